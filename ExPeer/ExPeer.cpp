@@ -3,10 +3,10 @@
 #include <iostream>
 #include <string>
 
-//	User-Defined Peer Class - Must inherit from NetPeer
+//	User-Defined Peer Class - Must inherit from NetPeer, given the channels it uses; NetPeer<> carries every one
 //	Allows the end-user to seamlessly integrate PeerNet into their application
 //	by providing their own derived NetPeer(client) class
-class MyPeer : public PeerNet::NetPeer
+class MyPeer : public PeerNet::NetPeer<>
 {
 	inline void Receive(PeerNet::ReceivePacket* Packet)
 	{
@@ -18,7 +18,7 @@ class MyPeer : public PeerNet::NetPeer
 	}
 public:
 	inline MyPeer(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
-		: PeerNet::NetPeer(PNInstance, DefaultSocket, NetAddr) {
+		: PeerNet::NetPeer<>(PNInstance, DefaultSocket, NetAddr) {
 		NewInterval(std::chrono::milliseconds(1000 / 60).count());	// 60 Ticks every 1 second
 	}
 };
@@ -29,7 +29,7 @@ public:
 class MyPeerFactory : public PeerNet::NetPeerFactory
 {
 public:
-	inline PeerNet::NetPeer* Create(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
+	inline PeerNet::NetPeerBase* Create(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
 	{
 		return new MyPeer(PNInstance, DefaultSocket, NetAddr);
 	}
@@ -50,7 +50,10 @@ enum OperationID
 	Ordered1 = 0,
 	Ordered2 = 1,
 	Ordered3 = 2,
-	Ordered4 = 3
+	Ordered4 = 3,
+	Snapshot1 = 0,
+	FEC1 = 0,
+	Keyed1 = 0
 };
 
 int main()
@@ -77,14 +80,26 @@ int main()
 	printf("\tr0 - Send 16 reliable packets to the discovered peer - Operation 0\n");
 	printf("\tr1 - Send 256 reliable packets to the discovered peer - Operation 1\n");
 	printf("\tr2 - Send 1024 reliable packets to the discovered peer - Operation 2\n");
-	printf("\tr3 - Send 10240 reliable packets to the discovered peer - Operation 3\n");
+	printf("\tr3 - Send 10240 reliable packets to the discovered peer, only the newest 1024 stay in flight - Operation 3\n");
 	printf("\tu0 - Send 16 unreliable packets to the discovered peer - Operation 0\n");
 	printf("\tu1 - Send 256 unreliable packets to the discovered peer - Operation 1\n");
 	printf("\tu2 - Send 1024 unreliable packets to the discovered peer - Operation 2\n");
 	printf("\tu3 - Send 10240 unreliable packets to the discovered peer - Operation 3\n");
+	printf("\tp0 - Send 16 bit packed position updates to the discovered peer - Operation 0\n");
+	printf("\ts0 - Send 16 snapshots of a mostly static world to the discovered peer - Operation 0\n");
+	printf("\tf0 - Send 256 FEC packets, 2 parity per 8 data, to the discovered peer - Operation 0\n");
+	printf("\tk0 - Write 1024 reliable values spread over 8 keys to the discovered peer - Operation 0\n");
+	printf("\tloss - Toggle dropping 1 in 10 reliable, ordered, FEC and keyed packets from the discovered peer\n");
+	printf("\timmediate - Toggle delivering the discovered peer's packets from the receive thread instead of each tick\n");
 	printf("\n");
 	printf("\tStatistics:\n");
 	printf("\trtt - Print the discovered peer's RTT's to the console\n");
+	printf("\n");
+	printf("\tCongestion:\n");
+	printf("\taimd - Use additive-increase multiplicative-decrease congestion control for the discovered peer\n");
+	printf("\tbbr - Use bandwidth and delay model congestion control for the discovered peer\n");
+	printf("\tlimit - Limit sends to the discovered peer to 64KB per second\n");
+	printf("\tunlimit - Remove the discovered peer's bandwidth limit\n");
 	
 	printf("\n");
 
@@ -99,8 +114,18 @@ int main()
 	MyPeerFactory* Factory = new MyPeerFactory();
 	PeerNet::PeerNet *_PeerNet = new PeerNet::PeerNet(Factory, 10240, 16);
 
+	//	Declare every operation before any peers exist
+	for (unsigned long OP = 0; OP < 4; OP++) {
+		_PeerNet->RegisterOperation({ PeerNet::PN_Ordered, OP });
+		_PeerNet->RegisterOperation({ PeerNet::PN_Reliable, OP });
+		_PeerNet->RegisterOperation({ PeerNet::PN_Unreliable, OP });
+	}
+	_PeerNet->RegisterOperation({ PeerNet::PN_Snapshot, OperationID::Snapshot1 });
+	_PeerNet->RegisterOperation({ PeerNet::PN_FEC, OperationID::FEC1, 0, false, 8, 2 });
+	_PeerNet->RegisterOperation({ PeerNet::PN_Keyed, OperationID::Keyed1, 0, true });
+
 	PeerNet::NetSocket* Socket = nullptr;
-	PeerNet::NetPeer* Peer = nullptr;
+	PeerNet::NetPeerBase* Peer = nullptr;
 
 	//	New Line before first command entry
 	printf("\n");
@@ -165,6 +190,7 @@ int main()
 				while (i < 16)
 				{
 					auto NewPacket = Peer->CreateOrderedPacket(OperationID::Ordered1);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm ordered!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -179,6 +205,7 @@ int main()
 				while (i < 256)
 				{
 					auto NewPacket = Peer->CreateOrderedPacket(OperationID::Ordered2);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm ordered!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -193,6 +220,7 @@ int main()
 				while (i < 1024)
 				{
 					auto NewPacket = Peer->CreateOrderedPacket(OperationID::Ordered3);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm ordered!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -207,6 +235,7 @@ int main()
 				while (i < 10240)
 				{
 					auto NewPacket = Peer->CreateOrderedPacket(OperationID::Ordered4);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm ordered!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -221,6 +250,7 @@ int main()
 				while (i < 16)
 				{
 					auto NewPacket = Peer->CreateReliablePacket(OperationID::Reliable1);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm reliable!!");
 					Peer->Send_Packet(NewPacket);
 				i++;
@@ -235,6 +265,7 @@ int main()
 				while (i < 256)
 				{
 					auto NewPacket = Peer->CreateReliablePacket(OperationID::Reliable2);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm reliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -249,6 +280,7 @@ int main()
 				while (i < 1024)
 				{
 					auto NewPacket = Peer->CreateReliablePacket(OperationID::Reliable3);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm reliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -263,6 +295,7 @@ int main()
 				while (i < 10240)
 				{
 					auto NewPacket = Peer->CreateReliablePacket(OperationID::Reliable4);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm reliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -277,6 +310,7 @@ int main()
 				while (i < 16)
 				{
 					auto NewPacket = Peer->CreateUnreliablePacket(OperationID::Unreliable1);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm unreliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -291,6 +325,7 @@ int main()
 				while (i < 256)
 				{
 					auto NewPacket = Peer->CreateUnreliablePacket(OperationID::Unreliable2);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm unreliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -305,6 +340,7 @@ int main()
 				while (i < 1024)
 				{
 					auto NewPacket = Peer->CreateUnreliablePacket(OperationID::Unreliable3);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm unreliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
@@ -319,19 +355,120 @@ int main()
 				while (i < 10240)
 				{
 					auto NewPacket = Peer->CreateUnreliablePacket(OperationID::Unreliable4);
+					if (NewPacket == nullptr) { break; }
 					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm unreliable!!");
 					Peer->Send_Packet(NewPacket);
 					i++;
 				}
 			}
 		}
+		else if (ConsoleInput == "p0")
+		{
+			if (Peer != nullptr)
+			{
+				unsigned int i = 0;
+				while (i < 16)
+				{
+					auto NewPacket = Peer->CreateUnreliablePacket(OperationID::Unreliable1);
+					if (NewPacket == nullptr) { break; }
+					NewPacket->WriteRanged(i, 0, 1023);	//	Entity ID - 10 bits
+					NewPacket->WriteQuantizedVector(i * 1.5f, 0.0f, -i * 2.25f, -512.0f, 512.0f, 16);	//	Position - 48 bits
+					NewPacket->WriteQuaternion(1.0f, 0.0f, 0.0f, 0.0f, 10);	//	Rotation - 32 bits
+					NewPacket->WriteBit(i % 2 == 0);	//	Grounded - 1 bit
+					Peer->Send_Packet(NewPacket);
+					i++;
+				}
+			}
+		}
+		else if (ConsoleInput == "s0")
+		{
+			if (Peer != nullptr)
+			{
+				//	1024 entities where only one changes each snapshot
+				static std::string World(1024, 'E');
+				unsigned int i = 0;
+				while (i < 16)
+				{
+					World[(i * 61) % World.size()]++;
+					auto NewPacket = Peer->CreateSnapshotPacket(OperationID::Snapshot1);
+					if (NewPacket == nullptr) { break; }
+					NewPacket->WriteData<std::string>(World);
+					Peer->Send_Packet(NewPacket);
+					i++;
+				}
+			}
+		}
+		else if (ConsoleInput == "f0")
+		{
+			if (Peer != nullptr)
+			{
+				unsigned int i = 0;
+				while (i < 256)
+				{
+					auto NewPacket = Peer->CreateFECPacket(OperationID::FEC1);
+					if (NewPacket == nullptr) { break; }
+					NewPacket->WriteData<std::string>("I'm about to be serialized and I'm error corrected!!");
+					Peer->Send_Packet(NewPacket);
+					i++;
+				}
+			}
+		}
+		else if (ConsoleInput == "k0")
+		{
+			if (Peer != nullptr)
+			{
+				unsigned int i = 0;
+				while (i < 1024)
+				{
+					auto NewPacket = Peer->CreateKeyedPacket(OperationID::Keyed1, i % 8);
+					if (NewPacket == nullptr) { break; }
+					NewPacket->WriteData<unsigned int>(i);
+					Peer->Send_Packet(NewPacket);
+					i++;
+				}
+			}
+		}
+		else if (ConsoleInput == "loss")
+		{
+			if (Peer != nullptr)
+			{
+				Peer->FakePacketLoss = Peer->FakePacketLoss ? 0 : 10;
+				printf("\tFake Packet Loss:\t%u%%\n", Peer->FakePacketLoss);
+			}
+		}
+		else if (ConsoleInput == "immediate")
+		{
+			if (Peer != nullptr)
+			{
+				Peer->SetImmediateDispatch(!Peer->ImmediateDispatching());
+				printf("\tImmediate Dispatch:\t%s\n", Peer->ImmediateDispatching() ? "On" : "Off");
+			}
+		}
 		else if (ConsoleInput == "rtt")
 		{
 			if (Peer != nullptr)
 			{
 				printf("\tKeep-Alive RTT:\t%.3fms\n", Peer->RTT_KOL().count());
+				printf("\tSmoothed RTT:\t%.3fms\n", Peer->RTT().count());
+				printf("\tRetransmit Timeout:\t%.3fms\n", Peer->RTO().count());
 			}
 		}
+		else if (ConsoleInput == "aimd")
+		{
+			if (Peer != nullptr) { Peer->SetCongestionControl(new PeerNet::CongestionAIMD()); }
+		}
+		else if (ConsoleInput == "bbr")
+		{
+			if (Peer != nullptr) { Peer->SetCongestionControl(new PeerNet::CongestionBBR()); }
+		}
+		else if (ConsoleInput == "limit")
+		{
+			if (Peer != nullptr) { Peer->SetRateLimit(65536); }
+		}
+		else if (ConsoleInput == "unlimit")
+		{
+			if (Peer != nullptr) { Peer->SetRateLimit(0); }
+		}
 		else if (ConsoleInput == "stats")
 		{
 			if (Peer != nullptr)
@@ -1,9 +1,9 @@
 #include "PeerNet.hpp"
 
-//	User-Defined Peer Class - Must inherit from NetPeer
+//	User-Defined Peer Class - Must inherit from NetPeer, given the channels it uses
 //	Allows the end-user to seamlessly integrate PeerNet into their application
 //	by providing their own derived NetPeer(client) class
-class MyPeer : public PeerNet::NetPeer {
+class MyPeer : public PeerNet::NetPeer<PeerNet::UnreliableChannel, PeerNet::ReliableChannel, PeerNet::OrderedChannel> {
 	//	This function is called whenever this peer receives a packet
 	inline void Receive(PeerNet::ReceivePacket* Packet) {
 		printf("Received Packet ID: %i\n", Packet->GetPacketID());
@@ -13,7 +13,7 @@ class MyPeer : public PeerNet::NetPeer {
 	inline void Tick() {}
 public:
 	inline MyPeer(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
-		: PeerNet::NetPeer(PNInstance, DefaultSocket, NetAddr) {
+		: NetPeer(PNInstance, DefaultSocket, NetAddr) {
 		NewInterval(std::chrono::milliseconds(1000 / 60).count());	// 60 Ticks every 1 second
 	}
 };
@@ -24,7 +24,7 @@ public:
 class MyPeerFactory : public PeerNet::NetPeerFactory {
 public:
 	//	This function is called whenever a new peer is created
-	inline PeerNet::NetPeer* Create(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr) {
+	inline PeerNet::NetPeerBase* Create(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr) {
 		return new MyPeer(PNInstance, DefaultSocket, NetAddr);
 	}
 };
@@ -44,6 +44,11 @@ int main() {
 	//	Initialize PeerNet, 10240 SendPackets, 10240 ReceivePackets, 16 maximum NetSockets
 	PeerNet::PeerNet *_PeerNet = new PeerNet::PeerNet(Factory, 10240, 16);
 
+	//	Declare every operation we'll use before any peers exist
+	_PeerNet->RegisterOperation({ PeerNet::PN_Unreliable, OperationID::Unreliable1 });
+	_PeerNet->RegisterOperation({ PeerNet::PN_Reliable, OperationID::Reliable1 });
+	_PeerNet->RegisterOperation({ PeerNet::PN_Ordered, OperationID::Ordered1 });
+
 	//	Open a socket at 127.0.0.1:9999
 	PeerNet::NetSocket* Socket = _PeerNet->OpenSocket("127.0.0.1", "9999");
 
@@ -51,11 +56,12 @@ int main() {
 	_PeerNet->SetDefaultSocket(Socket);
 
 	//	Connect to our socket, represented as a NetPeer
-	PeerNet::NetPeer* Peer = _PeerNet->GetPeer("127.0.0.1", "9999");
+	PeerNet::NetPeerBase* Peer = _PeerNet->GetPeer("127.0.0.1", "9999");
 
 	//	Send some Unreliable Packets
 	for (int i = 0; i < 4; i++) {
 		auto NewPacket = Peer->CreateUnreliablePacket(OperationID::Unreliable1);
+		if (NewPacket == nullptr) { break; }
 		NewPacket->WriteData<std::string>("I'm about to be serialized and I'm unreliable!!");
 		Peer->Send_Packet(NewPacket);
 		i++;
@@ -64,6 +70,7 @@ int main() {
 	//	Send some Reliable Packets
 	for (int i = 0; i < 4; i++) {
 		auto NewPacket = Peer->CreateReliablePacket(OperationID::Reliable1);
+		if (NewPacket == nullptr) { break; }
 		NewPacket->WriteData<std::string>("I'm about to be serialized and I'm reliable!!");
 		Peer->Send_Packet(NewPacket);
 		i++;
@@ -72,6 +79,7 @@ int main() {
 	//	Send some Ordered Packets
 	for (int i = 0; i < 4; i++) {
 		auto NewPacket = Peer->CreateOrderedPacket(OperationID::Ordered1);
+		if (NewPacket == nullptr) { break; }
 		NewPacket->WriteData<std::string>("I'm about to be serialized and I'm ordered!!");
 		Peer->Send_Packet(NewPacket);
 	}
@@ -0,0 +1,1246 @@
+#include "PeerNet.hpp"
+
+//	Self checking tests for the parts of PeerNet that need no network
+//	Prints every failed check and returns non-zero if there were any
+
+int Failures = 0;
+#define CHECK(Expression) if (!(Expression)) { printf("\tFAILED line %i: %s\n", __LINE__, #Expression); ++Failures; }
+
+//	Builds a delta by hand: StateSize then a single { ZeroRun, LiteralRun, Literals } run
+inline std::string MakeDelta(const size_t StateSize, const size_t ZeroRun, const size_t LiteralRun, const size_t Literals)
+{
+	std::string Delta;
+	PeerNet::SnapshotDelta::WriteVarInt(Delta, StateSize);
+	PeerNet::SnapshotDelta::WriteVarInt(Delta, ZeroRun);
+	PeerNet::SnapshotDelta::WriteVarInt(Delta, LiteralRun);
+	Delta.append(Literals, '\x01');
+	return Delta;
+}
+
+//	Deltas come straight off the wire; every malformed one must be refused without writing or reading out of bounds
+inline void TestSnapshotDecode()
+{
+	printf("Snapshot Decode\n");
+	using namespace PeerNet::SnapshotDelta;
+	const std::string Baseline(64, 'A');
+	std::string State(Baseline);
+	State[3] = 'B'; State[40] = 'C';
+	std::string Decoded;
+
+	//	Round trip
+	CHECK(Decode(Baseline, Encode(Baseline, State), Decoded) && Decoded == State);
+	//	Truncated varint
+	CHECK(!Decode(Baseline, std::string(1, '\x80'), Decoded));
+	//	Zero run past the end of the state
+	CHECK(!Decode(Baseline, MakeDelta(64, 65, 0, 0), Decoded));
+	//	Zero run big enough to wrap Out around
+	CHECK(!Decode(Baseline, MakeDelta(64, ~(size_t)0, 1, 1), Decoded));
+	//	Literal run past the end of the state
+	CHECK(!Decode(Baseline, MakeDelta(64, 60, 8, 8), Decoded));
+	//	Literal run big enough to wrap once added to Out or Pos
+	CHECK(!Decode(Baseline, MakeDelta(64, 8, ~(size_t)0 - 4, 4), Decoded));
+	//	Literal run longer than the delta that carries it
+	CHECK(!Decode(Baseline, MakeDelta(64, 0, 16, 4), Decoded));
+	//	Exactly filling the state is fine
+	CHECK(Decode(Baseline, MakeDelta(64, 60, 4, 4), Decoded) && Decoded.size() == 64);
+}
+
+//	Channels left out of a set take no slot and are simply not found
+inline void TestChannelSet()
+{
+	printf("Channel Set\n");
+	using namespace PeerNet;
+	ChannelTable<ReliableChannel, OrderedChannel> Table(ChannelContext{ nullptr, nullptr, nullptr, nullptr, false });
+	CHECK(Table.Find<ReliableChannel>() == Table.Get<ReliableChannel>());
+	CHECK(Table.Find<OrderedChannel>() == Table.Get<OrderedChannel>());
+	CHECK(Table.Find<FECChannel>() == nullptr);
+	CHECK(Table.Find<KeyedChannel>() == nullptr);
+	CHECK(!Table.Receive(PN_FEC, nullptr));
+	unsigned int Count = 0;
+	Table.ForEach([&](auto*const) { ++Count; });
+	CHECK(Count == 2);
+}
+
+//	The smallest peer that can be built, for any channel set
+template <typename... Channels>
+class TestPeer : public PeerNet::NetPeer<Channels...>
+{
+	inline void Tick() {}
+	inline void Receive(PeerNet::ReceivePacket* Packet) {}
+public:
+	inline TestPeer(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
+		: PeerNet::NetPeer<Channels...>(PNInstance, DefaultSocket, NetAddr) {}
+};
+
+//	Building one means every channel specific part of a reduced peer compiles
+class ReducedFactory : public PeerNet::NetPeerFactory
+{
+public:
+	inline PeerNet::NetPeerBase* Create(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
+	{
+		return new TestPeer<PeerNet::ReliableChannel, PeerNet::OrderedChannel>(PNInstance, DefaultSocket, NetAddr);
+	}
+};
+
+//	Times Count dispatches of an ordered channel queue swap through Table's jump table
+template <typename Table>
+inline double TimeDispatch(Table& Channels, const unsigned long Count)
+{
+	std::deque<PeerNet::ReceivePacket*> Queue;
+	const auto Start = std::chrono::steady_clock::now();
+	for (unsigned long i = 0; i < Count; i++) { Channels.SwapProcessingQueue(PeerNet::PN_Ordered, Queue); }
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / Count;
+}
+
+//	A reduced peer is smaller than one carrying every channel by about the channels it leaves out
+//	Both reach their channels through the same jump, so dispatch costs the same whichever set it is
+inline void TestPeerChannelSets()
+{
+	printf("Peer Channel Sets\n");
+	using namespace PeerNet;
+	ReducedFactory Factory;
+	typedef ChannelTable<ReliableChannel, OrderedChannel> Reduced;
+	typedef PeerChannels<>::Table Full;
+	const size_t ReducedPeer = sizeof(TestPeer<ReliableChannel, OrderedChannel>);
+	const size_t FullPeer = sizeof(TestPeer<>);
+	printf("\tNetPeerBase %zu bytes, reduced peer %zu bytes, full peer %zu bytes\n", sizeof(NetPeerBase), ReducedPeer, FullPeer);
+	CHECK(ReducedPeer < FullPeer);
+	CHECK(ReducedPeer >= sizeof(NetPeerBase) + sizeof(Reduced));
+	CHECK(FullPeer - ReducedPeer >= sizeof(UnreliableChannel) + sizeof(SnapshotChannel) + sizeof(FECChannel) + sizeof(KeyedChannel));
+
+	//	Visit reaches the channel for a type and nothing for a type left out
+	Reduced Small(ChannelContext{ nullptr, nullptr, nullptr, nullptr, false });
+	bool Ordered = false;
+	CHECK(Small.Visit(PN_Ordered, [&](auto*const Channel) { Ordered = std::is_same<std::decay_t<decltype(*Channel)>, OrderedChannel>::value; }));
+	CHECK(Ordered);
+	CHECK(!Small.Visit(PN_Keyed, [&](auto*const) { Ordered = false; }));
+	CHECK(Ordered);
+	unsigned int With = 0;
+	Small.With<ReliableChannel>([&](ReliableChannel*const) { ++With; });
+	Small.With<FECChannel>([&](FECChannel*const) { ++With; });
+	CHECK(With == 1);
+
+	Full* Large = new Full(ChannelContext{ nullptr, nullptr, nullptr, nullptr, false });
+	const unsigned long Count = 10000000;
+	const double SmallNs = TimeDispatch(Small, Count);
+	const double LargeNs = TimeDispatch(*Large, Count);
+	printf("\tDispatch %.2fns reduced, %.2fns full\n", SmallNs, LargeNs);
+	delete Large;
+}
+
+//	An IPv4 stranger at 10.0.0.0 + Host
+inline PeerNet::PeerKey Stranger(const unsigned long Host)
+{
+	SOCKADDR_INET Addr = {};
+	Addr.Ipv4.sin_family = AF_INET;
+	Addr.Ipv4.sin_addr.s_addr = 0x0A000000 + Host;
+	Addr.Ipv4.sin_port = 1000;
+	return PeerNet::PeerKey(&Addr);
+}
+
+//	A flood of Hellos from spoofed addresses gets a bounded number of replies
+//	and must not keep out a client that already holds a valid cookie
+inline void TestHelloFlood()
+{
+	printf("Hello Flood\n");
+	using namespace PeerNet;
+	HandshakeGate Gate;
+	const PeerKey Client(Stranger(0));
+	unsigned long long ClientCookie = 0;
+	CHECK(Gate.Hello(Client, ClientCookie));
+
+	const unsigned long Flood = 100000;
+	unsigned long Answered = 0;
+	unsigned long long Cookie = 0;
+	const auto Start = std::chrono::steady_clock::now();
+	for (unsigned long i = 1; i <= Flood; i++) { if (Gate.Hello(Stranger(i), Cookie)) { ++Answered; } }
+	const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	printf("\t%lu Hellos in %.3fs, %lu answered\n", Flood, Seconds, Answered);
+	CHECK(Answered <= PN_ChallengeBurst + (unsigned long)(Seconds * PN_ChallengeRate) + 1);
+	CHECK(Answered < Flood);
+
+	//	Forged cookies are refused and spend nothing
+	for (unsigned long i = 1; i <= PN_AdmissionBurst * 2; i++) { CHECK(!Gate.Response(Stranger(i), i)); }
+	//	Someone else's cookie is no good either
+	CHECK(!Gate.Response(Stranger(1), ClientCookie));
+	//	The client that answered its Challenge still gets in
+	CHECK(Gate.Response(Client, ClientCookie));
+}
+
+//	Junk from strangers arriving the way a receive thread hands it over
+//	Every datagram must be dropped and counted without decompressing anything that can't be a handshake, and nothing may throw
+inline void TestStrangerFlood()
+{
+	printf("Stranger Flood\n");
+	using namespace PeerNet;
+	PeerNet::PeerNet Net(nullptr, 16, 1);
+	ZSTD_DCtx*const Context = ZSTD_createDCtx();
+	char Uncompressed[PN_MaxPacketSize];
+	char Datagram[PN_MaxPacketSize];
+	std::mt19937 Random(1);
+	SOCKADDR_INET From = {};
+	From.Ipv4.sin_family = AF_INET;
+	From.Ipv4.sin_port = 1000;
+	unsigned long Sent = 0;
+	const auto Start = std::chrono::steady_clock::now();
+
+	//	Random bytes of every size
+	for (unsigned long i = 0; i < 100000; i++, Sent++)
+	{
+		const size_t Size = 1 + Random() % PN_MaxPacketSize;
+		for (size_t b = 0; b < Size; b++) { Datagram[b] = (char)Random(); }
+		From.Ipv4.sin_addr.s_addr = Random();
+		Net.TranslateData(nullptr, &From, Datagram, Size, Context, Uncompressed);
+	}
+	//	Well formed frames that are too big to be a handshake
+	const std::string Big(512, 'x');
+	const size_t BigSize = ZSTD_compress(Datagram, PN_MaxPacketSize, Big.data(), Big.size(), 1);
+	for (unsigned long i = 0; i < 1000; i++, Sent++) { Net.TranslateData(nullptr, &From, Datagram, BigSize, Context, Uncompressed); }
+	//	Frames of exactly a handshakes size that are something else entirely
+	const std::string NotHandshake(ReceivePacket::Compose(1, PN_Reliable, 0, std::chrono::steady_clock::now(), std::string(HandshakeSize() - ReceivePacket::HeaderSize(), '\0')));
+	const size_t NotSize = ZSTD_compress(Datagram, PN_MaxPacketSize, NotHandshake.data(), NotHandshake.size(), 1);
+	for (unsigned long i = 0; i < 1000; i++, Sent++) { Net.TranslateData(nullptr, &From, Datagram, NotSize, Context, Uncompressed); }
+	//	A Hello cut short; the header still claims a handshakes size
+	const std::string Hello(HandshakePacket(HS_Hello, 0));
+	const size_t HelloSize = ZSTD_compress(Datagram, PN_MaxPacketSize, Hello.data(), Hello.size(), 1);
+	for (unsigned long i = 0; i < 1000; i++, Sent++) { Net.TranslateData(nullptr, &From, Datagram, 1 + i % (HelloSize - 1), Context, Uncompressed); }
+	const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	printf("\t%lu datagrams in %.3fs, %llu rejected\n", Sent, Seconds, Net.GetRejectedCount());
+	CHECK(Net.GetRejectedCount() == Sent);
+	ZSTD_freeDCtx(Context);
+}
+
+//	An IPv6 stranger at 2001:db8::Host
+inline SOCKADDR_INET Stranger6(const unsigned long Host)
+{
+	SOCKADDR_INET Addr = {};
+	Addr.Ipv6.sin6_family = AF_INET6;
+	Addr.Ipv6.sin6_addr.u.Byte[0] = 0x20;
+	Addr.Ipv6.sin6_addr.u.Byte[1] = 0x01;
+	Addr.Ipv6.sin6_addr.u.Byte[2] = 0x0d;
+	Addr.Ipv6.sin6_addr.u.Byte[3] = 0xb8;
+	std::memcpy(&Addr.Ipv6.sin6_addr.u.Byte[12], &Host, 4);
+	Addr.Ipv6.sin6_port = 1000;
+	return Addr;
+}
+
+//	Peers are found and connected by their binary address whichever family it is
+//	Connecting and disconnecting only touch a bucket, so churn stays cheap with the table full
+inline void TestPeerTable()
+{
+	printf("Peer Table\n");
+	using namespace PeerNet;
+	//	A new peer gets its address straight from the datagram, IPv6 included
+	ReducedFactory Factory;
+	PeerNet::PeerNet Net(&Factory, 16, 1, true);
+	const SOCKADDR_INET V6 = Stranger6(0x01000000);
+	NetPeerBase*const Peer = Net.GetPeer(&V6);
+	CHECK(Peer != nullptr);
+	if (Peer != nullptr)
+	{
+		CHECK(Peer->GetAddress()->GetFormatted() == "[2001:db8:0:0:0:0:0:1]:1000");
+		CHECK(PeerKey(Peer->GetAddress()->SockAddr()) == PeerKey(&V6));
+		CHECK(Net.GetPeer(&V6) == Peer);
+		Net.DisconnectPeer(Peer);
+	}
+
+	//	Fake peers; the table never looks inside them
+	const unsigned long Count = 100000;
+	PeerTable Table;
+	auto Fake = [](const unsigned long i) { return (NetPeerBase*)(uintptr_t)(i + 1); };
+	auto Start = std::chrono::steady_clock::now();
+	for (unsigned long i = 0; i < Count; i++) { Table.FindOrCreate(Stranger(i), [&]() { return Fake(i); }); }
+	const double InsertNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / Count;
+	unsigned long Found = 0;
+	Start = std::chrono::steady_clock::now();
+	for (unsigned long Round = 0; Round < 10; Round++)
+	{
+		for (unsigned long i = 0; i < Count; i++) { if (Table.Find(Stranger(i)) == Fake(i)) { ++Found; } }
+	}
+	const double FindNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / (Count * 10);
+	CHECK(Found == Count * 10);
+	CHECK(Table.Find(Stranger(Count)) == nullptr);
+	//	Only the peer an address belongs to can take it out
+	CHECK(!Table.Erase(Stranger(0), Fake(1)));
+	//	One peer leaving and another arriving, over and over, with the table full
+	Start = std::chrono::steady_clock::now();
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		CHECK(Table.Erase(Stranger(i), Fake(i)));
+		Table.FindOrCreate(Stranger(Count + i), [&]() { return Fake(Count + i); });
+	}
+	const double ChurnNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / Count;
+	CHECK(Table.Find(Stranger(0)) == nullptr);
+	CHECK(Table.Find(Stranger(Count * 2 - 1)) == Fake(Count * 2 - 1));
+	unsigned long Visited = 0;
+	Table.ForEach([&](NetPeerBase*const) { ++Visited; });
+	CHECK(Visited == Count);
+	CHECK(Table.Clear().size() == Count);
+	CHECK(Table.Find(Stranger(Count)) == nullptr);
+	EpochManager::Instance().Synchronize();
+	printf("\t%lu peers: %.0fns per connect, %.0fns per lookup, %.0fns per disconnect and connect\n", Count, InsertNs, FindNs, ChurnNs);
+}
+
+//	A peer for two PeerNets talking over loopback
+//	The echoing side sends every unreliable packet straight back; the other side times how long each took to come back
+//	Reliable and ordered packets are only counted
+class LoopbackPeer : public PeerNet::NetPeer<PeerNet::UnreliableChannel, PeerNet::ReliableChannel, PeerNet::OrderedChannel>
+{
+	inline void Tick() {}
+	inline void Receive(PeerNet::ReceivePacket* Packet)
+	{
+		switch (Packet->GetType())
+		{
+			case PeerNet::PN_Unreliable:
+			{
+				const long long Sent = Packet->ReadData<long long>();
+				if (Echo) {
+					PeerNet::SendPacket*const Pong = CreateUnreliablePacket(0);
+					if (Pong != nullptr) { Pong->WriteData<long long>(Sent); Send_Packet(Pong); }
+				}
+				else { RoundTrips.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch() - std::chrono::steady_clock::duration(Sent)).count()); }
+			}
+			break;
+			default:
+				++Received;
+				Bytes += Packet->GetRemaining();
+		}
+	}
+public:
+	const bool Echo;
+	std::vector<double> RoundTrips;		//	Milliseconds
+	unsigned long Received = 0;			//	Reliable and ordered packets
+	unsigned long long Bytes = 0;		//	Their payload
+
+	inline LoopbackPeer(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr, const bool Echoing)
+		: NetPeer(PNInstance, DefaultSocket, NetAddr), Echo(Echoing) {
+		NewInterval(std::chrono::milliseconds(1000 / 60).count());	// 60 Ticks every 1 second, as the examples tick
+	}
+};
+
+class LoopbackFactory : public PeerNet::NetPeerFactory
+{
+	const bool Echo;
+public:
+	inline LoopbackFactory(const bool Echoing) : Echo(Echoing) {}
+	inline PeerNet::NetPeerBase* Create(PeerNet::PeerNet* PNInstance, PeerNet::NetSocket*const DefaultSocket, PeerNet::NetAddress*const NetAddr)
+	{
+		return new LoopbackPeer(PNInstance, DefaultSocket, NetAddr, Echo);
+	}
+};
+
+//	A client and an echoing server, each a polled PeerNet on its own loopback port
+//	Everything runs on the calling thread, one Poll of each side per Pump
+struct Loopback
+{
+	LoopbackFactory ClientFactory;
+	LoopbackFactory ServerFactory;
+	PeerNet::PeerNet Client;
+	PeerNet::PeerNet Server;
+	LoopbackPeer* ToServer = nullptr;	//	The client's peer for the server
+	LoopbackPeer* ToClient = nullptr;	//	The server's peer for the client
+
+	inline Loopback(const std::string& ClientPort, const std::string& ServerPort)
+		: ClientFactory(false), ServerFactory(true), Client(&ClientFactory, 16, 1, true), Server(&ServerFactory, 16, 1, true)
+	{
+		for (PeerNet::PeerNet* Net : { &Client, &Server })
+		{
+			Net->RegisterOperation({ PeerNet::PN_Unreliable, 0 });
+			Net->RegisterOperation({ PeerNet::PN_Reliable, 0 });
+			Net->RegisterOperation({ PeerNet::PN_Ordered, 0 });
+		}
+		Client.SetDefaultSocket(Client.OpenSocket("127.0.0.1", ClientPort));
+		Server.SetDefaultSocket(Server.OpenSocket("127.0.0.1", ServerPort));
+		ToServer = (LoopbackPeer*)Client.GetPeer("127.0.0.1", ServerPort);
+		//	Hello, Challenge, Response and its echo
+		const auto Start = std::chrono::steady_clock::now();
+		while (ToServer != nullptr && !ToServer->IsConnected() && std::chrono::steady_clock::now() - Start < std::chrono::seconds(5)) { Pump(); }
+		ToClient = (LoopbackPeer*)Server.GetPeer("127.0.0.1", ClientPort);
+	}
+
+	inline const bool Connected() const { return ToServer != nullptr && ToClient != nullptr && ToServer->IsConnected(); }
+
+	inline void Pump()
+	{
+		Client.Poll(1024);
+		Server.Poll(1024);
+	}
+};
+
+//	Milliseconds for Count unreliable pings to the server and back, one at a time
+inline std::vector<double> PingPong(Loopback& Link, const unsigned long Count)
+{
+	Link.ToServer->RoundTrips.clear();
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		PeerNet::SendPacket*const Ping = Link.ToServer->CreateUnreliablePacket(0);
+		Ping->WriteData<long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+		Link.ToServer->Send_Packet(Ping);
+		const auto Start = std::chrono::steady_clock::now();
+		while (Link.ToServer->RoundTrips.size() <= i && std::chrono::steady_clock::now() - Start < std::chrono::seconds(1)) { Link.Pump(); }
+	}
+	std::vector<double> RoundTrips(Link.ToServer->RoundTrips);
+	std::sort(RoundTrips.begin(), RoundTrips.end());
+	return RoundTrips;
+}
+
+//	A packet reaches Receive() as soon as it's received with immediate dispatch, instead of on the peer's next tick
+//	So the server answering a ping adds nothing like the up to 16ms a 60Hz tick does
+inline void TestPingPong()
+{
+	printf("Ping Pong\n");
+	Loopback Link("9100", "9101");
+	CHECK(Link.Connected());
+	if (!Link.Connected()) { return; }
+	//	The client takes its pongs straight off the socket either way, so only the server's delivery differs
+	Link.ToServer->SetImmediateDispatch(true);
+	const unsigned long Count = 100;
+	Link.ToClient->SetImmediateDispatch(false);
+	const std::vector<double> Ticked(PingPong(Link, Count));
+	Link.ToClient->SetImmediateDispatch(true);
+	const std::vector<double> Immediate(PingPong(Link, Count));
+	CHECK(Ticked.size() == Count && Immediate.size() == Count);
+	if (Ticked.size() != Count || Immediate.size() != Count) { return; }
+	printf("\tRound trip on the next tick: %.3fms median, %.3fms 99th percentile\n", Ticked[Count / 2], Ticked[Count * 99 / 100]);
+	printf("\tRound trip with immediate dispatch: %.3fms median, %.3fms 99th percentile\n", Immediate[Count / 2], Immediate[Count * 99 / 100]);
+	CHECK(Immediate[Count / 2] < Ticked[Count / 2]);
+}
+
+//	Kilobytes per second of ordered payload the server receives while the client streams Count packets of Size bytes
+//	The client keeps at most Ahead packets undelivered so the server's reorder window is never the limit
+inline double Goodput(Loopback& Link, const unsigned long Count, const unsigned long Size, const unsigned long Ahead)
+{
+	std::string Payload(Size, 0);
+	for (auto& Byte : Payload) { Byte = (char)rand(); }	//	Keep compression from shrinking it
+	Link.ToClient->Received = 0;
+	Link.ToClient->Bytes = 0;
+	unsigned long Sent = 0;
+	const auto Start = std::chrono::steady_clock::now();
+	while (Link.ToClient->Received < Count && std::chrono::steady_clock::now() - Start < std::chrono::seconds(20))
+	{
+		while (Sent < Count && Sent - Link.ToClient->Received < Ahead)
+		{
+			PeerNet::SendPacket*const Packet = Link.ToServer->CreateOrderedPacket(0);
+			Packet->WriteData<std::string>(Payload);
+			Link.ToServer->Send_Packet(Packet);
+			++Sent;
+		}
+		Link.Pump();
+	}
+	if (Link.ToClient->Received < Count) { return 0; }
+	return Link.ToClient->Bytes / 1024.0 / std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+//	An ordered stream keeps moving as loss rises, for either congestion controller
+//	AIMD halves its window on every loss event while BBR ignores loss, so BBR should hold up better
+inline void TestGoodput()
+{
+	printf("Goodput\n");
+	Loopback Link("9102", "9103");
+	CHECK(Link.Connected());
+	if (!Link.Connected()) { return; }
+	Link.ToClient->SetImmediateDispatch(true);
+	const unsigned long Count = 2000;
+	const unsigned short Losses[] = { 0, 1, 5, 10, 20 };
+	double Rates[2][5] = {};
+	for (const bool BBR : { false, true })
+	{
+		if (BBR) { Link.ToServer->SetCongestionControl(new PeerNet::CongestionBBR()); }
+		for (unsigned char i = 0; i < 5; i++)
+		{
+			Link.ToClient->FakePacketLoss = Losses[i];
+			Rates[BBR][i] = Goodput(Link, Count, 1024, 256);
+			printf("\t%s at %u%% loss: %.0fKB/s\n", BBR ? "BBR" : "AIMD", Losses[i], Rates[BBR][i]);
+			CHECK(Rates[BBR][i] > 0);
+		}
+	}
+	Link.ToClient->FakePacketLoss = 0;
+	CHECK(Rates[1][3] > Rates[0][3]);
+}
+
+//	Bytes resent while the client sends Count updates of Size bytes on Channel, one every millisecond
+inline unsigned long long Resent(Loopback& Link, const PeerNet::PacketType Channel, const unsigned long Count, const unsigned long Size)
+{
+	std::string Payload(Size, 0);
+	for (auto& Byte : Payload) { Byte = (char)rand(); }
+	const unsigned long long Before = Link.ToServer->GetResentBytes();
+	auto Next = std::chrono::steady_clock::now();
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		PeerNet::SendPacket*const Packet = Channel == PeerNet::PN_Reliable ? Link.ToServer->CreateReliablePacket(0) : Link.ToServer->CreateOrderedPacket(0);
+		Packet->WriteData<std::string>(Payload);
+		Link.ToServer->Send_Packet(Packet);
+		Next += std::chrono::milliseconds(1);
+		while (std::chrono::steady_clock::now() < Next) { Link.Pump(); }
+	}
+	//	Give the last losses time to go out again
+	const auto Settle = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+	while (std::chrono::steady_clock::now() < Settle) { Link.Pump(); }
+	return Link.ToServer->GetResentBytes() - Before;
+}
+
+//	Reliable only resends the newest unacknowledged packet of an operation, where ordered has to fill every gap
+//	So the same stream of updates under the same loss costs reliable far fewer resent bytes
+inline void TestRetransmitBandwidth()
+{
+	printf("Retransmit Bandwidth\n");
+	Loopback Link("9104", "9105");
+	CHECK(Link.Connected());
+	if (!Link.Connected()) { return; }
+	Link.ToClient->SetImmediateDispatch(true);
+	Link.ToClient->FakePacketLoss = 10;
+	const unsigned long Count = 1000;
+	const unsigned long Size = 256;
+	const unsigned long long Reliable = Resent(Link, PeerNet::PN_Reliable, Count, Size);
+	const unsigned long long Ordered = Resent(Link, PeerNet::PN_Ordered, Count, Size);
+	Link.ToClient->FakePacketLoss = 0;
+	printf("\t%lu updates of %lu bytes at 10%% loss: reliable resent %.1fKB, ordered resent %.1fKB\n", Count, Size, Reliable / 1024.0, Ordered / 1024.0);
+	CHECK(Reliable < Ordered);
+}
+
+//	Counts its ticks and notes every thread that ran one
+class CountedEvent : public TimedEvent
+{
+	inline void OnTick()
+	{
+		++Ticks;
+		//	Each thread only records itself once per run
+		static thread_local unsigned long Seen = 0;
+		if (Seen == Run.load()) { return; }
+		Seen = Run.load();
+		std::lock_guard<std::mutex> Lock(ThreadsMutex);
+		Threads.push_back(std::this_thread::get_id());
+	}
+	inline void OnExpire() {}
+public:
+	inline static std::atomic<unsigned long> Run = 0;
+	inline static std::mutex ThreadsMutex;
+	inline static std::vector<std::thread::id> Threads;
+	std::atomic<unsigned long> Ticks = 0;
+
+	inline CountedEvent(const long long Interval) : TimedEvent(std::chrono::milliseconds(Interval), 0) {}
+	inline ~CountedEvent() { StopTimer(); }
+};
+
+//	However many peers there are, the timer wheel ticks them all from its own thread and the executor's workers
+//	Each one costs a TimerEntry, where it used to cost a thread and its stack
+inline void TestTimerScale()
+{
+	printf("Timer Scale\n");
+	const long long Interval = 100;
+	const long long Window = 2000;
+	for (const unsigned long Count : { 10000ul, 100000ul })
+	{
+		CountedEvent::Run++;
+		CountedEvent::Threads.clear();
+		std::vector<std::unique_ptr<CountedEvent>> Events;
+		for (unsigned long i = 0; i < Count; i++) { Events.emplace_back(new CountedEvent(Interval)); }
+		const auto Start = std::chrono::steady_clock::now();
+		for (auto& Event : Events) { Event->StartTimer(); }
+		const double StartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+		std::this_thread::sleep_for(std::chrono::milliseconds(Window));
+		const auto StopStart = std::chrono::steady_clock::now();
+		for (auto& Event : Events) { Event->StopTimer(); }
+		const double StopMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - StopStart).count();
+		unsigned long long Ticks = 0;
+		for (auto& Event : Events) { Ticks += Event->Ticks.load(); }
+		const double Expected = (double)Count * Window / Interval;
+		size_t Threads = 0;
+		{
+			std::lock_guard<std::mutex> Lock(CountedEvent::ThreadsMutex);
+			Threads = CountedEvent::Threads.size();
+		}
+		printf("\t%lu events every %lldms: %llu of %.0f ticks in %lldms from %zu threads, %zu bytes each, %.0fms to start and %.0fms to stop them all\n",
+			Count, Interval, Ticks, Expected, Window, Threads, sizeof(TimerEntry), StartMs, StopMs);
+		CHECK(Threads > 0 && Threads <= std::thread::hardware_concurrency() + 2);
+		CHECK(Ticks > Expected / 2);
+	}
+}
+
+//	A peer's tick worth Units of work; notes the worker that ran it
+struct SkewedTask : public ExecutorTask
+{
+	unsigned long Units = 0;
+	std::atomic<unsigned long>* Done = nullptr;
+	std::thread::id Worker;
+	volatile unsigned long long Sink = 0;
+
+	inline void Run()
+	{
+		Worker = std::this_thread::get_id();
+		for (unsigned long i = 0; i < Units; i++) { Sink = Sink + i * i; }
+		++*Done;
+	}
+};
+
+//	Tasks from outside the pool are dealt round robin, so every heavy peer here lands in the same worker's inbox
+//	Idle workers steal from it, so the work still ends up spread across all of them
+inline void TestExecutorBalance()
+{
+	printf("Executor Balance\n");
+	TaskExecutor& Executor = TaskExecutor::Instance();
+	const size_t Workers = Executor.WorkerCount();
+	const unsigned long Count = 1000;
+	const unsigned long Light = 1000;
+	const unsigned long Heavy = 200000;
+	std::vector<SkewedTask> Tasks(Count);
+	std::map<std::thread::id, unsigned long long> Units;
+	unsigned long long Total = 0;
+	const auto Start = std::chrono::steady_clock::now();
+	for (unsigned char Round = 0; Round < 10; Round++)
+	{
+		std::atomic<unsigned long> Done = 0;
+		//	One peer in fifty does heavy work and they all share an inbox
+		for (unsigned long i = 0; i < Count; i++)
+		{
+			Tasks[i].Units = (i % (Workers * 25) == 0) ? Heavy : Light;
+			Tasks[i].Done = &Done;
+			Executor.Submit(&Tasks[i]);
+		}
+		while (Done.load() < Count) { std::this_thread::yield(); }
+		for (auto& Task : Tasks) { Units[Task.Worker] += Task.Units; Total += Task.Units; }
+	}
+	const double Ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+	unsigned long long Busiest = 0;
+	for (auto& Entry : Units) { Busiest = (std::max)(Busiest, Entry.second); }
+	//	Without stealing the inbox that got every heavy peer would do nearly all of it
+	const double Share = (double)Busiest / Total;
+	printf("\t%zu workers, %zu did work, busiest did %.1f%% of it (%.1f%% would be even), %.1fms for 10 rounds\n",
+		Workers, Units.size(), Share * 100, 100.0 / Workers, Ms);
+	CHECK(Share < 1.0 - 0.5 / Workers);
+}
+
+//	Each acknowledgement only visits the slots it newly covers, so its cost doesn't grow with what's in flight
+//	Past PN_ReliableWindow outstanding packets the oldest give up their slots
+inline void TestReliableWindow()
+{
+	printf("Reliable Window\n");
+	using namespace PeerNet;
+	for (const unsigned long Count : { 16ul, 256ul, 1024ul, 10240ul })
+	{
+		AckTracker Acks(nullptr);
+		RTTEstimator Estimator;
+		SendPacer Pacer(nullptr, &Estimator, &Acks, new CongestionAIMD());
+		ReliableChannel Channel(nullptr, PN_Reliable, &Acks, &Estimator, &Pacer);
+		Channel.Register(0);
+		for (unsigned long i = 0; i < Count; i++) { Channel.NewPacket(0); }
+		const unsigned long InFlight = Channel.Outstanding(0);
+		CHECK(InFlight == (std::min)(Count, (unsigned long)PN_ReliableWindow));
+		//	One acknowledgement per packet, oldest first, as they'd arrive
+		const unsigned long First = Count - InFlight + 1;
+		const auto Start = std::chrono::steady_clock::now();
+		for (unsigned long ID = First; ID <= Count; ID++) { Channel.ACK(ID, 0); }
+		const double AckNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / InFlight;
+		printf("\t%lu sent, %lu in flight: %.0fns per acknowledgement\n", Count, InFlight, AckNs);
+	}
+	EpochManager::Instance().Synchronize();
+}
+
+//	Counts its own destruction so retirement can be watched
+struct Retiree
+{
+	std::atomic<unsigned long>*const Destroyed;
+	inline ~Retiree() { ++*Destroyed; }
+};
+
+//	More threads than there used to be epoch slots pin at once, then exit and leave their slots to the next batch
+//	Nothing retired meanwhile may be destroyed while a thread is still pinned
+inline void TestEpochThreads()
+{
+	printf("Epoch Threads\n");
+	using namespace PeerNet;
+	const unsigned long Threads = 256;
+	std::atomic<unsigned long> Destroyed(0);
+	for (unsigned char Batch = 0; Batch < 2; Batch++)
+	{
+		std::atomic<unsigned long> Pinned(0);
+		std::atomic<bool> Done(false);
+		std::vector<std::thread> Workers;
+		for (unsigned long i = 0; i < Threads; i++)
+		{
+			Workers.emplace_back([&]() {
+				EpochGuard Guard;
+				++Pinned;
+				while (!Done.load()) { std::this_thread::yield(); }
+			});
+		}
+		while (Pinned.load() < Threads) { std::this_thread::yield(); }
+		Retire(new Retiree{ &Destroyed });
+		for (unsigned char i = 0; i < 4; i++) { EpochManager::Instance().Collect(); }
+		CHECK(Destroyed.load() == Batch);
+		Done.store(true);
+		for (auto& Worker : Workers) { Worker.join(); }
+		EpochManager::Instance().Synchronize();
+		CHECK(Destroyed.load() == Batch + 1ul);
+	}
+}
+
+//	A peer retired while a socket still holds its packets must outlive those sends however many epochs go by
+inline void TestEpochBusy()
+{
+	printf("Epoch Busy\n");
+	using namespace PeerNet;
+	std::atomic<unsigned long> Destroyed(0);
+	std::atomic<unsigned long> Sending(2);
+	Retire(new Retiree{ &Destroyed }, &Sending);
+	for (unsigned char i = 0; i < 16; i++) { EpochManager::Instance().Collect(); }
+	CHECK(Destroyed.load() == 0);
+	--Sending;
+	for (unsigned char i = 0; i < 16; i++) { EpochManager::Instance().Collect(); }
+	CHECK(Destroyed.load() == 0);
+	//	Synchronize waits for the last send to be let go of
+	std::thread Socket([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); --Sending; });
+	EpochManager::Instance().Synchronize();
+	CHECK(Destroyed.load() == 1);
+	Socket.join();
+}
+
+//	A released handle must stay stale however often its slot is handed out again
+inline void TestHandleSlab()
+{
+	printf("Handle Slab\n");
+	using namespace PeerNet;
+	int Objects[4] = {};
+	HandleSlab<int> Slab(4, false);
+	const SlotHandle Stale = Slab.Acquire(&Objects[0]);
+	CHECK(Stale != 0 && Slab.Get(Stale) == &Objects[0]);
+	CHECK(Slab.Release(Stale));
+	CHECK(!Slab.Release(Stale));
+	CHECK(Slab.Get(Stale) == nullptr);
+
+	//	Released slots go to the back of the queue
+	const SlotHandle Next = Slab.Acquire(&Objects[1]);
+	CHECK(HandleIndex(Next) != HandleIndex(Stale));
+	Slab.Release(Next);
+
+	//	Churn every slot well past where a 12 bit generation would have wrapped
+	for (unsigned long i = 0; i < (1ul << 14); i++)
+	{
+		const SlotHandle Handle = Slab.Acquire(&Objects[i % 4]);
+		CHECK(Handle != 0 && Handle != Stale && Slab.Get(Stale) == nullptr);
+		Slab.Release(Handle);
+	}
+
+	//	A slot reserved before its object exists resolves to nothing until it's assigned
+	const SlotHandle Reserved = Slab.Acquire(nullptr);
+	CHECK(Reserved != 0 && Slab.Get(Reserved) == nullptr);
+	Slab.Assign(Reserved, &Objects[2]);
+	CHECK(Slab.Get(Reserved) == &Objects[2]);
+	Slab.Release(Reserved);
+	Slab.Assign(Reserved, &Objects[3]);
+	CHECK(Slab.Get(Reserved) == nullptr);
+
+	//	A full slab that may not grow refuses
+	SlotHandle Held[4];
+	for (auto& Handle : Held) { Handle = Slab.Acquire(&Objects[0]); CHECK(Handle != 0); }
+	CHECK(Slab.Acquire(&Objects[0]) == 0);
+	for (auto& Handle : Held) { CHECK(Slab.Release(Handle)); }
+}
+
+//	Everything written to a SendPacket, as the receiving peer would read it
+inline PeerNet::ReceivePacket* Replay(PeerNet::SendPacket& Packet)
+{
+	Packet.FlushBits();
+	return new PeerNet::ReceivePacket(Packet.GetPacketID(), Packet.GetType(), Packet.GetOperationID(), Packet.GetCreationTime(), Packet.GetPayload());
+}
+
+//	Peers come out of a block slab; churning them must keep reusing the same blocks and never mix up sizes
+inline void TestBlockSlab()
+{
+	printf("Block Slab\n");
+	using namespace PeerNet;
+	BlockSlabs& Slabs = BlockSlabs::Instance();
+	std::vector<void*> First;
+	for (unsigned long i = 0; i < PN_BlockChunk * 3; i++) { First.push_back(Slabs.Allocate(1000)); }
+	for (auto Block : First) { CHECK(((size_t)Block % alignof(std::max_align_t)) == 0); }
+	for (auto Block : First) { Slabs.Release(Block, 1000); }
+	//	The same blocks come back however often they churn
+	for (unsigned char Round = 0; Round < 8; Round++)
+	{
+		std::vector<void*> Again;
+		for (unsigned long i = 0; i < PN_BlockChunk * 3; i++) { Again.push_back(Slabs.Allocate(1000)); }
+		for (auto Block : Again) { CHECK(std::find(First.begin(), First.end(), Block) != First.end()); }
+		for (auto Block : Again) { Slabs.Release(Block, 1000); }
+	}
+	//	Another size gets blocks of its own
+	void*const Other = Slabs.Allocate(3000);
+	CHECK(std::find(First.begin(), First.end(), Other) == First.end());
+	std::memset(Other, 0, 3000);
+	Slabs.Release(Other, 3000);
+}
+
+//	Every bit packed write must read back as written, share bytes with its neighbours and leave WriteData intact
+inline void TestBitPacking()
+{
+	printf("Bit Packing\n");
+	using namespace PeerNet;
+
+	//	Raw bits of every width, crossing the 32 bit scratch boundary
+	{
+		SendPacket Out(1, PN_Unreliable, 0, nullptr);
+		for (unsigned char Count = 1; Count <= 32; Count++) { Out.WriteBits(0xA5C3F00Ful >> (32 - Count), Count); }
+		Out.WriteBit(true);
+		ReceivePacket*const In = Replay(Out);
+		for (unsigned char Count = 1; Count <= 32; Count++) { CHECK(In->ReadBits(Count) == (0xA5C3F00Ful >> (32 - Count))); }
+		CHECK(In->ReadBit());
+		CHECK(In->GetRemaining() == 0);
+		delete In;
+	}
+
+	//	Ranged integers, including ones outside their range which are clamped
+	{
+		SendPacket Out(1, PN_Unreliable, 0, nullptr);
+		for (long Value = -5; Value <= 5; Value++) { Out.WriteRanged(Value, -5, 5); }
+		Out.WriteRanged(-6, -5, 5);
+		Out.WriteRanged(100, -5, 5);
+		Out.WriteRanged(7, 7, 7);
+		Out.WriteBits(15, 4);	//	What a malformed packet might hold for a [0, 10] range
+		ReceivePacket*const In = Replay(Out);
+		for (long Value = -5; Value <= 5; Value++) { CHECK(In->ReadRanged(-5, 5) == Value); }
+		CHECK(In->ReadRanged(-5, 5) == -5);
+		CHECK(In->ReadRanged(-5, 5) == 5);
+		CHECK(In->ReadRanged(7, 7) == 7);
+		CHECK(In->ReadRanged(0, 10) == 10);
+		delete In;
+	}
+
+	//	Quantized values and vectors come back within half a step, out of range ones clamped
+	{
+		const float Step = 200.0f / ((1 << 12) - 1);
+		SendPacket Out(1, PN_Unreliable, 0, nullptr);
+		Out.WriteQuantized(-100.0f, -100.0f, 100.0f, 12);
+		Out.WriteQuantized(33.3f, -100.0f, 100.0f, 12);
+		Out.WriteQuantized(250.0f, -100.0f, 100.0f, 12);
+		Out.WriteQuantizedVector(1.5f, -42.25f, 99.9f, -100.0f, 100.0f, 12);
+		ReceivePacket*const In = Replay(Out);
+		CHECK(std::fabs(In->ReadQuantized(-100.0f, 100.0f, 12) + 100.0f) <= Step / 2);
+		CHECK(std::fabs(In->ReadQuantized(-100.0f, 100.0f, 12) - 33.3f) <= Step / 2);
+		CHECK(In->ReadQuantized(-100.0f, 100.0f, 12) == 100.0f);
+		float X, Y, Z;
+		In->ReadQuantizedVector(X, Y, Z, -100.0f, 100.0f, 12);
+		CHECK(std::fabs(X - 1.5f) <= Step / 2 && std::fabs(Y + 42.25f) <= Step / 2 && std::fabs(Z - 99.9f) <= Step / 2);
+		delete In;
+	}
+
+	//	Smallest three quaternions, with each component being the largest in turn and a negative one
+	{
+		const float Rotations[5][4] = {
+			{ 0.9f, 0.1f, -0.3f, 0.3f }, { 0.1f, -0.8f, 0.4f, 0.2f }, { 0.2f, 0.3f, 0.9f, -0.1f }, { 0.05f, 0.1f, 0.2f, 0.97f }, { -0.9f, 0.1f, -0.3f, 0.3f }
+		};
+		SendPacket Out(1, PN_Unreliable, 0, nullptr);
+		float Unit[5][4];
+		for (unsigned char i = 0; i < 5; i++)
+		{
+			const float* R = Rotations[i];
+			const float Length = std::sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + R[3] * R[3]);
+			for (unsigned char c = 0; c < 4; c++) { Unit[i][c] = R[c] / Length; }
+			Out.WriteQuaternion(Unit[i][0], Unit[i][1], Unit[i][2], Unit[i][3], 10);
+		}
+		ReceivePacket*const In = Replay(Out);
+		for (unsigned char i = 0; i < 5; i++)
+		{
+			float Q[4];
+			In->ReadQuaternion(Q[0], Q[1], Q[2], Q[3], 10);
+			//	q and -q are the same rotation
+			const float Dot = Q[0] * Unit[i][0] + Q[1] * Unit[i][1] + Q[2] * Unit[i][2] + Q[3] * Unit[i][3];
+			CHECK(std::fabs(Dot) > 0.9999f);
+		}
+		delete In;
+	}
+
+	//	Bits and regular data mixed freely
+	{
+		SendPacket Out(1, PN_Unreliable, 0, nullptr);
+		Out.WriteBits(5, 3);
+		Out.WriteData<std::string>("between");
+		Out.WriteBit(true);
+		Out.WriteRanged(300, 0, 1000);
+		Out.WriteData<std::uint32_t>(0xDEADBEEF);
+		Out.WriteBits(1, 1);
+		ReceivePacket*const In = Replay(Out);
+		CHECK(In->ReadBits(3) == 5);
+		CHECK(In->ReadData<std::string>() == "between");
+		CHECK(In->ReadBit());
+		CHECK(In->ReadRanged(0, 1000) == 300);
+		CHECK(In->ReadData<std::uint32_t>() == 0xDEADBEEF);
+		CHECK(In->ReadBits(1) == 1);
+		CHECK(In->GetRemaining() == 0);
+		delete In;
+	}
+
+	//	A position update (id, vec3, quat, flag) written with cereal and bit packed
+	{
+		SendPacket Plain(1, PN_Unreliable, 0, nullptr);
+		Plain.WriteData<std::uint32_t>(517);
+		Plain.WriteData(12.5f); Plain.WriteData(-3.25f); Plain.WriteData(200.0f);
+		Plain.WriteData(1.0f); Plain.WriteData(0.0f); Plain.WriteData(0.0f); Plain.WriteData(0.0f);
+		Plain.WriteData(true);
+		SendPacket Packed(1, PN_Unreliable, 0, nullptr);
+		Packed.WriteRanged(517, 0, 1023);
+		Packed.WriteQuantizedVector(12.5f, -3.25f, 200.0f, -512.0f, 512.0f, 18);
+		Packed.WriteQuaternion(1.0f, 0.0f, 0.0f, 0.0f, 9);
+		Packed.WriteBit(true);
+		Packed.FlushBits();
+		printf("\tPosition update: %zu bytes with cereal, %zu bit packed\n", Plain.GetPayload().size(), Packed.GetPayload().size());
+		CHECK(Plain.GetPayload().size() == 33);
+		CHECK(Packed.GetPayload().size() == 12);
+	}
+}
+
+//	A keyed packet as the channel writes it, carrying Keys[0..Count) each at Version
+inline PeerNet::ReceivePacket* KeyedPacket(const unsigned long ID, const unsigned long*const Keys, const unsigned short Count, const unsigned long Version)
+{
+	PeerNet::SendPacket Out(ID, PeerNet::PN_Keyed, 0, nullptr);
+	Out.WriteData<unsigned char>(0);
+	Out.WriteData<unsigned short>(Count);
+	for (unsigned short i = 0; i < Count; i++)
+	{
+		Out.WriteData<unsigned long>(Keys[i]);
+		Out.WriteData<unsigned long>(Version);
+		Out.WriteData<std::string>("value");
+	}
+	return Replay(Out);
+}
+
+//	Values the channel has queued for delivery, which are then thrown away
+inline size_t Delivered(PeerNet::KeyedChannel& Channel)
+{
+	std::deque<PeerNet::ReceivePacket*> Queue;
+	Channel.SwapProcessingQueue(Queue);
+	for (auto Packet : Queue) { delete Packet; }
+	return Queue.size();
+}
+
+//	Flushes the channel and counts the values it sent, marking its packets done
+inline size_t Flushed(PeerNet::KeyedChannel& Channel)
+{
+	std::vector<PeerNet::SendPacket*> Out;
+	Channel.Flush(Out);
+	for (auto Packet : Out) { Packet->NeedsDelete = 1; }
+	Channel.DeleteUsed();
+	return Out.size();
+}
+
+//	A remote peer may only make us remember MaxKeys keys of an operation
+//	And a reliable key nobody acknowledges is resent less and less often, not every retransmission timeout
+inline void TestKeyedLimits()
+{
+	printf("Keyed Limits\n");
+	using namespace PeerNet;
+	AckTracker Acks(nullptr);
+	RTTEstimator Estimator;
+	KeyedChannel Channel(nullptr, PN_Keyed, &Acks, &Estimator);
+	CHECK(Channel.Register(0));
+	Channel.SetMaxKeys(0, 4);
+
+	const unsigned long Four[] = { 1, 2, 3, 4 };
+	Channel.Receive(KeyedPacket(1, Four, 4, 1));
+	CHECK(Delivered(Channel) == 4);
+	//	Known keys keep updating
+	Channel.Receive(KeyedPacket(2, Four, 4, 2));
+	CHECK(Delivered(Channel) == 4);
+	//	A fifth key drops the packet from there on
+	const unsigned long Fifth[] = { 2, 5, 3 };
+	Channel.Receive(KeyedPacket(3, Fifth, 3, 3));
+	CHECK(Delivered(Channel) == 1);
+	//	Floods of fresh keys stay dropped
+	for (unsigned long Key = 100; Key < 10100; Key++) { Channel.Receive(KeyedPacket(Key, &Key, 1, 1)); }
+	CHECK(Delivered(Channel) == 0);
+
+	//	One RTT sample takes the timeout down to PN_RTO_Min, 20ms
+	Estimator.Sample(std::chrono::milliseconds(1));
+	Channel.SetReliable(0, true);
+	SendPacket*const Value = Channel.NewPacket(0, 7);
+	Value->WriteData<std::string>("unacknowledged");
+	Channel.Write(Value);
+	CHECK(Flushed(Channel) == 1);
+	CHECK(Flushed(Channel) == 0);
+	//	One timeout later it goes again, then has to wait twice as long
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	CHECK(Flushed(Channel) == 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(Flushed(Channel) == 1);
+	//	Now four timeouts; a flat timeout would have resent it again by now
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	CHECK(Flushed(Channel) == 0);
+	//	A new value starts over
+	SendPacket*const Newer = Channel.NewPacket(0, 7);
+	Newer->WriteData<std::string>("newer");
+	Channel.Write(Newer);
+	CHECK(Flushed(Channel) == 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	CHECK(Flushed(Channel) == 1);
+	Channel.PrintStats();
+	EpochManager::Instance().Synchronize();
+}
+
+//	Nanoseconds one lock and unlock of Mutex costs when nothing else wants it
+inline double LockCost(PeerNet::PeerMutex& Mutex)
+{
+	const unsigned long Rounds = 10000000;
+	volatile unsigned long Counter = 0;
+	const auto Start = std::chrono::steady_clock::now();
+	for (unsigned long r = 0; r < Rounds; r++) { Mutex.lock(); Counter = Counter + 1; Mutex.unlock(); }
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / Rounds;
+}
+
+//	Peers of a polled PeerNet are built with every channel, operation, ack, pacer and dispatch lock switched off
+inline void TestPolledLocks()
+{
+	printf("Polled Locks\n");
+	using namespace PeerNet;
+	OperationTable<ReliableOperation> Threaded;
+	OperationTable<ReliableOperation> Polled(true);
+	CHECK(Threaded.Register(1) && Polled.Register(1));
+	CHECK(Threaded.Find(1)->IN_Mutex.Locking() && Threaded.Find(1)->OUT_Mutex.Locking());
+	CHECK(!Polled.Find(1)->IN_Mutex.Locking() && !Polled.Find(1)->OUT_Mutex.Locking());
+	//	Operations with nothing to lock register just the same
+	OperationTable<UnreliableOperation> Unlocked(true);
+	CHECK(Unlocked.Register(1));
+
+	//	A switched off lock never blocks, so taking it twice is harmless
+	PeerMutex Off(true);
+	Off.lock();
+	CHECK(Off.try_lock());
+	Off.unlock();
+	Off.unlock();
+	PeerMutex On;
+	On.lock();
+	CHECK(!On.try_lock());
+	On.unlock();
+
+	//	A polled channel still works end to end
+	AckTracker Acks(nullptr, true);
+	RTTEstimator Estimator(true);
+	KeyedChannel Channel(nullptr, PN_Keyed, &Acks, &Estimator, true);
+	CHECK(Channel.Register(0));
+	const unsigned long Keys[] = { 1, 2, 3 };
+	Channel.Receive(KeyedPacket(1, Keys, 3, 1));
+	CHECK(Delivered(Channel) == 3);
+	EpochManager::Instance().Synchronize();
+
+	printf("\tUncontended lock and unlock: %.1fns locking, %.1fns polled\n", LockCost(On), LockCost(Off));
+}
+
+//	Megabytes per second MulAdd manages at Level over a shard sized buffer
+inline double MulAddRate(const PeerNet::FEC::VectorLevel Level, const std::vector<unsigned char>& Src)
+{
+	std::vector<unsigned char> Dst(Src.size(), 0);
+	const unsigned long Rounds = 20000;
+	const auto Start = std::chrono::steady_clock::now();
+	for (unsigned long r = 0; r < Rounds; r++) { PeerNet::FEC::MulAdd(Dst.data(), Src.data(), (unsigned char)(2 + r % 250), Src.size(), Level); }
+	const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	return (double)Src.size() * Rounds / Seconds / (1024 * 1024);
+}
+
+//	Groups of 8 data and 2 parity packets, as ExPeer sends them, under 1 to 10% random loss
+//	Every group that lost no more than its parity must come back byte for byte; the rest are counted as residual loss
+inline void TestFECRecovery()
+{
+	printf("FEC Recovery\n");
+	using namespace PeerNet;
+	std::mt19937 Random(7);
+
+	//	Every vector path this CPU has agrees with the scalar one, including on the tail
+	static const char*const Names[] = { "scalar", "SSSE3", "AVX2" };
+	std::vector<unsigned char> Src(1200 + 13);
+	for (auto& Byte : Src) { Byte = (unsigned char)Random(); }
+	for (unsigned char Level = FEC::Vector_SSSE3; Level <= FEC::Vector(); Level++)
+	{
+		std::vector<unsigned char> Scalar(Src.size(), 0x5A), Vector(Src.size(), 0x5A);
+		FEC::MulAdd(Scalar.data(), Src.data(), 0x57, Src.size(), FEC::Vector_None);
+		FEC::MulAdd(Vector.data(), Src.data(), 0x57, Src.size(), (FEC::VectorLevel)Level);
+		CHECK(Scalar == Vector);
+	}
+	printf("\tMulAdd: %.0f MB/s scalar, %.0f MB/s %s\n", MulAddRate(FEC::Vector_None, Src), MulAddRate(FEC::Vector(), Src), Names[FEC::Vector()]);
+
+	const unsigned char K = 8;
+	const unsigned char M = 2;
+	const unsigned long Groups = 2000;
+	for (unsigned int Loss = 1; Loss <= 10; Loss++)
+	{
+		unsigned long Sent = 0, Lost = 0, Recovered = 0;
+		double Seconds = 0;
+		for (unsigned long g = 0; g < Groups; g++)
+		{
+			std::vector<std::string> Data(K);
+			for (auto& Shard : Data) { Shard = FEC::Frame(std::string(200 + Random() % 1000, (char)Random())); }
+			std::vector<std::string> Parity;
+			FEC::Encode(Data, M, Parity);
+			std::string Shards[K + M];
+			bool Have[K + M];
+			unsigned char Missing = 0, MissingData = 0;
+			for (unsigned char r = 0; r < K + M; r++)
+			{
+				Have[r] = Random() % 100 >= Loss;
+				if (Have[r]) { Shards[r] = r < K ? Data[r] : Parity[r - K]; }
+				else { ++Missing; if (r < K) { ++MissingData; } }
+			}
+			Sent += K;
+			Lost += MissingData;
+			if (MissingData == 0) { continue; }
+			const auto Start = std::chrono::steady_clock::now();
+			const bool Rebuilt = FEC::Decode(Shards, Have, K, M, Data[0].size());
+			Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+			CHECK(Rebuilt == (Missing <= M));
+			if (!Rebuilt) { continue; }
+			for (unsigned char d = 0; d < K; d++) { CHECK(Shards[d] == Data[d]); }
+			Recovered += MissingData;
+		}
+		printf("\t%2u%% loss: %lu of %lu data packets lost, %lu rebuilt, %.3f%% residual loss, %.1fus per rebuild\n",
+			Loss, Lost, Sent, Recovered, 100.0 * (Lost - Recovered) / Sent, Lost > 0 ? Seconds * 1e6 / Lost : 0.0);
+	}
+}
+
+#ifdef PN_Coroutines
+//	Waits once for an operation and records how it ended
+inline PeerNet::NetTask AwaitPacket(PeerNet::AwaiterList*const Waiters, const std::chrono::steady_clock::duration Timeout, PeerNet::ReceiveResult*const Result)
+{
+	*Result = co_await PeerNet::ReceiveAwaiter(Waiters, PeerNet::PN_Reliable, 1, Timeout);
+}
+
+inline PeerNet::NetTask AwaitConfirm(PeerNet::AwaiterList*const Waiters, PeerNet::AwaitStatus*const Status)
+{
+	*Status = co_await PeerNet::ConfirmAwaiter(Waiters, nullptr, std::chrono::steady_clock::duration::zero());
+}
+
+//	Waits once for the response to request ID and records how it ended
+inline PeerNet::NetTask AwaitResponse(PeerNet::AwaiterList*const Waiters, const unsigned long RequestID, const std::chrono::steady_clock::duration Timeout, PeerNet::ReceiveResult*const Result)
+{
+	*Result = co_await PeerNet::ReceiveAwaiter(Waiters, PeerNet::PN_Reliable, 1, Timeout, nullptr, RequestID);
+}
+
+//	A response on operation 1 to request ID, carrying Value
+inline PeerNet::ReceivePacket* Response(const unsigned long RequestID, const unsigned long Value)
+{
+	PeerNet::SendPacket Out(1, PeerNet::PN_Reliable, 1, nullptr);
+	Out.WriteData(RequestID);
+	Out.WriteData(Value);
+	return Replay(Out);
+}
+
+//	A coroutine must be able to tell a packet from a timeout from its peer going away
+//	Nothing resumes until ResumeReady, which the peer calls from its tick; only Cancel resumes straight away
+inline void TestAwaitStatus()
+{
+	printf("Await Status\n");
+	using namespace PeerNet;
+	AwaiterList Waiters(nullptr);
+	ReceiveResult Result = { Await_Invalid, nullptr };
+
+	//	A packet arrives
+	AwaitPacket(&Waiters, std::chrono::steady_clock::duration::zero(), &Result);
+	ReceivePacket*const Packet = new ReceivePacket(1, PN_Reliable, 1, std::chrono::steady_clock::now(), std::string());
+	CHECK(Waiters.Take(Packet));
+	CHECK(Result.Status == Await_Invalid);	//	Not until the tick
+	Waiters.ResumeReady();
+	CHECK(Result.Status == Await_Packet && Result.Packet == Packet);
+	delete Packet;
+
+	//	Packets of other operations aren't ours
+	Result = { Await_Invalid, nullptr };
+	AwaitPacket(&Waiters, std::chrono::steady_clock::duration::zero(), &Result);
+	ReceivePacket*const Other = new ReceivePacket(1, PN_Reliable, 2, std::chrono::steady_clock::now(), std::string());
+	CHECK(!Waiters.Take(Other));
+	delete Other;
+
+	//	The peer goes away
+	Waiters.Cancel();
+	CHECK(Result.Status == Await_Closed && Result.Packet == nullptr);
+
+	//	Nothing arrives in time
+	Result = { Await_Invalid, nullptr };
+	AwaitPacket(&Waiters, std::chrono::milliseconds(1), &Result);
+	Waiters.Expire(std::chrono::steady_clock::now());
+	Waiters.ResumeReady();
+	CHECK(Result.Status == Await_Invalid);	//	Not yet
+	Waiters.Expire(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+	CHECK(Result.Status == Await_Invalid);
+	Waiters.ResumeReady();
+	CHECK(Result.Status == Await_Timeout && Result.Packet == nullptr);
+
+	//	Nothing to wait on
+	AwaitStatus Status = Await_Confirmed;
+	AwaitConfirm(&Waiters, &Status);
+	CHECK(Status == Await_Invalid);
+}
+
+//	Each Call gets the response to its own request
+//	One that arrives after its caller timed out must not be handed to the next caller on the same operation
+inline void TestAwaitRequests()
+{
+	printf("Await Requests\n");
+	using namespace PeerNet;
+	AwaiterList Waiters(nullptr);
+	const unsigned long First = Waiters.NextRequestID();
+	const unsigned long Second = Waiters.NextRequestID();
+	CHECK(First != 0 && Second != 0 && First != Second);
+
+	//	The first caller gives up
+	ReceiveResult Late = { Await_Invalid, nullptr };
+	AwaitResponse(&Waiters, First, std::chrono::milliseconds(1), &Late);
+	Waiters.Expire(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+	Waiters.ResumeReady();
+	CHECK(Late.Status == Await_Timeout);
+
+	//	The second is waiting when the first's answer turns up
+	ReceiveResult Result = { Await_Invalid, nullptr };
+	AwaitResponse(&Waiters, Second, std::chrono::steady_clock::duration::zero(), &Result);
+	ReceivePacket*const Stale = Response(First, 1);
+	CHECK(!Waiters.Take(Stale));
+	CHECK(Stale->ReadData<unsigned long>() == First);	//	Left for Receive() as it arrived
+	delete Stale;
+	//	Too short to hold an ID at all
+	ReceivePacket*const Empty = new ReceivePacket(1, PN_Reliable, 1, std::chrono::steady_clock::now(), std::string());
+	CHECK(!Waiters.Take(Empty));
+	delete Empty;
+
+	//	Its own answer, with the ID already read off
+	ReceivePacket*const Answer = Response(Second, 2);
+	CHECK(Waiters.Take(Answer));
+	Waiters.ResumeReady();
+	CHECK(Result.Status == Await_Packet && Result.Packet == Answer);
+	CHECK(Answer->ReadData<unsigned long>() == 2);
+	delete Answer;
+
+	//	Plain waiters on the operation still take anything, IDs included
+	ReceiveResult Any = { Await_Invalid, nullptr };
+	AwaitPacket(&Waiters, std::chrono::steady_clock::duration::zero(), &Any);
+	ReceivePacket*const Unasked = Response(First, 3);
+	CHECK(Waiters.Take(Unasked));
+	Waiters.ResumeReady();
+	CHECK(Any.Status == Await_Packet && Any.Packet->ReadData<unsigned long>() == First);
+	delete Unasked;
+}
+#endif
+
+int main()
+{
+	TestSnapshotDecode();
+	TestChannelSet();
+	TestPeerChannelSets();
+	TestHelloFlood();
+	TestStrangerFlood();
+	TestPeerTable();
+	TestPingPong();
+	TestGoodput();
+	TestRetransmitBandwidth();
+	TestTimerScale();
+	TestExecutorBalance();
+	TestReliableWindow();
+	TestEpochThreads();
+	TestEpochBusy();
+	TestHandleSlab();
+	TestBlockSlab();
+	TestBitPacking();
+	TestFECRecovery();
+	TestKeyedLimits();
+	TestPolledLocks();
+#ifdef PN_Coroutines
+	TestAwaitStatus();
+	TestAwaitRequests();
+#endif
+
+	printf("\n%s - %i failed checks\n", Failures == 0 ? "PASSED" : "FAILED", Failures);
+	return Failures == 0 ? 0 : 1;
+}
\ No newline at end of file
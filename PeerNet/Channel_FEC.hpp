@@ -0,0 +1,561 @@
+#pragma once
+#include <vector>
+//	The vector paths are compiled whatever the build targets and picked at run time from what the CPU supports
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PN_FECVector
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PN_FECTarget(Set)	//	MSVC compiles any intrinsic without /arch
+#else
+#define PN_FECTarget(Set) __attribute__((target(Set)))
+#endif
+#endif
+
+#define PN_FECMaxShards 64		//	Most data plus parity packets in a single group
+#define PN_FECHistory 16		//	Groups each operation remembers while waiting for parity; must be a power of two
+#define PN_FECDefaultData 4		//	Data packets per group unless SetRatio says otherwise
+#define PN_FECDefaultParity 1	//	Parity packets per group unless SetRatio says otherwise
+#define PN_FECGroupAge 50		//	Milliseconds a partially filled group waits for more data before its parity goes out anyway
+
+namespace PeerNet
+{
+	//
+	//	Forward Error Correction
+	//	Every K data packets are followed by M parity packets
+	//	Any K of the K+M packets in a group rebuild the whole group without a round trip
+	//	M == 1 is plain XOR parity; otherwise a systematic Reed-Solomon code over GF(2^8) built from a Cauchy matrix
+	//	Shards are framed as [Length (2 bytes)] [Payload] and zero padded to the longest shard in the group
+	namespace FEC
+	{
+		struct GaloisTables
+		{
+			unsigned char Exp[512];
+			unsigned char Log[256];
+
+			inline GaloisTables()
+			{
+				//	x^8 + x^4 + x^3 + x^2 + 1
+				unsigned short X = 1;
+				for (unsigned short i = 0; i < 255; i++)
+				{
+					Exp[i] = (unsigned char)X;
+					Log[X] = (unsigned char)i;
+					X <<= 1;
+					if (X & 0x100) { X ^= 0x11D; }
+				}
+				for (unsigned short i = 255; i < 512; i++) { Exp[i] = Exp[i - 255]; }
+				Log[0] = 0;
+			}
+		};
+
+		inline const GaloisTables& Tables()
+		{
+			static const GaloisTables Table;
+			return Table;
+		}
+
+		inline const unsigned char Mul(const unsigned char A, const unsigned char B)
+		{
+			if (A == 0 || B == 0) { return 0; }
+			return Tables().Exp[Tables().Log[A] + Tables().Log[B]];
+		}
+
+		//	A must not be zero
+		inline const unsigned char Inv(const unsigned char A) { return Tables().Exp[255 - Tables().Log[A]]; }
+
+		//	Widest vector path this CPU can run
+		enum VectorLevel : unsigned char
+		{
+			Vector_None = 0,
+			Vector_SSSE3 = 1,
+			Vector_AVX2 = 2
+		};
+
+		inline const VectorLevel DetectVector()
+		{
+#if defined(PN_FECVector) && defined(_MSC_VER)
+			int Info[4];
+			__cpuid(Info, 0);
+			const int Leaves = Info[0];
+			__cpuid(Info, 1);
+			const bool SSSE3 = (Info[2] & (1 << 9)) != 0;
+			//	AVX needs the OS to save the upper halves of the registers too
+			const bool AVX = (Info[2] & (1 << 27)) != 0 && (Info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+			bool AVX2 = false;
+			if (AVX && Leaves >= 7) {
+				__cpuidex(Info, 7, 0);
+				AVX2 = (Info[1] & (1 << 5)) != 0;
+			}
+			return AVX2 ? Vector_AVX2 : SSSE3 ? Vector_SSSE3 : Vector_None;
+#elif defined(PN_FECVector)
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") ? Vector_AVX2 : __builtin_cpu_supports("ssse3") ? Vector_SSSE3 : Vector_None;
+#else
+			return Vector_None;
+#endif
+		}
+
+		//	Checked once per process
+		inline const VectorLevel Vector()
+		{
+			static const VectorLevel Level = DetectVector();
+			return Level;
+		}
+
+		//	Dst ^= Coef * Src one byte at a time, from Offset on
+		inline void MulAddScalar(unsigned char*const Dst, const unsigned char*const Src, const unsigned char Coef, size_t Offset, const size_t Size)
+		{
+			if (Coef == 0) { return; }
+			if (Coef == 1) {
+				for (; Offset < Size; Offset++) { Dst[Offset] ^= Src[Offset]; }
+				return;
+			}
+			const unsigned char LogCoef = Tables().Log[Coef];
+			for (; Offset < Size; Offset++) {
+				if (Src[Offset] != 0) { Dst[Offset] ^= Tables().Exp[LogCoef + Tables().Log[Src[Offset]]]; }
+			}
+		}
+
+#ifdef PN_FECVector
+		//	The vector paths split each byte into nibbles and look up both halves of the product with a byte shuffle
+		//	Lo and Hi hold Coef times every low and high nibble, twice over; each returns how many bytes it did
+
+		PN_FECTarget("ssse3") inline size_t MulAddSSSE3(unsigned char*const Dst, const unsigned char*const Src, const unsigned char*const Lo, const unsigned char*const Hi, const size_t Size)
+		{
+			const __m128i Lo128 = _mm_load_si128((const __m128i*)Lo);
+			const __m128i Hi128 = _mm_load_si128((const __m128i*)Hi);
+			const __m128i Mask128 = _mm_set1_epi8(0x0F);
+			size_t i = 0;
+			for (; i + 16 <= Size; i += 16)
+			{
+				const __m128i S = _mm_loadu_si128((const __m128i*)(Src + i));
+				const __m128i P = _mm_xor_si128(
+					_mm_shuffle_epi8(Lo128, _mm_and_si128(S, Mask128)),
+					_mm_shuffle_epi8(Hi128, _mm_and_si128(_mm_srli_epi64(S, 4), Mask128)));
+				_mm_storeu_si128((__m128i*)(Dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(Dst + i)), P));
+			}
+			return i;
+		}
+
+		PN_FECTarget("avx2") inline size_t MulAddAVX2(unsigned char*const Dst, const unsigned char*const Src, const unsigned char*const Lo, const unsigned char*const Hi, const size_t Size)
+		{
+			const __m256i Lo256 = _mm256_load_si256((const __m256i*)Lo);
+			const __m256i Hi256 = _mm256_load_si256((const __m256i*)Hi);
+			const __m256i Mask256 = _mm256_set1_epi8(0x0F);
+			size_t i = 0;
+			for (; i + 32 <= Size; i += 32)
+			{
+				const __m256i S = _mm256_loadu_si256((const __m256i*)(Src + i));
+				const __m256i P = _mm256_xor_si256(
+					_mm256_shuffle_epi8(Lo256, _mm256_and_si256(S, Mask256)),
+					_mm256_shuffle_epi8(Hi256, _mm256_and_si256(_mm256_srli_epi64(S, 4), Mask256)));
+				_mm256_storeu_si256((__m256i*)(Dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(Dst + i)), P));
+			}
+			//	Whatever is left of a 32 byte block may still fill a 16 byte one
+			const __m128i Lo128 = _mm_load_si128((const __m128i*)Lo);
+			const __m128i Hi128 = _mm_load_si128((const __m128i*)Hi);
+			const __m128i Mask128 = _mm_set1_epi8(0x0F);
+			for (; i + 16 <= Size; i += 16)
+			{
+				const __m128i S = _mm_loadu_si128((const __m128i*)(Src + i));
+				const __m128i P = _mm_xor_si128(
+					_mm_shuffle_epi8(Lo128, _mm_and_si128(S, Mask128)),
+					_mm_shuffle_epi8(Hi128, _mm_and_si128(_mm_srli_epi64(S, 4), Mask128)));
+				_mm_storeu_si128((__m128i*)(Dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(Dst + i)), P));
+			}
+			return i;
+		}
+#endif
+
+		//	Dst ^= Coef * Src
+		//	Takes the widest vector path Vector() allows, then finishes the tail one byte at a time
+		inline void MulAdd(unsigned char*const Dst, const unsigned char*const Src, const unsigned char Coef, const size_t Size, const VectorLevel Level = Vector())
+		{
+			if (Coef == 0) { return; }
+			size_t i = 0;
+#ifdef PN_FECVector
+			if (Coef != 1 && Level != Vector_None && Size >= 16)
+			{
+				alignas(32) unsigned char Lo[32];
+				alignas(32) unsigned char Hi[32];
+				for (unsigned char n = 0; n < 16; n++)
+				{
+					Lo[n] = Lo[n + 16] = Mul(Coef, n);
+					Hi[n] = Hi[n + 16] = Mul(Coef, (unsigned char)(n << 4));
+				}
+				i = Level == Vector_AVX2 ? MulAddAVX2(Dst, Src, Lo, Hi, Size) : MulAddSSSE3(Dst, Src, Lo, Hi, Size);
+			}
+#endif
+			MulAddScalar(Dst, Src, Coef, i, Size);
+		}
+
+		//	Row of the encoding matrix for shard Row; the first K rows are the identity
+		inline const unsigned char Coefficient(const unsigned char Row, const unsigned char Col, const unsigned char K, const unsigned char M)
+		{
+			if (Row < K) { return Row == Col ? 1 : 0; }
+			if (M == 1) { return 1; }
+			//	Cauchy matrix 1 / (x + y) with x = Row and y = Col; every square submatrix is invertible
+			return Inv(Row ^ Col);
+		}
+
+		inline const string Frame(const string& Payload)
+		{
+			string Shard(2, 0);
+			Shard[0] = (char)(Payload.size() & 0xFF);
+			Shard[1] = (char)(Payload.size() >> 8);
+			Shard += Payload;
+			return Shard;
+		}
+
+		//	Returns false if the shard is malformed
+		inline const bool Unframe(const string& Shard, string& Payload)
+		{
+			if (Shard.size() < 2) { return false; }
+			const size_t Size = (unsigned char)Shard[0] | ((size_t)(unsigned char)Shard[1] << 8);
+			if (Size + 2 > Shard.size()) { return false; }
+			Payload.assign(Shard, 2, Size);
+			return true;
+		}
+
+		//	Build M parity shards from K framed data shards
+		inline void Encode(std::vector<string>& Data, const unsigned char M, std::vector<string>& Parity)
+		{
+			const unsigned char K = (unsigned char)Data.size();
+			size_t Size = 0;
+			for (auto& Shard : Data) { Size = (std::max)(Size, Shard.size()); }
+			for (auto& Shard : Data) { Shard.resize(Size, 0); }
+			Parity.assign(M, string(Size, 0));
+			for (unsigned char j = 0; j < M; j++) {
+				for (unsigned char i = 0; i < K; i++) {
+					MulAdd((unsigned char*)&Parity[j][0], (const unsigned char*)Data[i].data(), Coefficient(K + j, i, K, M), Size);
+				}
+			}
+		}
+
+		//	Rebuild the missing data shards of a group
+		//	Shards holds K+M entries, Have marks which arrived; at least K must have
+		//	Missing data shards are written into Shards; returns false if there isn't enough to rebuild
+		inline const bool Decode(string*const Shards, const bool*const Have, const unsigned char K, const unsigned char M, const size_t Size)
+		{
+			//	Pick K shards, preferring data so the matrix stays mostly identity
+			std::vector<unsigned char> Rows;
+			for (unsigned char r = 0; r < K + M && Rows.size() < K; r++) {
+				if (Have[r]) { Rows.push_back(r); }
+			}
+			if (Rows.size() < K) { return false; }
+			//	Invert the K x K submatrix with Gauss-Jordan elimination
+			std::vector<unsigned char> A(K * K), I(K * K, 0);
+			for (unsigned char r = 0; r < K; r++) {
+				I[r * K + r] = 1;
+				for (unsigned char c = 0; c < K; c++) { A[r * K + c] = Coefficient(Rows[r], c, K, M); }
+			}
+			for (unsigned char c = 0; c < K; c++)
+			{
+				unsigned char Pivot = c;
+				while (Pivot < K && A[Pivot * K + c] == 0) { ++Pivot; }
+				if (Pivot == K) { return false; }
+				if (Pivot != c) {
+					for (unsigned char x = 0; x < K; x++) {
+						std::swap(A[Pivot * K + x], A[c * K + x]);
+						std::swap(I[Pivot * K + x], I[c * K + x]);
+					}
+				}
+				const unsigned char Scale = Inv(A[c * K + c]);
+				for (unsigned char x = 0; x < K; x++) {
+					A[c * K + x] = Mul(A[c * K + x], Scale);
+					I[c * K + x] = Mul(I[c * K + x], Scale);
+				}
+				for (unsigned char r = 0; r < K; r++)
+				{
+					const unsigned char Factor = A[r * K + c];
+					if (r == c || Factor == 0) { continue; }
+					for (unsigned char x = 0; x < K; x++) {
+						A[r * K + x] ^= Mul(Factor, A[c * K + x]);
+						I[r * K + x] ^= Mul(Factor, I[c * K + x]);
+					}
+				}
+			}
+			//	Data shard d is row d of the inverse applied to the shards we have
+			for (unsigned char r = 0; r < K; r++) {
+				if (Have[Rows[r]]) { Shards[Rows[r]].resize(Size, 0); }
+			}
+			for (unsigned char d = 0; d < K; d++)
+			{
+				if (Have[d]) { continue; }
+				string Rebuilt(Size, 0);
+				for (unsigned char r = 0; r < K; r++) {
+					MulAdd((unsigned char*)&Rebuilt[0], (const unsigned char*)Shards[Rows[r]].data(), I[d * K + r], Size);
+				}
+				Shards[d].swap(Rebuilt);
+			}
+			return true;
+		}
+	}
+
+	struct FECGroup
+	{
+		unsigned long ID = 0;			//	Group this slot currently holds
+		unsigned long FirstID = 0;		//	Packet ID of data shard 0
+		unsigned char K = 0;			//	Data shards; only known once parity arrives
+		unsigned char M = 0;			//	Parity shards; only known once parity arrives
+		unsigned char Received = 0;		//	Shards we have, received or rebuilt
+		size_t Size = 0;				//	Padded shard size; only known once parity arrives
+		steady_clock::time_point CreationTime;
+		bool Have[PN_FECMaxShards] = {};
+		string Shards[PN_FECMaxShards];
+	};
+
+	struct FECOperation
+	{
+		//	IN
+		PeerMutex IN_Mutex;
+		FECGroup IN_Groups[PN_FECHistory];	//	Recent groups indexed by (ID & (PN_FECHistory - 1))
+		//	OUT
+		PeerMutex OUT_Mutex;
+		unsigned char K = PN_FECDefaultData;
+		unsigned char M = PN_FECDefaultParity;
+		unsigned long OUT_NextID = 1;		//	Next data packet ID we'll use
+		unsigned long OUT_NextGroup = 1;	//	Group the next data packet starts or joins
+		std::vector<string> OUT_Shards;		//	Framed data shards of the group being filled
+		steady_clock::time_point OUT_GroupStart;	//	When the oldest shard of the group being filled was sent
+	};
+
+	class FECChannel
+	{
+		NetAddress*const Address;
+		const PacketType ChannelID;
+		AckTracker*const Acks;
+
+		OperationTable<FECOperation> Operations;
+
+		PeerMutex OUT_Mutex;
+		std::deque<SendPacket*> OUT_Packets;	//	Packets that need to be deleted
+
+		PeerMutex IN_Mutex;
+		std::deque<ReceivePacket*> NeedsProcessed;	//	Packets that need to be processed
+
+		std::atomic<unsigned long long> Stats_Recovered;	//	Data packets rebuilt from parity
+		std::atomic<unsigned long long> Stats_Lost;			//	Data packets that never arrived and couldn't be rebuilt
+
+		//	Build a wire packet; Layout: [Group] [Index] [K] [M] [Shard]
+		inline SendPacket*const NewShard(const unsigned long ID, const unsigned long OP, const unsigned long Group,
+			const unsigned char Index, const unsigned char K, const unsigned char M, const string& Shard, const steady_clock::time_point& CT)
+		{
+			SendPacket* Packet = new SendPacket(ID, ChannelID, OP, Address, true, CT);
+			Packet->WriteData<unsigned long>(Group);
+			Packet->WriteData<unsigned char>(Index);
+			Packet->WriteData<unsigned char>(K);
+			Packet->WriteData<unsigned char>(M);
+			Packet->WriteData<string>(Shard);
+			return Packet;
+		}
+
+		//	Close the group being filled and emit its parity
+		//	Data packets already went out; only parity records the final K
+		inline void CloseGroup(const unsigned long OP, FECOperation*const Operation, std::vector<SendPacket*>& Out)
+		{
+			const unsigned char K = (unsigned char)Operation->OUT_Shards.size();
+			const unsigned long FirstID = Operation->OUT_NextID - K;
+			std::vector<string> Parity;
+			FEC::Encode(Operation->OUT_Shards, Operation->M, Parity);
+			for (unsigned char j = 0; j < Operation->M; j++) {
+				Out.push_back(NewShard(FirstID, OP, Operation->OUT_NextGroup, K + j, K, Operation->M, Parity[j], steady_clock::now()));
+			}
+			Operation->OUT_Shards.clear();
+			++Operation->OUT_NextGroup;
+		}
+
+		//	Hand a payload to the user as if it had arrived by itself
+		inline void Deliver(const unsigned long ID, const unsigned long OP, const steady_clock::time_point& CT, const string& Shard)
+		{
+			string Payload;
+			if (!FEC::Unframe(Shard, Payload)) { return; }
+			IN_Mutex.lock();
+			NeedsProcessed.push_back(new ReceivePacket(ID, ChannelID, OP, CT, Payload));
+			IN_Mutex.unlock();
+		}
+
+	public:
+		inline FECChannel(NetAddress*const Addr, const PacketType &ChanID, AckTracker*const AckTrack, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack), Operations(Polled),
+			OUT_Mutex(Polled), OUT_Packets(), IN_Mutex(Polled), NeedsProcessed(), Stats_Recovered(0), Stats_Lost(0) {}
+
+		inline ~FECChannel()
+		{
+			for (auto Packet : OUT_Packets) { Retire(Packet); }
+			for (auto Packet : NeedsProcessed) { delete Packet; }
+		}
+
+		//	Create the state for an operation before any traffic uses it
+		inline const bool Register(const unsigned long OP) { return Operations.Register(OP); }
+
+		//	Set how many parity packets follow how many data packets for an operation
+		//	Takes effect from the next group
+		inline void SetRatio(const unsigned long OP, unsigned char Data, unsigned char Parity)
+		{
+			if (Data < 1) { Data = 1; }
+			if (Parity < 1) { Parity = 1; }
+			if (Data + Parity > PN_FECMaxShards) { Data = PN_FECMaxShards - Parity; }
+			FECOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+			Operation->OUT_Mutex.lock();
+			Operation->K = Data;
+			Operation->M = Parity;
+			Operation->OUT_Mutex.unlock();
+		}
+
+		//	Initialize and return a new packet for the user to fill
+		//	It is not sent as-is; Encode wraps it as a data shard
+		inline SendPacket* NewPacket(const unsigned long& OP)
+		{
+			if (Operations.Find(OP) == nullptr) { printf("FEC Channel - Unregistered Operation %lu\n", OP); return nullptr; }
+			return new SendPacket(0, ChannelID, OP, Address);
+		}
+
+		//	Consumes a filled packet and fills Out with the packets to actually send
+		//	The data shard always goes out immediately; parity follows once the group fills
+		inline void Encode(SendPacket*const UserPacket, std::vector<SendPacket*>& Out)
+		{
+			const unsigned long OP = UserPacket->GetOperationID();
+			FECOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { delete UserPacket; return; }
+			const string Shard(FEC::Frame(UserPacket->GetPayload()));
+#ifdef _PERF_SPINLOCK
+			while (!Operation->OUT_Mutex.try_lock()) {}
+#else
+			Operation->OUT_Mutex.lock();
+#endif
+			const unsigned char Index = (unsigned char)Operation->OUT_Shards.size();
+			//	SetRatio may have shrunk K mid group; data must always look like data
+			const unsigned char K = (std::max)(Operation->K, (unsigned char)(Index + 1));
+			Out.push_back(NewShard(Operation->OUT_NextID++, OP, Operation->OUT_NextGroup, Index, K, Operation->M, Shard, UserPacket->GetCreationTime()));
+			if (Index == 0) { Operation->OUT_GroupStart = steady_clock::now(); }
+			Operation->OUT_Shards.push_back(Shard);
+			if (Operation->OUT_Shards.size() >= Operation->K) { CloseGroup(OP, Operation, Out); }
+			Operation->OUT_Mutex.unlock();
+			OUT_Mutex.lock();
+			for (auto Packet : Out) { OUT_Packets.push_back(Packet); }
+			OUT_Mutex.unlock();
+			delete UserPacket;
+		}
+
+		//	Close partially filled groups whose oldest shard has waited longer than PN_FECGroupAge
+		//	A pause in sending then can't leave a group's tail unprotected, while a steady stream still fills whole groups
+		inline void Flush(std::vector<SendPacket*>& Out)
+		{
+			const steady_clock::time_point Now = steady_clock::now();
+			Operations.ForEach([&](const unsigned long OP, FECOperation& Operation) {
+				Operation.OUT_Mutex.lock();
+				if (!Operation.OUT_Shards.empty() && Now - Operation.OUT_GroupStart >= milliseconds(PN_FECGroupAge)) { CloseGroup(OP, &Operation, Out); }
+				Operation.OUT_Mutex.unlock();
+			});
+			OUT_Mutex.lock();
+			for (auto Packet : Out) { OUT_Packets.push_back(Packet); }
+			OUT_Mutex.unlock();
+		}
+
+		inline void DeleteUsed()
+		{
+			OUT_Mutex.lock();
+			auto Packet = OUT_Packets.begin();
+			while (Packet != OUT_Packets.end())
+			{
+				if ((*Packet)->NeedsDelete == 1) {
+					Retire(*Packet);
+					Packet = OUT_Packets.erase(Packet);
+				}
+				else {
+					++Packet;
+				}
+			}
+			OUT_Mutex.unlock();
+		}
+
+		//	Swaps the NeedsProcessed queue with an external empty queue (from another thread)
+		inline void SwapProcessingQueue(std::deque<ReceivePacket*> &Queue)
+		{
+			IN_Mutex.lock();
+			NeedsProcessed.swap(Queue);
+			IN_Mutex.unlock();
+		}
+
+		//	Receives a shard
+		//	Data is handed over immediately, in whatever order it arrives
+		//	Once a group has K shards including parity any missing data is rebuilt and handed over too
+		//	IN_Packet is always consumed
+		inline void Receive(ReceivePacket*const IN_Packet)
+		{
+			const unsigned long OP = IN_Packet->GetOperationID();
+			FECOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { delete IN_Packet; return; }
+			const unsigned long Group = IN_Packet->ReadData<unsigned long>();
+			const unsigned char Index = IN_Packet->ReadData<unsigned char>();
+			const unsigned char K = IN_Packet->ReadData<unsigned char>();
+			const unsigned char M = IN_Packet->ReadData<unsigned char>();
+			string Shard(IN_Packet->ReadData<string>());
+			const bool IsParity = Index >= K;
+			if (K == 0 || K + M > PN_FECMaxShards || Index >= K + M) { delete IN_Packet; return; }
+
+#ifdef _PERF_SPINLOCK
+			while (!Operation->IN_Mutex.try_lock()) {}
+#else
+			Operation->IN_Mutex.lock();
+#endif
+			FECGroup& G = Operation->IN_Groups[Group & (PN_FECHistory - 1)];
+			//	Too old to matter any more
+			if (Group < G.ID) { Operation->IN_Mutex.unlock(); delete IN_Packet; return; }
+			if (Group > G.ID)
+			{
+				//	Whatever the previous occupant never got is gone for good
+				if (G.K > 0) {
+					for (unsigned char d = 0; d < G.K; d++) { if (!G.Have[d]) { ++Stats_Lost; } }
+				}
+				for (unsigned char r = 0; r < PN_FECMaxShards; r++) { G.Have[r] = false; G.Shards[r].clear(); }
+				G.ID = Group;
+				G.K = 0; G.M = 0; G.Received = 0; G.Size = 0;
+			}
+			if (G.Have[Index]) { Operation->IN_Mutex.unlock(); delete IN_Packet; return; }
+			//	Parity knows the groups final shape
+			if (IsParity) {
+				G.K = K; G.M = M; G.Size = Shard.size();
+				G.FirstID = IN_Packet->GetPacketID();
+				G.CreationTime = IN_Packet->GetCreationTime();
+			}
+			else {
+				G.FirstID = IN_Packet->GetPacketID() - Index;
+				Deliver(IN_Packet->GetPacketID(), OP, IN_Packet->GetCreationTime(), Shard);
+			}
+			G.Shards[Index].swap(Shard);
+			G.Have[Index] = true;
+			++G.Received;
+			//	Rebuild whatever data is still missing once we have enough
+			if (G.K > 0 && G.Received >= G.K)
+			{
+				bool Missing = false;
+				for (unsigned char d = 0; d < G.K; d++) { if (!G.Have[d]) { Missing = true; break; } }
+				if (Missing && FEC::Decode(G.Shards, G.Have, G.K, G.M, G.Size))
+				{
+					for (unsigned char d = 0; d < G.K; d++)
+					{
+						if (G.Have[d]) { continue; }
+						G.Have[d] = true;
+						++G.Received;
+						++Stats_Recovered;
+#ifdef _DEBUG_PACKETS_FEC
+						printf("FEC - %d - Recovered\n", G.FirstID + d);
+#endif
+						Deliver(G.FirstID + d, OP, G.CreationTime, G.Shards[d]);
+					}
+				}
+			}
+			Operation->IN_Mutex.unlock();
+			delete IN_Packet;
+		}
+
+		inline void PrintStats()
+		{
+			printf("FEC Channel Recovered: %llu Lost: %llu\n", Stats_Recovered.load(), Stats_Lost.load());
+		}
+	};
+}
\ No newline at end of file
@@ -9,22 +9,29 @@ namespace PeerNet
 	{
 		NetAddress*const Address;
 		const PacketType ChannelID;
+		AckTracker*const Acks;
+		RTTEstimator*const Estimator;
 
 		const long long RollingRTT;			//	Keep a rolling average of the last estimated 60 Round Trip Times
 		duration<double, milli> OUT_RTT;	//	Start the system off assuming a 100ms ping. Let the algorythms adjust from that point.
 
 		std::atomic<unsigned long> IN_LastID;	//	The largest received ID so far
 
-		std::mutex OUT_Mutex;
+		PeerMutex OUT_Mutex;
 		std::atomic<unsigned long> OUT_NextID;	//	Next packet ID we'll use
 		std::atomic<unsigned long> OUT_LastACK;	//	Highest ACK'd packet id
 		std::deque<SendPacket*> OUT_Packets;	//	Packets that need to be deleted
 
 	public:
-		inline KeepAliveChannel(NetAddress*const Addr, const PacketType &ChanID)
-			: Address(Addr), ChannelID(ChanID), RollingRTT(60), OUT_RTT(100),
+		inline KeepAliveChannel(NetAddress*const Addr, const PacketType &ChanID, AckTracker*const AckTrack, RTTEstimator*const RTT, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack), Estimator(RTT), RollingRTT(60), OUT_RTT(100),
 			IN_LastID(0),
-			OUT_Mutex(), OUT_NextID(1), OUT_LastACK(0) {}
+			OUT_Mutex(Polled), OUT_NextID(1), OUT_LastACK(0) {}
+
+		inline ~KeepAliveChannel()
+		{
+			for (auto Packet : OUT_Packets) { Retire(Packet); }
+		}
 
 		//	Initialize and return a new packet for sending
 		inline SendPacket*const NewPacket()
@@ -55,7 +62,7 @@ namespace PeerNet
 			while (Packet != OUT_Packets.end())
 			{
 				if ((*Packet)->NeedsDelete == 1) {
-					delete (*Packet);
+					Retire(*Packet);
 					Packet = OUT_Packets.erase(Packet);
 				}
 				else {
@@ -76,6 +83,7 @@ namespace PeerNet
 				OUT_LastACK.store(IN_Packet->GetPacketID());
 				//	Calculate the RTT
 				std::chrono::duration <double, milli> RTT = steady_clock::now() - IN_Packet->GetCreationTime();
+				Estimator->Sample(RTT);
 #ifdef _PERF_SPINLOCK
 				while (!OUT_Mutex.try_lock()) {}
 #else
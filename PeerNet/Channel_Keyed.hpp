@@ -0,0 +1,319 @@
+#pragma once
+#include <unordered_set>
+#include <vector>
+
+#define PN_KeyedHistory 256		//	Sent packets each operation remembers to match acknowledgements against; must be a power of two
+#define PN_KeyedPayload 1200	//	Bytes of values packed into one packet before starting another
+#define PN_KeyedMaxKeys 4096	//	Keys each operation tracks for the remote side unless OperationDescriptor::MaxKeys says otherwise
+
+namespace PeerNet
+{
+	struct KeyedValue
+	{
+		string Value;
+		unsigned long Version = 0;		//	Taken from the operation every time the value is written
+		unsigned long AckedVersion = 0;	//	Newest version the remote peer has acknowledged
+		bool Dirty = false;				//	Written since it was last sent
+		unsigned char SendCount = 0;	//	Times this version has been sent; each resend waits twice as long as the last
+		steady_clock::time_point LastSent;
+	};
+
+	//	Which key versions a sent packet carried
+	struct KeyedSent
+	{
+		unsigned long ID = 0;
+		std::vector<std::pair<unsigned long, unsigned long>> Keys;
+	};
+
+	struct KeyedOperation
+	{
+		//	IN
+		PeerMutex IN_Mutex;
+		std::unordered_map<unsigned long, unsigned long> IN_Versions;	//	Newest version delivered per key
+		size_t IN_MaxKeys = PN_KeyedMaxKeys;							//	Most keys IN_Versions may hold
+		//	OUT
+		PeerMutex OUT_Mutex;
+		bool Reliable = false;
+		unsigned long OUT_NextID = 1;
+		unsigned long OUT_LastVersion = 0;	//	Versions count up across every key so a key forgotten and written again still moves forward
+		std::unordered_map<unsigned long, KeyedValue> OUT_Values;	//	Latest value written per key, for keys that still need to go out
+		std::unordered_set<unsigned long> OUT_Pending;				//	Keys that still need to go out
+		KeyedSent OUT_Sent[PN_KeyedHistory];						//	Recently sent packets indexed by (ID & (PN_KeyedHistory - 1))
+	};
+
+	//
+	//	Keyed Channel
+	//	Values are written under a key and only the newest value per key is kept
+	//	Everything written since the last flush goes out together, packed into as few packets as possible
+	//	Reliable operations keep resending a key until its newest version is acknowledged
+	//	Layout: [Reliable] [Count] { [Key] [Version] [Value] } ...
+	class KeyedChannel
+	{
+		NetAddress*const Address;
+		const PacketType ChannelID;
+		AckTracker*const Acks;
+		RTTEstimator*const Estimator;
+
+		OperationTable<KeyedOperation> Operations;
+
+		PeerMutex OUT_Mutex;
+		std::deque<SendPacket*> OUT_Packets;	//	Packets that need to be deleted
+
+		PeerMutex IN_Mutex;
+		std::deque<ReceivePacket*> NeedsProcessed;	//	Packets that need to be processed
+
+		std::atomic<unsigned long long> Stats_Written;	//	Values handed to us
+		std::atomic<unsigned long long> Stats_Sent;		//	Values actually written into packets
+		std::atomic<unsigned long long> Stats_Resent;	//	Values written into packets again while waiting on an ACK
+		std::atomic<unsigned long long> Stats_Dropped;	//	Incoming packets dropped for bringing more keys than allowed
+
+		//	Mark every key version a packet carried as acknowledged
+		inline void Acknowledge(KeyedOperation*const Operation, const unsigned long ID)
+		{
+			KeyedSent& Sent = Operation->OUT_Sent[ID & (PN_KeyedHistory - 1)];
+			if (Sent.ID != ID) { return; }
+			for (auto& Key : Sent.Keys)
+			{
+				auto Value = Operation->OUT_Values.find(Key.first);
+				if (Value == Operation->OUT_Values.end() || Key.second <= Value->second.AckedVersion) { continue; }
+				Value->second.AckedVersion = Key.second;
+				//	Only stop once the newest version is through, then forget the key entirely
+				if (Value->second.AckedVersion >= Value->second.Version) {
+					Operation->OUT_Pending.erase(Key.first);
+					Operation->OUT_Values.erase(Value);
+				}
+			}
+			Sent.ID = 0;
+			Sent.Keys.clear();
+		}
+
+	public:
+		inline KeyedChannel(NetAddress*const Addr, const PacketType &ChanID, AckTracker*const AckTrack, RTTEstimator*const RTT, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack), Estimator(RTT), Operations(Polled),
+			OUT_Mutex(Polled), OUT_Packets(), IN_Mutex(Polled), NeedsProcessed(), Stats_Written(0), Stats_Sent(0), Stats_Resent(0), Stats_Dropped(0) {}
+
+		inline ~KeyedChannel()
+		{
+			for (auto Packet : OUT_Packets) { Retire(Packet); }
+			for (auto Packet : NeedsProcessed) { delete Packet; }
+		}
+
+		//	Create the state for an operation before any traffic uses it
+		inline const bool Register(const unsigned long OP) { return Operations.Register(OP); }
+
+		//	Should keys of this operation be resent until acknowledged
+		//	Turning it off drops keys that already went out and were only waiting on an acknowledgement
+		inline void SetReliable(const unsigned long OP, const bool Reliable)
+		{
+			KeyedOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+			Operation->OUT_Mutex.lock();
+			Operation->Reliable = Reliable;
+			if (!Reliable)
+			{
+				auto Key = Operation->OUT_Pending.begin();
+				while (Key != Operation->OUT_Pending.end())
+				{
+					auto Value = Operation->OUT_Values.find(*Key);
+					if (Value != Operation->OUT_Values.end() && Value->second.Dirty) { ++Key; continue; }
+					if (Value != Operation->OUT_Values.end()) { Operation->OUT_Values.erase(Value); }
+					Key = Operation->OUT_Pending.erase(Key);
+				}
+				for (auto& Sent : Operation->OUT_Sent) { Sent.ID = 0; Sent.Keys.clear(); }
+			}
+			Operation->OUT_Mutex.unlock();
+		}
+
+		//	Cap how many keys of an operation we remember the newest version of
+		//	Every key the remote side ever writes costs an entry, so without a cap it could grow us without bound
+		inline void SetMaxKeys(const unsigned long OP, const size_t MaxKeys)
+		{
+			KeyedOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+			Operation->IN_Mutex.lock();
+			Operation->IN_MaxKeys = MaxKeys;
+			Operation->IN_Mutex.unlock();
+		}
+
+		//	Initialize and return a new packet for the user to fill with a keys value
+		//	It is not sent as-is; Write stores it until the next Flush
+		inline SendPacket* NewPacket(const unsigned long& OP, const unsigned long& Key)
+		{
+			if (Operations.Find(OP) == nullptr) { printf("Keyed Channel - Unregistered Operation %lu\n", OP); return nullptr; }
+			return new SendPacket(Key, ChannelID, OP, Address);
+		}
+
+		//	Consumes a filled packet, replacing whatever value its key held
+		inline void Write(SendPacket*const UserPacket)
+		{
+			const unsigned long Key = UserPacket->GetPacketID();
+			KeyedOperation*const Operation = Operations.Find(UserPacket->GetOperationID());
+			if (Operation == nullptr) { delete UserPacket; return; }
+			string Payload(UserPacket->GetPayload());
+#ifdef _PERF_SPINLOCK
+			while (!Operation->OUT_Mutex.try_lock()) {}
+#else
+			Operation->OUT_Mutex.lock();
+#endif
+			KeyedValue& Value = Operation->OUT_Values[Key];
+			Value.Value.swap(Payload);
+			Value.Version = ++Operation->OUT_LastVersion;
+			Value.Dirty = true;
+			Value.SendCount = 0;
+			Operation->OUT_Pending.insert(Key);
+			Operation->OUT_Mutex.unlock();
+			++Stats_Written;
+			delete UserPacket;
+		}
+
+		//	Pack every key that needs to go out into packets and fill Out with them
+		//	Called once per tick
+		inline void Flush(std::vector<SendPacket*>& Out)
+		{
+			const steady_clock::time_point Now = steady_clock::now();
+			const size_t First = Out.size();
+			Operations.ForEach([&](const unsigned long OP, KeyedOperation& Operation) {
+				Operation.OUT_Mutex.lock();
+				std::vector<std::vector<unsigned long>> Batches(1);
+				size_t BatchSize = 0;
+				auto Key = Operation.OUT_Pending.begin();
+				while (Key != Operation.OUT_Pending.end())
+				{
+					KeyedValue& Value = Operation.OUT_Values[*Key];
+					//	Reliable keys that already went out wait a retransmission timeout for their ACK, backed off like any other resend
+					if (!Value.Dirty && (!Operation.Reliable || !Estimator->RetransmitDue(Value.SendCount, Value.LastSent, Now))) { ++Key; continue; }
+					if (!Value.Dirty) { ++Stats_Resent; }
+					const size_t Size = Value.Value.size() + 16;
+					if (BatchSize > 0 && BatchSize + Size > PN_KeyedPayload) {
+						Batches.emplace_back();
+						BatchSize = 0;
+					}
+					Batches.back().push_back(*Key);
+					BatchSize += Size;
+					Value.Dirty = false;
+					Value.LastSent = Now;
+					if (Value.SendCount < 255) { ++Value.SendCount; }
+					//	Unreliable keys are done as soon as they're sent; their values go once they're written below
+					if (!Operation.Reliable) { Key = Operation.OUT_Pending.erase(Key); }
+					else { ++Key; }
+				}
+				for (auto& Batch : Batches)
+				{
+					if (Batch.empty()) { continue; }
+					const unsigned long PacketID = Operation.OUT_NextID++;
+					SendPacket* Packet = new SendPacket(PacketID, ChannelID, OP, Address, true);
+					Packet->WriteData<unsigned char>(Operation.Reliable);
+					Packet->WriteData<unsigned short>((unsigned short)Batch.size());
+					KeyedSent& Sent = Operation.OUT_Sent[PacketID & (PN_KeyedHistory - 1)];
+					Sent.ID = Operation.Reliable ? PacketID : 0;
+					Sent.Keys.clear();
+					for (auto BatchKey : Batch)
+					{
+						const KeyedValue& Value = Operation.OUT_Values[BatchKey];
+						Packet->WriteData<unsigned long>(BatchKey);
+						Packet->WriteData<unsigned long>(Value.Version);
+						Packet->WriteData<string>(Value.Value);
+						if (Operation.Reliable) { Sent.Keys.emplace_back(BatchKey, Value.Version); }
+						else { Operation.OUT_Values.erase(BatchKey); }
+					}
+					Stats_Sent += Batch.size();
+					Out.push_back(Packet);
+				}
+				Operation.OUT_Mutex.unlock();
+			});
+			OUT_Mutex.lock();
+			for (size_t i = First; i < Out.size(); i++) { OUT_Packets.push_back(Out[i]); }
+			OUT_Mutex.unlock();
+		}
+
+		//	Acknowledge delivery from a selective acknowledgement
+		inline void ACK(const unsigned long& Latest, const unsigned long long& Mask, const unsigned long& OP)
+		{
+			KeyedOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+#ifdef _PERF_SPINLOCK
+			while (!Operation->OUT_Mutex.try_lock()) {}
+#else
+			Operation->OUT_Mutex.lock();
+#endif
+			Acknowledge(Operation, Latest);
+			for (unsigned char Bit = 0; Bit < 64 && Bit + 1 < Latest; ++Bit) {
+				if (Mask & (1ull << Bit)) { Acknowledge(Operation, Latest - 1 - Bit); }
+			}
+			Operation->OUT_Mutex.unlock();
+		}
+
+		inline void DeleteUsed()
+		{
+			OUT_Mutex.lock();
+			auto Packet = OUT_Packets.begin();
+			while (Packet != OUT_Packets.end())
+			{
+				if ((*Packet)->NeedsDelete == 1) {
+					Retire(*Packet);
+					Packet = OUT_Packets.erase(Packet);
+				}
+				else {
+					++Packet;
+				}
+			}
+			OUT_Mutex.unlock();
+		}
+
+		//	Swaps the NeedsProcessed queue with an external empty queue (from another thread)
+		inline void SwapProcessingQueue(std::deque<ReceivePacket*> &Queue)
+		{
+			IN_Mutex.lock();
+			NeedsProcessed.swap(Queue);
+			IN_Mutex.unlock();
+		}
+
+		//	Receives a packet of keyed values
+		//	Each value is handed to the user as its own packet whose ID is the key
+		//	Values older than one already delivered for the same key are skipped
+		//	A key that would take us past the operation's MaxKeys drops the rest of the packet, unacknowledged
+		//	IN_Packet is always consumed
+		inline void Receive(ReceivePacket*const IN_Packet)
+		{
+			const unsigned long OP = IN_Packet->GetOperationID();
+			KeyedOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { delete IN_Packet; return; }
+			const bool Reliable = IN_Packet->ReadData<unsigned char>() != 0;
+			unsigned short Count = IN_Packet->ReadData<unsigned short>();
+#ifdef _PERF_SPINLOCK
+			while (!Operation->IN_Mutex.try_lock()) {}
+#else
+			Operation->IN_Mutex.lock();
+#endif
+			while (Count-- > 0)
+			{
+				const unsigned long Key = IN_Packet->ReadData<unsigned long>();
+				const unsigned long Version = IN_Packet->ReadData<unsigned long>();
+				const string Value(IN_Packet->ReadData<string>());
+				auto Known = Operation->IN_Versions.find(Key);
+				if (Known == Operation->IN_Versions.end()) {
+					if (Operation->IN_Versions.size() >= Operation->IN_MaxKeys) {
+						++Stats_Dropped;
+						Operation->IN_Mutex.unlock();
+						delete IN_Packet;
+						return;
+					}
+					Known = Operation->IN_Versions.emplace(Key, 0).first;
+				}
+				if (Version <= Known->second) { continue; }
+				Known->second = Version;
+				IN_Mutex.lock();
+				NeedsProcessed.push_back(new ReceivePacket(Key, ChannelID, OP, IN_Packet->GetCreationTime(), Value));
+				IN_Mutex.unlock();
+			}
+			if (Reliable) { Acks->Received(ChannelID, OP, IN_Packet->GetPacketID(), 0); }
+			Operation->IN_Mutex.unlock();
+			delete IN_Packet;
+		}
+
+		inline void PrintStats()
+		{
+			printf("Keyed Channel Written: %llu Sent: %llu Resent: %llu Dropped: %llu\n", Stats_Written.load(), Stats_Sent.load(), Stats_Resent.load(), Stats_Dropped.load());
+		}
+	};
+}
\ No newline at end of file
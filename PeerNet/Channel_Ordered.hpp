@@ -1,15 +1,24 @@
 #pragma once
 
+#define PN_OrderedWindow 1024	//	Packets each operation will hold waiting for a gap to fill; must be a power of two
+
 namespace PeerNet
 {
 	struct OrderedOperation
 	{
 		//	IN
+		PeerMutex IN_Mutex;
 		unsigned long IN_LowestID = 0;	//	The lowest received ID
 		unsigned long IN_HighestID = 0;	//	Highest received ID
-		std::unordered_map<unsigned long, ReceivePacket*> IN_StoredIDs;	//	Incoming packets we cant process yet
+		unsigned long IN_StoredCount = 0;	//	Packets currently held in the ring
+		unsigned long IN_QueuedCount = 0;	//	Packets delivered in order but not yet handed to Receive()
+		unsigned short IN_Window = PN_OrderedWindow;	//	Most packets held at once, stored or queued
+		ReceivePacket* IN_Ring[PN_OrderedWindow] = {};	//	Incoming packets we cant process yet indexed by (ID & (PN_OrderedWindow - 1))
 		//	OUT
+		PeerMutex OUT_Mutex;
 		std::atomic<unsigned long> OUT_NextID = 1;	//	The next packet ID we'll use
+		unsigned long OUT_LastACK = 0;	//	Every packet ID up to this one has been acknowledged
+		unsigned long OUT_HighestACK = 0;	//	Highest packet ID acknowledged
 		std::unordered_map<unsigned long, SendPacket*> OUT_Packets;	//	Unacknowledged outgoing packets
 	};
 
@@ -17,83 +26,135 @@ namespace PeerNet
 	{
 		NetAddress*const Address;
 		const PacketType ChannelID;
+		AckTracker*const Acks;
+		RTTEstimator*const Estimator;
+		SendPacer*const Pacer;
 
-		std::mutex IN_Mutex;
-		std::mutex OUT_Mutex;
-		std::deque<SendPacket*> OUT_ACKs;	//	ACKs that need to be deleted
-
-		std::unordered_map<unsigned long, OrderedOperation> Operations;
+		OperationTable<OrderedOperation> Operations;
 
+		PeerMutex IN_Mutex;
 		std::deque<ReceivePacket*> NeedsProcessed;	//	Packets that need to be processed
 
+		//	How many IDs past IN_LowestID we have room for; the operations window less what's waiting to be processed
+		//	Must be called with the operations IN_Mutex held
+		inline static const unsigned short FreeWindow(const OrderedOperation*const OP)
+		{
+			return (unsigned short)(OP->IN_Window - (std::min)(OP->IN_QueuedCount, (unsigned long)OP->IN_Window));
+		}
+
 	public:
 		//	Default constructor initializes us and our base class
-		inline OrderedChannel(NetAddress*const Addr, const PacketType &ChanID)
-			: Address(Addr), ChannelID(ChanID),
-			IN_Mutex(), OUT_Mutex(), NeedsProcessed() {}
-
-		//	Acknowledge delivery of a single packet
-		//	TODO:
-		//	This will cause a resource leak when IsSending.load == false
-		//	Since it wont get erased from OUT_Packets, it will eventually resend
-		//	and eventually we'll receive an ack which deletes it
-		inline void ACK(const unsigned long& ID, const unsigned long& OP)
+		inline OrderedChannel(NetAddress*const Addr, const PacketType &ChanID, AckTracker*const AckTrack, RTTEstimator*const RTT, SendPacer*const Pace, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack), Estimator(RTT), Pacer(Pace),
+			Operations(Polled), IN_Mutex(Polled), NeedsProcessed() {}
+
+		//	Create the state for an operation before any traffic uses it
+		inline const bool Register(const unsigned long OP) { return Operations.Register(OP); }
+
+		//	Limit how many packets an operation holds waiting on a gap or to be processed; 0 or anything past PN_OrderedWindow means PN_OrderedWindow
+		inline void SetWindow(const unsigned long OP, const unsigned short Window)
 		{
-			//	Grab our OrderedOperation; Creates a new one if not exists
-			auto it = Operations[OP].OUT_Packets.find(ID);
-			if (it != Operations[OP].OUT_Packets.end()) {
-				it->second->NeedsDelete.store(1);
+			OrderedOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+			Operation->IN_Mutex.lock();
+			Operation->IN_Window = (Window == 0 || Window > PN_OrderedWindow) ? (unsigned short)PN_OrderedWindow : Window;
+			Operation->IN_Mutex.unlock();
+		}
+
+		inline ~OrderedChannel()
+		{
+			Operations.ForEach([](const unsigned long, OrderedOperation& Operation) {
+				for (auto Packet : Operation.IN_Ring) { delete Packet; }
+				for (auto Packet : Operation.OUT_Packets) { Retire(Packet.second); }
+			});
+			for (auto Packet : NeedsProcessed) { delete Packet; }
+		}
+
+		//	Acknowledge delivery from a selective acknowledgement
+		//	Cumulative covers everything up to it, Mask covers the 64 IDs below Latest
+		//	Packets left out of PN_FastRetransmit newer acknowledgements are queued for resending right away
+		//	Window is how many IDs past Cumulative the remote peer has room for
+		inline void ACK(const unsigned long& Cumulative, const unsigned long& Latest, const unsigned long long& Mask, const unsigned long& OP, const unsigned short& Window)
+		{
+			OrderedOperation*const Op = Operations.Find(OP);
+			if (Op == nullptr) { return; }
+#ifdef _PERF_SPINLOCK
+			while (!Op->OUT_Mutex.try_lock()) {}
+#else
+			Op->OUT_Mutex.lock();
+#endif
+			const auto Acknowledge = [Op, this](const unsigned long ID) {
+				auto it = Op->OUT_Packets.find(ID);
+				if (it != Op->OUT_Packets.end() && it->second->NeedsDelete.exchange(1) == 0) { Pacer->Acked(it->second); }
+			};
+			//	Only packets sent exactly once give an unambiguous Round-Trip-Time
+			auto Newest = Op->OUT_Packets.find(Latest);
+			if (Newest != Op->OUT_Packets.end() && Newest->second->NeedsDelete.load() == 0 && Newest->second->GetSendCount() == 1) {
+				Estimator->Sample(steady_clock::now() - Newest->second->GetLastSent());
+			}
+			//	Each ID is only walked cumulatively once
+			const unsigned long Limit = (std::min)(Cumulative, Op->OUT_NextID.load() - 1);
+			for (unsigned long ID = Op->OUT_LastACK + 1; ID <= Limit; ++ID) { Acknowledge(ID); }
+			if (Limit > Op->OUT_LastACK) { Op->OUT_LastACK = Limit; }
+			if (Latest > Op->OUT_LastACK) { Acknowledge(Latest); }
+			for (unsigned char Bit = 0; Bit < 64; ++Bit)
+			{
+				if (!(Mask & (1ull << Bit))) { continue; }
+				const unsigned long ID = Latest - 1 - Bit;
+				if (ID <= Op->OUT_LastACK) { break; }
+				Acknowledge(ID);
 			}
+			//	Count a report against every gap below a newly acknowledged packet
+			if (Latest > Op->OUT_HighestACK && Latest < Op->OUT_NextID.load())
+			{
+				const unsigned long Lowest = (std::max)(Op->OUT_LastACK + 1, Latest > 64 ? Latest - 64 : 1ul);
+				for (unsigned long ID = Lowest; ID < Latest; ++ID)
+				{
+					if (Mask & (1ull << (Latest - 1 - ID))) { continue; }
+					auto it = Op->OUT_Packets.find(ID);
+					if (it == Op->OUT_Packets.end() || it->second->NeedsDelete.load() == 1) { continue; }
+					SendPacket*const Packet = it->second;
+					if (Packet->GapReports < PN_FastRetransmit && ++Packet->GapReports == PN_FastRetransmit && Packet->IsSending.load() == 0)
+					{
+						Packet->IsSending.store(1);
+						Pacer->Retransmit(Packet, false);
+					}
+				}
+				Op->OUT_HighestACK = Latest;
+			}
+			//	Never run further ahead than the remote peer can hold
+			Pacer->SetSendLimit(ChannelID, OP, Cumulative + Window);
+			Op->OUT_Mutex.unlock();
 		}
 
 		//	Initialize and return a new packet for sending
 		inline SendPacket* NewPacket(const unsigned long& OP)
 		{
-			const unsigned long PacketID = Operations[OP].OUT_NextID++;
-			SendPacket* Packet = new SendPacket(PacketID, ChannelID, OP, Address);
-			Packet->WriteData<bool>(false);	//	Not an ACK
+			OrderedOperation*const Op = Operations.Find(OP);
+			if (Op == nullptr) { printf("Ordered Channel - Unregistered Operation %lu\n", OP); return nullptr; }
 #ifdef _PERF_SPINLOCK
-			while (!OUT_Mutex.try_lock()) {}
+			while (!Op->OUT_Mutex.try_lock()) {}
 #else
-			OUT_Mutex.lock();
+			Op->OUT_Mutex.lock();
 #endif
-			Operations[OP].OUT_Packets.emplace(PacketID, Packet);
-			OUT_Mutex.unlock();
+			const unsigned long PacketID = Op->OUT_NextID++;
+			//	Until the receiver advertises its window assume it matches ours
+			if (PacketID == 1) { Pacer->SetSendLimit(ChannelID, OP, PN_OrderedWindow); }
+			SendPacket* Packet = new SendPacket(PacketID, ChannelID, OP, Address);
+			Op->OUT_Packets.emplace(PacketID, Packet);
+			Op->OUT_Mutex.unlock();
 			return Packet;
 		}
 
-		inline SendPacket*const NewACK(ReceivePacket* IncomingPacket, NetAddress* Address)
+		//	Queues unacknowledged packets whose retransmission timeout has expired with the pacer
+		inline void ResendUnacknowledged()
 		{
-			SendPacket* ACK = new SendPacket(IncomingPacket->GetPacketID(), PN_Ordered, IncomingPacket->GetOperationID(), Address, true, IncomingPacket->GetCreationTime());
-			ACK->WriteData<bool>(true);	//	Is an ACK
-			OUT_Mutex.lock();
-			OUT_ACKs.push_back(ACK);
-			OUT_Mutex.unlock();
-			return ACK;
-		}
-
-		//	Resends all unacknowledged packets across a specific NetSocket
-		inline void ResendUnacknowledged(NetSocket*const Socket)
-		{
-			OUT_Mutex.lock();
-			//	Cleanup sent ACKs
-			auto Packet = OUT_ACKs.begin();
-			while (Packet != OUT_ACKs.end())
-			{
-				if ((*Packet)->NeedsDelete == 1) {
-					delete (*Packet);
-					Packet = OUT_ACKs.erase(Packet);
-				}
-				else {
-					++Packet;
-				}
-			}
+			const steady_clock::time_point Now = steady_clock::now();
 			//	Resend unacknowledged packets
-			auto Operation = Operations.begin();
-			while (Operation != Operations.end())
-			{
-				auto Packet = Operation->second.OUT_Packets.begin();
-				while (Packet != Operation->second.OUT_Packets.end())
+			Operations.ForEach([&](const unsigned long, OrderedOperation& Operation) {
+				Operation.OUT_Mutex.lock();
+				auto Packet = Operation.OUT_Packets.begin();
+				while (Packet != Operation.OUT_Packets.end())
 				{
 					//	If we're not currently sending
 					if (Packet->second->IsSending.load() == 0)
@@ -101,81 +162,121 @@ namespace PeerNet
 						//	If this packet needs deleted
 						if (Packet->second->NeedsDelete.load() == 1)
 						{
-							delete Packet->second;
-							Packet = Operation->second.OUT_Packets.erase(Packet);
+							Retire(Packet->second);
+							Packet = Operation.OUT_Packets.erase(Packet);
 							continue;
 						}
-						//	If this packet doesn't need deleted
-						else {
+						//	If this packet doesn't need deleted and has waited long enough for its ACK
+						else if (Estimator->RetransmitDue(Packet->second, Now)) {
 							//	Flag this packet as sending
 							Packet->second->IsSending.store(1);
 							//	Resend the packet
-							Socket->SendPacket(Packet->second);
+							Pacer->Retransmit(Packet->second, true);
 						}
 					}
 					//	Move to the next packet
 					++Packet;
 				}
-				//	Move to the next operation
-				++Operation;
-			}
-			OUT_Mutex.unlock();
+				Operation.OUT_Mutex.unlock();
+			});
 		}
 
 		//	Swaps the NeedsProcessed queue with an external empty queue (from another thread)
+		//	Whatever it hands over is about to be processed, so its operations windows open back up
 		inline void SwapProcessingQueue(std::deque<ReceivePacket*> &Queue)
 		{
 			IN_Mutex.lock();
 			NeedsProcessed.swap(Queue);
 			IN_Mutex.unlock();
+			//	Packets of an operation arrive in runs; settle each run under one lock
+			auto Run = Queue.begin();
+			while (Run != Queue.end())
+			{
+				const unsigned long OperationID = (*Run)->GetOperationID();
+				unsigned long Count = 0;
+				while (Run != Queue.end() && (*Run)->GetOperationID() == OperationID) { ++Count; ++Run; }
+				OrderedOperation*const OP = Operations.Find(OperationID);
+				if (OP == nullptr) { continue; }
+				OP->IN_Mutex.lock();
+				OP->IN_QueuedCount -= (std::min)(Count, OP->IN_QueuedCount);
+				//	A sender we had stalled won't send anything to hear the news from; tell it ourselves
+				Acks->Reopened(ChannelID, OperationID, FreeWindow(OP));
+				OP->IN_Mutex.unlock();
+			}
 		}
 
 		//	Receives an ordered packet
 		inline void Receive(ReceivePacket*const IN_Packet)
 		{
+			//	Cache our OrderedOperation
+			//	IN_Packet may be processed and deleted by another thread once it is queued
+			const unsigned long OperationID = IN_Packet->GetOperationID();
+			OrderedOperation*const OP = Operations.Find(OperationID);
+			if (OP == nullptr) { delete IN_Packet; return; }
 			//	Process a data packet
 #ifdef _PERF_SPINLOCK
-			while (!IN_Mutex.try_lock()) {}
+			while (!OP->IN_Mutex.try_lock()) {}
 #else
-			IN_Mutex.lock();
+			OP->IN_Mutex.lock();
 #endif
-			//	Cache our OrderedOperation
-			OrderedOperation* OP = &Operations[IN_Packet->GetOperationID()];
+			const unsigned long ID = IN_Packet->GetPacketID();
 
 			//	Ignore ID's below the LowestID
-			if (IN_Packet->GetPacketID() <= OP->IN_LowestID)
-			{ IN_Mutex.unlock(); delete IN_Packet; return; }
+			//	Still acknowledged since our earlier acknowledgement was evidently lost
+			if (ID <= OP->IN_LowestID)
+			{
+				Acks->Received(ChannelID, OperationID, ID, OP->IN_LowestID, FreeWindow(OP));
+				OP->IN_Mutex.unlock(); delete IN_Packet; return;
+			}
+
+			//	Drop ID's past the end of our window; the sender ignored our advertised window
+			//	Not acknowledged so it gets sent again once the window has moved
+			if (ID - OP->IN_LowestID > FreeWindow(OP))
+			{
+				OP->IN_Mutex.unlock(); delete IN_Packet; return;
+			}
 
 			//	Ignore ID's we've already stored
-			if (OP->IN_StoredIDs.count(IN_Packet->GetPacketID()))
+			ReceivePacket*& Slot = OP->IN_Ring[ID & (PN_OrderedWindow - 1)];
+			if (Slot != nullptr)
 			{
-				IN_Mutex.unlock(); delete IN_Packet; return;
+				Acks->Received(ChannelID, OperationID, ID, OP->IN_LowestID, FreeWindow(OP));
+				OP->IN_Mutex.unlock(); delete IN_Packet; return;
 			}
 
 			//	Update our HighestID if needed
-			if (IN_Packet->GetPacketID() > OP->IN_HighestID)
-			{ OP->IN_HighestID = IN_Packet->GetPacketID(); }
+			if (ID > OP->IN_HighestID)
+			{ OP->IN_HighestID = ID; }
 
 
 			//	(in-sequence processing)
 			//	Update our LowestID if needed
-			if (IN_Packet->GetPacketID() == OP->IN_LowestID + 1) {
+			if (ID == OP->IN_LowestID + 1) {
 				++OP->IN_LowestID;
-				//printf("Ordered - %d - %s\tNew\n", IN_Packet->GetPacketID(), IN_Packet->ReadData<std::string>().c_str());
 				//	Push this packet into the NeedsProcessed Queue
+				//	Still holding the operation lock so no other thread can slip a later packet in first
+#ifdef _PERF_SPINLOCK
+				while (!IN_Mutex.try_lock()) {}
+#else
+				IN_Mutex.lock();
+#endif
 				NeedsProcessed.push_back(IN_Packet);
-				// Loop through our StoredIDs container until we cant find (LowestID+1)
-				while (OP->IN_StoredIDs.count(OP->IN_LowestID + 1))
+				++OP->IN_QueuedCount;
+				//	Walk the ring until we hit the next gap
+				ReceivePacket** Next = &OP->IN_Ring[(OP->IN_LowestID + 1) & (PN_OrderedWindow - 1)];
+				while (*Next != nullptr)
 				{
 					++OP->IN_LowestID;
-					//printf("Ordered - %d - %s\tStored\n", IN_LowestID, IN_StoredIDs.at(IN_LowestID)->ReadData<std::string>().c_str());
 					//	Push this packet into the NeedsProcessed Queue
-					ReceivePacket* Pkt = OP->IN_StoredIDs.at(OP->IN_LowestID);
-					NeedsProcessed.push_back(Pkt);
-					//	Erase the ID from our out-of-order map
-					OP->IN_StoredIDs.erase(OP->IN_LowestID);
+					NeedsProcessed.push_back(*Next);
+					*Next = nullptr;
+					--OP->IN_StoredCount;
+					++OP->IN_QueuedCount;
+					Next = &OP->IN_Ring[(OP->IN_LowestID + 1) & (PN_OrderedWindow - 1)];
 				}
 				IN_Mutex.unlock();
+				Acks->Received(ChannelID, OperationID, ID, OP->IN_LowestID, FreeWindow(OP));
+				OP->IN_Mutex.unlock();
 				return;
 			}
 
@@ -183,20 +284,22 @@ namespace PeerNet
 			//	(out-of-sequence processing)
 			//	At this point ID must be greater than LowestID
 			//	Which means we have an out-of-sequence ID
-			OP->IN_StoredIDs.emplace(IN_Packet->GetPacketID(), IN_Packet);
-			IN_Mutex.unlock();
+			Slot = IN_Packet;
+			++OP->IN_StoredCount;
+			Acks->Received(ChannelID, OperationID, ID, OP->IN_LowestID, FreeWindow(OP));
+			OP->IN_Mutex.unlock();
 		}
 
 		inline void PrintStats()
 		{
-			auto Operation = Operations.begin();
-			while (Operation != Operations.end())
-			{
-				printf("Ordered Channel (%i) OUT_Packets Size: %zi\n", Operation->first, Operation->second.OUT_Packets.size());
-				printf("Ordered Channel (%i) IN_StoredIDs Size: %zi\n", Operation->first, Operation->second.IN_StoredIDs.size());
-				++Operation;
-			}
-
+			Operations.ForEach([](const unsigned long OP, OrderedOperation& Operation) {
+				Operation.OUT_Mutex.lock();
+				printf("Ordered Channel (%lu) OUT_Packets Size: %zi\n", OP, Operation.OUT_Packets.size());
+				Operation.OUT_Mutex.unlock();
+				Operation.IN_Mutex.lock();
+				printf("Ordered Channel (%lu) IN_Ring Size: %lu\n", OP, Operation.IN_StoredCount);
+				Operation.IN_Mutex.unlock();
+			});
 		}
 	};
 }
\ No newline at end of file
@@ -1,124 +1,212 @@
 #pragma once
 
+#define PN_ReliableWindow 1024	//	Outgoing packets tracked per operation; must be a power of two
+
 namespace PeerNet
 {
 	struct ReliableOperation
 	{
 		//	IN
+		PeerMutex IN_Mutex;
 		std::atomic<unsigned long> IN_LastID = 0;	//	The largest received (and acknowledged) ID so far
 		//	OUT
-		std::atomic<unsigned long> OUT_NextID = 1;	//	Next packet ID we'll use
-		std::atomic<unsigned long> OUT_LastACK = 0;	//	Next packet ID we'll use
-		std::unordered_map<unsigned long, SendPacket*> OUT_Packets;	//	Unacknowledged outgoing packets
+		PeerMutex OUT_Mutex;
+		unsigned long OUT_NextID = 1;	//	Next packet ID we'll use
+		unsigned long OUT_LastACK = 0;	//	Every packet ID up to this one has been acknowledged
+		unsigned long OUT_Tail = 1;		//	Oldest packet ID which may still occupy a slot
+		SendPacket* OUT_Packets[PN_ReliableWindow] = {};	//	Outgoing packets indexed by (ID & (PN_ReliableWindow - 1))
 	};
 	class ReliableChannel
 	{
 		NetAddress*const Address;
 		const PacketType ChannelID;
+		AckTracker*const Acks;
+		RTTEstimator*const Estimator;
+		SendPacer*const Pacer;
 
-		std::mutex IN_Mutex;
-		std::mutex OUT_Mutex;
-		std::deque<SendPacket*> OUT_ACKs;	//	ACKs that need to be deleted
+		OperationTable<ReliableOperation> Operations;
 
-		std::unordered_map<unsigned long, ReliableOperation> Operations;
+		PeerMutex OUT_Mutex;
+		std::deque<SendPacket*> OUT_Retired;	//	Packets pushed out of the window that need to be deleted
 
+		PeerMutex IN_Mutex;
 		std::deque<ReceivePacket*> NeedsProcessed;	//	Packets that need to be processed
 
+		std::atomic<unsigned long long> Stats_Superseded;	//	Unacknowledged packets freed because a newer one went out
+
+		//	Frees every packet older than the newest one that has gone out
+		//	The receiver only processes the newest packet, so resending anything before it is wasted
+		//	Packets still with the pacer or socket are only flagged; they get deleted on a later pass
+		//	Must be called with the operations OUT_Mutex held
+		inline void Supersede(ReliableOperation*const Operation)
+		{
+			unsigned long Newest = 0;
+			for (unsigned long ID = Operation->OUT_NextID; ID-- > Operation->OUT_Tail;)
+			{
+				SendPacket*const Packet = Operation->OUT_Packets[ID & (PN_ReliableWindow - 1)];
+				if (Packet != nullptr && Packet->GetSendCount() > 0) { Newest = ID; break; }
+			}
+			for (unsigned long ID = Operation->OUT_Tail; ID < Newest; ++ID)
+			{
+				SendPacket*& Slot = Operation->OUT_Packets[ID & (PN_ReliableWindow - 1)];
+				if (Slot == nullptr) { continue; }
+				if (Slot->NeedsDelete.exchange(1) == 0) {
+					Pacer->Discarded(Slot);
+					++Stats_Superseded;
+				}
+				if (Slot->IsSending.load() == 1) { continue; }
+				Retire(Slot);
+				Slot = nullptr;
+			}
+			//	Move the tail past every freed slot
+			while (Operation->OUT_Tail < Operation->OUT_NextID && Operation->OUT_Packets[Operation->OUT_Tail & (PN_ReliableWindow - 1)] == nullptr) { ++Operation->OUT_Tail; }
+		}
+
 	public:
-		inline ReliableChannel(NetAddress*const Addr, const PacketType &ChanID)
-			: Address(Addr), ChannelID(ChanID),
-			IN_Mutex(), OUT_Mutex(), NeedsProcessed() {}
+		inline ReliableChannel(NetAddress*const Addr, const PacketType &ChanID, AckTracker*const AckTrack, RTTEstimator*const RTT, SendPacer*const Pace, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack), Estimator(RTT), Pacer(Pace),
+			Operations(Polled), OUT_Mutex(Polled), OUT_Retired(), IN_Mutex(Polled), NeedsProcessed(), Stats_Superseded(0) {}
+
+		inline ~ReliableChannel()
+		{
+			Operations.ForEach([](const unsigned long, ReliableOperation& Operation) {
+				for (auto Packet : Operation.OUT_Packets) { Retire(Packet); }
+			});
+			for (auto Packet : OUT_Retired) { Retire(Packet); }
+			for (auto Packet : NeedsProcessed) { delete Packet; }
+		}
+
+		//	Create the state for an operation before any traffic uses it
+		inline const bool Register(const unsigned long OP) { return Operations.Register(OP); }
+
+		//	Packets of an operation still holding a window slot; never more than PN_ReliableWindow
+		inline const unsigned long Outstanding(const unsigned long OP)
+		{
+			ReliableOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return 0; }
+			Operation->OUT_Mutex.lock();
+			const unsigned long Count = Operation->OUT_NextID - Operation->OUT_Tail;
+			Operation->OUT_Mutex.unlock();
+			return Count;
+		}
 
 		//	Acknowledge all packets up to this ID
+		//	Each packet is only ever visited once, so this is O(1) amortized
 		inline void ACK(const unsigned long& ID, const unsigned long& OP)
 		{
-			if (ID <= Operations[OP].OUT_LastACK.load()) { return; }
+			ReliableOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+#ifdef _PERF_SPINLOCK
+			while (!Operation->OUT_Mutex.try_lock()) {}
+#else
+			Operation->OUT_Mutex.lock();
+#endif
+			if (ID <= Operation->OUT_LastACK || ID >= Operation->OUT_NextID) { Operation->OUT_Mutex.unlock(); return; }
 
-			Operations[OP].OUT_LastACK.store(ID);
-			auto it = Operations[OP].OUT_Packets.begin();
-			while (it != Operations[OP].OUT_Packets.end()) {
-				if (it->first <= ID) {
-					it->second->NeedsDelete.store(1);
-				}
-				++it;
+			//	Only packets sent exactly once give an unambiguous Round-Trip-Time
+			SendPacket*const Newest = Operation->OUT_Packets[ID & (PN_ReliableWindow - 1)];
+			if (Newest != nullptr && Newest->GetPacketID() == ID && Newest->GetSendCount() == 1) {
+				Estimator->Sample(steady_clock::now() - Newest->GetLastSent());
+			}
+			//	Anything older than Tail has already left the window
+			unsigned long Current = (std::max)(Operation->OUT_LastACK + 1, Operation->OUT_Tail);
+			for (; Current <= ID; ++Current)
+			{
+				SendPacket*const Packet = Operation->OUT_Packets[Current & (PN_ReliableWindow - 1)];
+				if (Packet != nullptr && Packet->NeedsDelete.exchange(1) == 0) { Pacer->Acked(Packet); }
 			}
+			Operation->OUT_LastACK = ID;
+			Operation->OUT_Mutex.unlock();
 		}
 
 		//	Initialize and return a new packet for sending
 		inline SendPacket* NewPacket(const unsigned long& OP)
 		{
-			const unsigned long PacketID = Operations[OP].OUT_NextID++;
-			SendPacket* Packet = new SendPacket(PacketID, ChannelID, OP, Address);
-			Packet->WriteData<bool>(false);	//	Not an ACK
+			ReliableOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { printf("Reliable Channel - Unregistered Operation %lu\n", OP); return nullptr; }
 #ifdef _PERF_SPINLOCK
-			while (!OUT_Mutex.try_lock()) {}
+			while (!Operation->OUT_Mutex.try_lock()) {}
 #else
-			OUT_Mutex.lock();
+			Operation->OUT_Mutex.lock();
 #endif
-			Operations[OP].OUT_Packets.emplace(PacketID, Packet);
-			OUT_Mutex.unlock();
+			//	Whatever the last packet replaced can go now rather than waiting for the next tick
+			Supersede(Operation);
+			const unsigned long PacketID = Operation->OUT_NextID++;
+			//	When the window is full the oldest packet gives up its slot
+			//	The receiver only processes the newest packet, so it would never be used anyway
+			if (PacketID - Operation->OUT_Tail >= PN_ReliableWindow)
+			{
+				SendPacket*& Oldest = Operation->OUT_Packets[Operation->OUT_Tail & (PN_ReliableWindow - 1)];
+				if (Oldest != nullptr) {
+					if (Oldest->NeedsDelete.exchange(1) == 0) { Pacer->Discarded(Oldest); }
+					OUT_Mutex.lock();
+					OUT_Retired.push_back(Oldest);
+					OUT_Mutex.unlock();
+					Oldest = nullptr;
+				}
+				++Operation->OUT_Tail;
+			}
+			SendPacket* Packet = new SendPacket(PacketID, ChannelID, OP, Address);
+			Operation->OUT_Packets[PacketID & (PN_ReliableWindow - 1)] = Packet;
+			Operation->OUT_Mutex.unlock();
 			return Packet;
 		}
 
-		inline SendPacket*const NewACK(ReceivePacket* IncomingPacket, NetAddress* Address)
-		{
-			SendPacket* ACK = new SendPacket(IncomingPacket->GetPacketID(), PN_Reliable, IncomingPacket->GetOperationID(), Address, true, IncomingPacket->GetCreationTime());
-			ACK->WriteData<bool>(true);	//	Is an ACK
-			OUT_Mutex.lock();
-			OUT_ACKs.push_back(ACK);
-			OUT_Mutex.unlock();
-			return ACK;
-		}
-
-		//	Resends all unacknowledged packets across a specific NetSocket
-		inline void ResendUnacknowledged(NetSocket* Socket)
+		//	Queues the newest unacknowledged packet of each operation with the pacer once its retransmission timeout expires
+		//	Older unacknowledged packets are superseded by it and freed instead of resent
+		inline void ResendUnacknowledged()
 		{
+			const steady_clock::time_point Now = steady_clock::now();
 			OUT_Mutex.lock();
-			//	Cleanup sent ACKs
-			auto Packet = OUT_ACKs.begin();
-			while (Packet != OUT_ACKs.end())
+			//	Cleanup packets which left the window
+			auto Packet = OUT_Retired.begin();
+			while (Packet != OUT_Retired.end())
 			{
-				if ((*Packet)->NeedsDelete == 1) {
-					delete (*Packet);
-					(*Packet) = NULL;
-					Packet = OUT_ACKs.erase(Packet);
+				if ((*Packet)->IsSending.load() == 0) {
+					Retire(*Packet);
+					Packet = OUT_Retired.erase(Packet);
 				}
 				else {
 					++Packet;
 				}
 			}
+			OUT_Mutex.unlock();
 			//	Resend unacknowledged packets
-			auto Operation = Operations.begin();
-			while (Operation != Operations.end())
-			{
-				auto Packet = Operation->second.OUT_Packets.begin();
-				while (Packet != Operation->second.OUT_Packets.end())
+			Operations.ForEach([&](const unsigned long, ReliableOperation& Operation) {
+				ReliableOperation*const OP = &Operation;
+				OP->OUT_Mutex.lock();
+				Supersede(OP);
+				for (unsigned long ID = OP->OUT_Tail; ID < OP->OUT_NextID; ++ID)
 				{
+					SendPacket*& Slot = OP->OUT_Packets[ID & (PN_ReliableWindow - 1)];
 					//	If we're not currently sending
-					if (Packet->second->IsSending.load() == 0)
+					if (Slot == nullptr || Slot->IsSending.load() == 1) { continue; }
+					//	If this packet needs deleted
+					if (ID <= OP->OUT_LastACK || Slot->NeedsDelete.load() == 1)
 					{
-						//	If this packet needs deleted
-						if (Packet->second->NeedsDelete.load() == 1)
-						{
-							delete Packet->second;
-							Packet = Operation->second.OUT_Packets.erase(Packet);
-							continue;
-						}
-						//	If this packet doesn't need deleted
-						else {
-							//	Flag this packet as sending
-							Packet->second->IsSending.store(1);
-							//	Resend the packet
-							Socket->SendPacket(Packet->second);
-						}
+						Retire(Slot);
+						Slot = nullptr;
+						continue;
 					}
-					//	Move to the next packet
-					++Packet;
+					//	Stop resending packets that expired or were replaced
+					if (Slot->IsObsolete(Now))
+					{
+						Pacer->Obsolete(Slot);
+						Retire(Slot);
+						Slot = nullptr;
+						continue;
+					}
+					//	Give the ACK a chance to arrive
+					if (!Estimator->RetransmitDue(Slot, Now)) { continue; }
+					//	Flag this packet as sending
+					Slot->IsSending.store(1);
+					//	Resend the packet
+					Pacer->Retransmit(Slot, true);
 				}
-				//	Move to the next operation
-				++Operation;
-			}
-			OUT_Mutex.unlock();
+				//	Move the tail past every freed slot
+				while (OP->OUT_Tail < OP->OUT_NextID && OP->OUT_Packets[OP->OUT_Tail & (PN_ReliableWindow - 1)] == nullptr) { ++OP->OUT_Tail; }
+				OP->OUT_Mutex.unlock();
+			});
 		}
 
 		//	Swaps the NeedsProcessed queue with an external empty queue (from another thread)
@@ -132,22 +220,38 @@ namespace PeerNet
 		//	Receives a packet
 		inline void Receive(ReceivePacket*const IN_Packet)
 		{
-			if (IN_Packet->GetPacketID() <= Operations[IN_Packet->GetOperationID()].IN_LastID.load()) { delete IN_Packet; return; }
+			//	IN_Packet may be processed and deleted by another thread once it is queued
+			const unsigned long OperationID = IN_Packet->GetOperationID();
+			const unsigned long ID = IN_Packet->GetPacketID();
+			ReliableOperation*const Operation = Operations.Find(OperationID);
+			if (Operation == nullptr) { delete IN_Packet; return; }
+#ifdef _PERF_SPINLOCK
+			while (!Operation->IN_Mutex.try_lock()) {}
+#else
+			Operation->IN_Mutex.lock();
+#endif
+			if (ID <= Operation->IN_LastID.load()) {
+				//	Let the sender know again so it stops resending
+				Acks->Received(ChannelID, OperationID, ID, Operation->IN_LastID.load());
+				Operation->IN_Mutex.unlock(); delete IN_Packet; return;
+			}
+			Operation->IN_LastID.store(ID);
+			//	Only the newest packet is processed so everything before it counts as received
+			Acks->Received(ChannelID, OperationID, ID, ID);
 			IN_Mutex.lock();
-			Operations[IN_Packet->GetOperationID()].IN_LastID.store(IN_Packet->GetPacketID());
 			NeedsProcessed.push_back(IN_Packet);
 			IN_Mutex.unlock();
+			Operation->IN_Mutex.unlock();
 		}
 
 		inline void PrintStats()
 		{
-			auto Operation = Operations.begin();
-			while (Operation != Operations.end())
-			{
-				printf("Reliable Channel (%i) OUT_Packets Size: %zi\n", Operation->first, Operation->second.OUT_Packets.size());
-				++Operation;
-			}
-
+			Operations.ForEach([](const unsigned long OP, ReliableOperation& Operation) {
+				Operation.OUT_Mutex.lock();
+				printf("Reliable Channel (%lu) OUT_Packets In Flight: %lu\n", OP, Operation.OUT_NextID - Operation.OUT_Tail);
+				Operation.OUT_Mutex.unlock();
+			});
+			printf("Reliable Channel Superseded: %llu\n", Stats_Superseded.load());
 		}
 
 		//	Get the largest received ID so far
@@ -0,0 +1,279 @@
+#pragma once
+
+#define PN_SnapshotHistory 32	//	How many snapshots each operation remembers; must be a power of two
+
+namespace PeerNet
+{
+	//
+	//	Snapshot Delta Encoding
+	//	The new state is XOR'd against a baseline both sides already have
+	//	Runs of unchanged (zero) bytes are then collapsed into a single varint
+	//	Layout: [StateSize] { [ZeroRun] [LiteralRun] [Literal Bytes...] } ...
+	namespace SnapshotDelta
+	{
+		inline void WriteVarInt(string& Out, size_t Value)
+		{
+			while (Value >= 0x80) {
+				Out.push_back((char)(Value | 0x80));
+				Value >>= 7;
+			}
+			Out.push_back((char)Value);
+		}
+
+		//	Returns false if the varint runs past the end of the input
+		inline const bool ReadVarInt(const string& In, size_t& Pos, size_t& Value)
+		{
+			Value = 0;
+			for (unsigned char Shift = 0; Pos < In.size() && Shift < 64; Shift += 7)
+			{
+				const unsigned char Byte = (unsigned char)In[Pos++];
+				Value |= (size_t)(Byte & 0x7F) << Shift;
+				if (!(Byte & 0x80)) { return true; }
+			}
+			return false;
+		}
+
+		//	Bytes beyond the end of the baseline are XOR'd against zero
+		inline const unsigned char XOR(const string& Baseline, const string& State, const size_t Pos)
+		{
+			return (unsigned char)State[Pos] ^ (Pos < Baseline.size() ? (unsigned char)Baseline[Pos] : 0);
+		}
+
+		inline const string Encode(const string& Baseline, const string& State)
+		{
+			string Out;
+			Out.reserve(State.size() / 4 + 8);
+			WriteVarInt(Out, State.size());
+			size_t Pos = 0;
+			while (Pos < State.size())
+			{
+				//	Count the unchanged bytes
+				const size_t ZeroStart = Pos;
+				while (Pos < State.size() && XOR(Baseline, State, Pos) == 0) { ++Pos; }
+				if (Pos == State.size()) { break; }	//	Trailing zeros are implied by StateSize
+				//	Count the changed bytes; tolerate short gaps so we dont fragment into many tiny runs
+				const size_t LiteralStart = Pos;
+				size_t LiteralEnd = Pos;
+				while (Pos < State.size())
+				{
+					if (XOR(Baseline, State, Pos) != 0) { LiteralEnd = ++Pos; continue; }
+					size_t Gap = Pos;
+					while (Gap < State.size() && Gap - Pos < 3 && XOR(Baseline, State, Gap) == 0) { ++Gap; }
+					if (Gap == State.size() || Gap - Pos >= 3) { break; }
+					Pos = Gap;
+				}
+				Pos = LiteralEnd;
+				WriteVarInt(Out, LiteralStart - ZeroStart);
+				WriteVarInt(Out, LiteralEnd - LiteralStart);
+				for (size_t i = LiteralStart; i < LiteralEnd; i++) { Out.push_back((char)XOR(Baseline, State, i)); }
+			}
+			return Out;
+		}
+
+		//	Returns false if the delta is malformed
+		inline const bool Decode(const string& Baseline, const string& Delta, string& State)
+		{
+			size_t Pos = 0;
+			size_t StateSize = 0;
+			if (!ReadVarInt(Delta, Pos, StateSize) || StateSize > PN_MaxPacketSize * 64) { return false; }
+			//	Start from the baseline; every byte not mentioned in the delta is unchanged
+			State.assign(StateSize, 0);
+			std::memcpy(&State[0], Baseline.data(), (std::min)(StateSize, Baseline.size()));
+			size_t Out = 0;
+			while (Pos < Delta.size())
+			{
+				size_t ZeroRun = 0, LiteralRun = 0;
+				if (!ReadVarInt(Delta, Pos, ZeroRun) || !ReadVarInt(Delta, Pos, LiteralRun)) { return false; }
+				//	Compare against what's left instead of adding; runs come off the wire and may be anything up to 2^64
+				if (ZeroRun > StateSize - Out) { return false; }
+				Out += ZeroRun;
+				if (LiteralRun > StateSize - Out || LiteralRun > Delta.size() - Pos) { return false; }
+				for (size_t i = 0; i < LiteralRun; i++, Out++) { State[Out] ^= Delta[Pos++]; }
+			}
+			return true;
+		}
+	}
+
+	struct SnapshotRecord
+	{
+		unsigned long ID = 0;
+		string State;
+	};
+
+	struct SnapshotOperation
+	{
+		//	IN
+		unsigned long IN_LastID = 0;	//	The largest received ID so far
+		SnapshotRecord IN_History[PN_SnapshotHistory];	//	Recently received snapshots, baselines for incoming deltas
+		//	OUT
+		unsigned long OUT_NextID = 1;	//	Next snapshot ID we'll use
+		unsigned long OUT_LastACK = 0;	//	Newest snapshot the remote peer has acknowledged
+		SnapshotRecord OUT_History[PN_SnapshotHistory];	//	Recently sent snapshots, baselines for outgoing deltas
+	};
+
+	class SnapshotChannel
+	{
+		NetAddress*const Address;
+		const PacketType ChannelID;
+		AckTracker*const Acks;
+
+		PeerMutex IN_Mutex;
+		PeerMutex OUT_Mutex;
+		std::deque<SendPacket*> OUT_Packets;	//	Packets that need to be deleted
+
+		OperationTable<SnapshotOperation> Operations;
+
+		std::deque<ReceivePacket*> NeedsProcessed;	//	Packets that need to be processed
+
+		unsigned long long Stats_StateBytes;	//	Bytes of state handed to us
+		unsigned long long Stats_WireBytes;		//	Bytes of state actually written after delta encoding
+
+	public:
+		inline SnapshotChannel(NetAddress*const Addr, const PacketType &ChanID, AckTracker*const AckTrack, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack),
+			IN_Mutex(Polled), OUT_Mutex(Polled), Operations(Polled), NeedsProcessed(),
+			Stats_StateBytes(0), Stats_WireBytes(0) {}
+
+		inline ~SnapshotChannel()
+		{
+			for (auto Packet : OUT_Packets) { Retire(Packet); }
+			for (auto Packet : NeedsProcessed) { delete Packet; }
+		}
+
+		//	Create the state for an operation before any traffic uses it
+		inline const bool Register(const unsigned long OP) { return Operations.Register(OP); }
+
+		//	Initialize and return a new packet for the user to fill with state
+		//	It is not sent as-is; Encode replaces it with a delta against the last acknowledged snapshot
+		inline SendPacket* NewPacket(const unsigned long& OP)
+		{
+			if (Operations.Find(OP) == nullptr) { printf("Snapshot Channel - Unregistered Operation %lu\n", OP); return nullptr; }
+			return new SendPacket(0, ChannelID, OP, Address);
+		}
+
+		//	Consumes a filled snapshot and returns the packet to actually send
+		//	Returns nullptr if its operation was never registered
+		inline SendPacket*const Encode(SendPacket*const UserPacket)
+		{
+			const unsigned long OP = UserPacket->GetOperationID();
+			SnapshotOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { delete UserPacket; return nullptr; }
+			const string State(UserPacket->GetPayload());
+#ifdef _PERF_SPINLOCK
+			while (!OUT_Mutex.try_lock()) {}
+#else
+			OUT_Mutex.lock();
+#endif
+			const unsigned long PacketID = Operation->OUT_NextID++;
+			//	Only delta against a baseline we still remember; anything older gets the full state
+			unsigned long BaselineID = Operation->OUT_LastACK;
+			if (BaselineID == 0 || PacketID - BaselineID >= PN_SnapshotHistory
+				|| Operation->OUT_History[BaselineID & (PN_SnapshotHistory - 1)].ID != BaselineID) {
+				BaselineID = 0;
+			}
+			SendPacket* Packet = new SendPacket(PacketID, ChannelID, OP, Address, true, UserPacket->GetCreationTime());
+			Packet->WriteData<unsigned long>(BaselineID);
+			if (BaselineID == 0) {
+				Packet->WriteData<string>(State);
+				Stats_WireBytes += State.size();
+			}
+			else {
+				const string Delta(SnapshotDelta::Encode(Operation->OUT_History[BaselineID & (PN_SnapshotHistory - 1)].State, State));
+				Packet->WriteData<string>(Delta);
+				Stats_WireBytes += Delta.size();
+			}
+			Stats_StateBytes += State.size();
+			SnapshotRecord& Record = Operation->OUT_History[PacketID & (PN_SnapshotHistory - 1)];
+			Record.ID = PacketID;
+			Record.State = State;
+			OUT_Packets.push_back(Packet);
+			OUT_Mutex.unlock();
+			delete UserPacket;
+			return Packet;
+		}
+
+		//	The remote peer now holds this snapshot and it can be used as a baseline
+		inline void ACK(const unsigned long& ID, const unsigned long& OP)
+		{
+			SnapshotOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { return; }
+			OUT_Mutex.lock();
+			if (ID > Operation->OUT_LastACK && ID < Operation->OUT_NextID) { Operation->OUT_LastACK = ID; }
+			OUT_Mutex.unlock();
+		}
+
+		inline void DeleteUsed()
+		{
+			OUT_Mutex.lock();
+			auto Packet = OUT_Packets.begin();
+			while (Packet != OUT_Packets.end())
+			{
+				if ((*Packet)->NeedsDelete == 1) {
+					Retire(*Packet);
+					Packet = OUT_Packets.erase(Packet);
+				}
+				else {
+					++Packet;
+				}
+			}
+			OUT_Mutex.unlock();
+		}
+
+		//	Swaps the NeedsProcessed queue with an external empty queue (from another thread)
+		inline void SwapProcessingQueue(std::deque<ReceivePacket*> &Queue)
+		{
+			IN_Mutex.lock();
+			NeedsProcessed.swap(Queue);
+			IN_Mutex.unlock();
+		}
+
+		//	Receives a snapshot, rebuilding its state from the baseline it references
+		//	Only snapshots we could rebuild are acknowledged, since the sender will use them as baselines
+		//	IN_Packet is always consumed
+		inline void Receive(ReceivePacket*const IN_Packet)
+		{
+			SnapshotOperation*const Operation = Operations.Find(IN_Packet->GetOperationID());
+			if (Operation == nullptr) { delete IN_Packet; return; }
+			const unsigned long BaselineID = IN_Packet->ReadData<unsigned long>();
+			const string Data(IN_Packet->ReadData<string>());
+#ifdef _PERF_SPINLOCK
+			while (!IN_Mutex.try_lock()) {}
+#else
+			IN_Mutex.lock();
+#endif
+			//	Only the newest snapshot matters
+			if (IN_Packet->GetPacketID() <= Operation->IN_LastID) { IN_Mutex.unlock(); delete IN_Packet; return; }
+
+			SnapshotRecord& Record = Operation->IN_History[IN_Packet->GetPacketID() & (PN_SnapshotHistory - 1)];
+			if (BaselineID == 0) {
+				Record.State = Data;
+			}
+			else {
+				const SnapshotRecord& Baseline = Operation->IN_History[BaselineID & (PN_SnapshotHistory - 1)];
+				string State;
+				if (Baseline.ID != BaselineID || !SnapshotDelta::Decode(Baseline.State, Data, State))
+				{
+#ifdef _DEBUG_PACKETS_SNAPSHOT
+					printf("Snapshot - %d - Missing Baseline %d\n", IN_Packet->GetPacketID(), BaselineID);
+#endif
+					IN_Mutex.unlock(); delete IN_Packet; return;
+				}
+				Record.State.swap(State);
+			}
+			Record.ID = IN_Packet->GetPacketID();
+			Operation->IN_LastID = Record.ID;
+			Acks->Received(ChannelID, IN_Packet->GetOperationID(), Record.ID, 0);
+			//	Hand the user a packet holding the full state, exactly as it was written
+			NeedsProcessed.push_back(new ReceivePacket(Record.ID, ChannelID, IN_Packet->GetOperationID(), IN_Packet->GetCreationTime(), Record.State));
+			IN_Mutex.unlock();
+			delete IN_Packet;
+		}
+
+		inline void PrintStats()
+		{
+			OUT_Mutex.lock();
+			printf("Snapshot Channel State Bytes: %llu Wire Bytes: %llu\n", Stats_StateBytes, Stats_WireBytes);
+			OUT_Mutex.unlock();
+		}
+	};
+}
\ No newline at end of file
@@ -13,24 +13,36 @@ namespace PeerNet
 	{
 		NetAddress*const Address;
 		const PacketType ChannelID;
+		AckTracker*const Acks;
 
-		std::mutex IN_Mutex;
-		std::mutex OUT_Mutex;
+		PeerMutex IN_Mutex;
+		PeerMutex OUT_Mutex;
 		std::deque<SendPacket*> OUT_Packets;	//	Packets that need to be deleted
 
-		std::unordered_map<unsigned long, UnreliableOperation> Operations;
+		OperationTable<UnreliableOperation> Operations;
 
 		std::deque<ReceivePacket*> NeedsProcessed;	//	Packets that need to be processed
 
 	public:
-		inline UnreliableChannel(NetAddress*const Addr, const PacketType ChanID)
-			: Address(Addr), ChannelID(ChanID),
-			IN_Mutex(), NeedsProcessed() {}
+		inline UnreliableChannel(NetAddress*const Addr, const PacketType ChanID, AckTracker*const AckTrack, const bool Polled = false)
+			: Address(Addr), ChannelID(ChanID), Acks(AckTrack),
+			IN_Mutex(Polled), OUT_Mutex(Polled), Operations(Polled), NeedsProcessed() {}
+
+		inline ~UnreliableChannel()
+		{
+			for (auto Packet : OUT_Packets) { Retire(Packet); }
+			for (auto Packet : NeedsProcessed) { delete Packet; }
+		}
+
+		//	Create the state for an operation before any traffic uses it
+		inline const bool Register(const unsigned long OP) { return Operations.Register(OP); }
 
 		//	Initialize and return a new packet for sending
 		inline SendPacket* NewPacket(const unsigned long& OP)
 		{
-			SendPacket* Packet = new SendPacket(Operations[OP].OUT_NextID++, ChannelID, OP, Address, true);
+			UnreliableOperation*const Operation = Operations.Find(OP);
+			if (Operation == nullptr) { printf("Unreliable Channel - Unregistered Operation %lu\n", OP); return nullptr; }
+			SendPacket* Packet = new SendPacket(Operation->OUT_NextID++, ChannelID, OP, Address, true);
 			OUT_Mutex.lock();
 			OUT_Packets.push_back(Packet);
 			OUT_Mutex.unlock();
@@ -44,7 +56,7 @@ namespace PeerNet
 			while (Packet != OUT_Packets.end())
 			{
 				if ((*Packet)->NeedsDelete == 1) {
-					delete (*Packet);
+					Retire(*Packet);
 					Packet = OUT_Packets.erase(Packet);
 				}
 				else {
@@ -65,8 +77,9 @@ namespace PeerNet
 		//	Receives a packet
 		inline void Receive(ReceivePacket*const IN_Packet)
 		{
-			if (IN_Packet->GetPacketID() <= Operations[IN_Packet->GetOperationID()].IN_LastID.load()) { delete IN_Packet; return; }
-			Operations[IN_Packet->GetOperationID()].IN_LastID.store(IN_Packet->GetPacketID());
+			UnreliableOperation*const Operation = Operations.Find(IN_Packet->GetOperationID());
+			if (Operation == nullptr || IN_Packet->GetPacketID() <= Operation->IN_LastID.load()) { delete IN_Packet; return; }
+			Operation->IN_LastID.store(IN_Packet->GetPacketID());
 			IN_Mutex.lock();
 			NeedsProcessed.push_back(IN_Packet);
 			IN_Mutex.unlock();
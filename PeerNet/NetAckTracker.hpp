@@ -0,0 +1,191 @@
+#pragma once
+#include <vector>
+
+#define PN_AckRepeats 3				//	How many outgoing packets carry each change in what we've received
+#define PN_AckMaxEntries 32			//	Most acknowledgements a single packet will carry
+#define PN_AckIdleTimeout 10		//	Milliseconds pending acknowledgements wait for a ride before getting their own packet
+
+namespace PeerNet
+{
+	//	What we've received for a single channel operation
+	struct AckEntry
+	{
+		PacketType Channel;
+		unsigned long OP;
+		unsigned long Cumulative;	//	Every ID up to this one has been received
+		unsigned long Latest;		//	Highest ID received
+		unsigned long long Mask;	//	Bit N set means (Latest - 1 - N) has been received
+		unsigned short Window;		//	IDs past Cumulative we have room for; 0 when the channel has no limit
+		unsigned char Repeats;		//	Outgoing packets left to carry this entry
+	};
+
+	//
+	//	Selective acknowledgements piggybacked onto every packet sent to a peer
+	//	Replaces sending a dedicated ACK packet back for every received packet
+	//	Layout: [Count] { [Channel] [OP] [Cumulative] [Latest] [Mask] [Window] } ...
+	class AckTracker
+	{
+		NetAddress*const Address;
+
+		PeerMutex Mutex;
+		std::vector<AckEntry> Entries;			//	Only a handful of operations are ever active at once; a linear scan beats hashing
+		unsigned long PendingCount;				//	Entries with Repeats left
+		steady_clock::time_point LastWritten;	//	Last time a packet carried our acknowledgements
+
+		PeerMutex OUT_Mutex;
+		std::deque<SendPacket*> OUT_Packets;	//	Dedicated ACK packets that need to be deleted
+
+	public:
+		inline AckTracker(NetAddress*const Addr, const bool Polled = false)
+			: Address(Addr), Mutex(Polled), Entries(), PendingCount(0), LastWritten(steady_clock::now()), OUT_Mutex(Polled), OUT_Packets() {}
+
+		//	Our peer is only destroyed once no socket holds any of these; they still go through the epoch like every other packet
+		inline ~AckTracker()
+		{
+			for (auto Packet : OUT_Packets) { Retire(Packet); }
+		}
+
+		//	Record that a packet was received
+		//	Cumulative is the channels own view of what has been fully received; 0 if it has none
+		//	Window is how far past Cumulative the sender may run; 0 if it may run freely
+		inline void Received(const PacketType Channel, const unsigned long OP, const unsigned long ID, const unsigned long Cumulative, const unsigned short Window = 0)
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			AckEntry* Entry = nullptr;
+			for (auto& Existing : Entries) {
+				if (Existing.Channel == Channel && Existing.OP == OP) { Entry = &Existing; break; }
+			}
+			if (Entry == nullptr) {
+				Entries.push_back({ Channel, OP, 0, 0, 0, 0, 0 });
+				Entry = &Entries.back();
+			}
+			if (ID > Entry->Latest)
+			{
+				const unsigned long Shift = ID - Entry->Latest;
+				//	The old Latest becomes bit (Shift - 1)
+				Entry->Mask = Shift > 64 ? 0 : ((Entry->Mask << 1) | 1) << (Shift - 1);
+				if (Entry->Latest == 0) { Entry->Mask = 0; }
+				Entry->Latest = ID;
+			}
+			else if (ID < Entry->Latest && Entry->Latest - ID <= 64) {
+				Entry->Mask |= 1ull << (Entry->Latest - ID - 1);
+			}
+			if (Cumulative > Entry->Cumulative) { Entry->Cumulative = Cumulative; }
+			Entry->Window = Window;
+			//	Duplicates re-arm the entry too; our earlier acknowledgements were evidently lost
+			if (Entry->Repeats == 0) { ++PendingCount; }
+			Entry->Repeats = PN_AckRepeats;
+			Mutex.unlock();
+		}
+
+		//	Room for an operation freed up without a packet arriving to report it
+		//	Re-arms its entry if the window grew since it was last written, so the sender hears about it
+		inline void Reopened(const PacketType Channel, const unsigned long OP, const unsigned short Window)
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			for (auto& Entry : Entries)
+			{
+				if (Entry.Channel != Channel || Entry.OP != OP || Window <= Entry.Window) { continue; }
+				Entry.Window = Window;
+				if (Entry.Repeats == 0) { ++PendingCount; }
+				Entry.Repeats = PN_AckRepeats;
+				break;
+			}
+			Mutex.unlock();
+		}
+
+		//	Stamp every pending acknowledgement onto an outgoing packet
+		//	Called as the packet is handed to its socket, so retransmissions and paced packets carry what we know now
+		//	Replaces whatever an earlier transmission of the same packet carried
+		inline void Write(SendPacket*const Packet)
+		{
+			stringstream Stream(std::ios::in | std::ios::out | std::ios::binary);
+			PortableBinaryOutputArchive Archive(Stream);
+			//	The archive leads with its own endian marker; the packet header already has one
+			const std::streamoff Start = Stream.tellp();
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			const unsigned char Count = (unsigned char)(std::min)(PendingCount, (unsigned long)PN_AckMaxEntries);
+			Archive(Count);
+			unsigned char Written = 0;
+			for (auto Entry = Entries.begin(); Entry != Entries.end() && Written < Count; ++Entry)
+			{
+				if (Entry->Repeats == 0) { continue; }
+				Archive(Entry->Channel);
+				Archive(Entry->OP);
+				Archive(Entry->Cumulative);
+				Archive(Entry->Latest);
+				Archive(Entry->Mask);
+				Archive(Entry->Window);
+				if (--Entry->Repeats == 0) { --PendingCount; }
+				++Written;
+			}
+			if (Count > 0) { LastWritten = steady_clock::now(); }
+			Mutex.unlock();
+			Packet->SetAcks(Stream.str().substr((size_t)Start));
+		}
+
+		//	Read the acknowledgements carried by an incoming packet
+		//	Must be called immediately after the packet is constructed
+		//	OnACK(Channel, OP, Cumulative, Latest, Mask, Window) is called for each one
+		template <typename Callback>
+		inline static void Read(ReceivePacket*const Packet, Callback OnACK)
+		{
+			unsigned char Count = Packet->ReadData<unsigned char>();
+			while (Count-- > 0)
+			{
+				const PacketType Channel = Packet->ReadData<PacketType>();
+				const unsigned long OP = Packet->ReadData<unsigned long>();
+				const unsigned long Cumulative = Packet->ReadData<unsigned long>();
+				const unsigned long Latest = Packet->ReadData<unsigned long>();
+				const unsigned long long Mask = Packet->ReadData<unsigned long long>();
+				const unsigned short Window = Packet->ReadData<unsigned short>();
+				OnACK(Channel, OP, Cumulative, Latest, Mask, Window);
+			}
+		}
+
+		//	Returns a dedicated ACK packet if acknowledgements have gone unsent for too long
+		//	Returns nullptr when nothing needs to go out
+		//	The acknowledgements themselves are stamped on when it is sent
+		inline SendPacket*const NewIdleACK()
+		{
+			Mutex.lock();
+			const bool Idle = PendingCount > 0 && steady_clock::now() - LastWritten >= milliseconds(PN_AckIdleTimeout);
+			Mutex.unlock();
+			if (!Idle) { return nullptr; }
+			SendPacket*const ACK = new SendPacket(0, PN_ACK, 0, Address, true);
+			OUT_Mutex.lock();
+			OUT_Packets.push_back(ACK);
+			OUT_Mutex.unlock();
+			return ACK;
+		}
+
+		inline void DeleteUsed()
+		{
+			OUT_Mutex.lock();
+			auto Packet = OUT_Packets.begin();
+			while (Packet != OUT_Packets.end())
+			{
+				if ((*Packet)->NeedsDelete == 1) {
+					Retire(*Packet);
+					Packet = OUT_Packets.erase(Packet);
+				}
+				else {
+					++Packet;
+				}
+			}
+			OUT_Mutex.unlock();
+		}
+	};
+}
\ No newline at end of file
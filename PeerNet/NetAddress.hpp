@@ -1,5 +1,7 @@
 #pragma once
 #include <string>
+#include <algorithm>
+#include <atomic>
 #include <deque>
 #include <mutex>
 
@@ -14,8 +16,11 @@ namespace PeerNet
 	{
 		std::string Address;
 		addrinfo* Results = nullptr;
+		SOCKADDR_INET* Memory = nullptr;	//	Our slot in the pool's registered buffer
+		std::atomic<SlotHandle> Handle;		//	Changes every time the pool hands us out again
+		std::atomic<unsigned long> Sending;	//	Packets to us a socket has been handed and not yet let go of
 
-		inline NetAddress() : Address(), RIO_BUF() {}
+		inline NetAddress() : Address(), RIO_BUF(), Handle(0), Sending(0) {}
 
 		//	Resolve initializes the NetAddress from an IP address or hostname along with a port number
 		inline void Resolve(std::string StrHost, std::string StrPort)
@@ -30,85 +35,136 @@ namespace PeerNet
 			//	Resolve the End Hosts addrinfo
 			if (getaddrinfo(StrHost.c_str(), StrPort.c_str(), &Hint, &Results) != 0) { printf("NetAddress GetAddrInfo Failed %i\n", WSAGetLastError()); }
 
-			//	Create our formatted address
-			if (Results->ai_family == AF_INET)
+			if (Results != nullptr) { Format(Results->ai_addr); }
+		}
+
+		//	Initializes the NetAddress straight from the binary address a datagram arrived from
+		//	Needs no name resolution and treats IPv4 and IPv6 alike
+		inline void Assign(const SOCKADDR_INET*const Addr)
+		{
+			std::memcpy(Memory, Addr, sizeof(SOCKADDR_INET));
+			Format((const sockaddr*)Memory);
+		}
+
+		//	Builds the printable IP:Port form; IPv6 addresses are bracketed
+		inline void Format(const sockaddr*const Addr)
+		{
+			char IP[INET6_ADDRSTRLEN] = {};
+			if (Addr->sa_family == AF_INET6)
 			{
-				char*const ResolvedIP = new char[16];
-				inet_ntop(AF_INET, &(((sockaddr_in*)((sockaddr*)Results->ai_addr))->sin_addr), ResolvedIP, 16);
-				Address = std::string(ResolvedIP) + std::string(":") + StrPort;
-				delete[] ResolvedIP;
+				const sockaddr_in6*const In6 = (const sockaddr_in6*)Addr;
+				inet_ntop(AF_INET6, &In6->sin6_addr, IP, sizeof(IP));
+				Address = std::string("[") + IP + std::string("]:") + std::to_string(ntohs(In6->sin6_port));
 			}
 			else {
-				//return &(((struct sockaddr_in6*)sa)->sin6_addr);
+				const sockaddr_in*const In = (const sockaddr_in*)Addr;
+				inet_ntop(AF_INET, &In->sin_addr, IP, sizeof(IP));
+				Address = std::string(IP) + std::string(":") + std::to_string(ntohs(In->sin_port));
 			}
 		}
 
-		inline ~NetAddress() { freeaddrinfo(Results); }
+		//	Forget everything so the pool can hand us out again
+		inline void Reset()
+		{
+			if (Results != nullptr) { freeaddrinfo(Results); Results = nullptr; }
+			Address.clear();
+			if (Memory != nullptr) { ZeroMemory(Memory, sizeof(SOCKADDR_INET)); }
+		}
+
+		inline ~NetAddress() { if (Results != nullptr) { freeaddrinfo(Results); } }
 
 		inline const std::string& GetFormatted() const { return Address; }
 		//get rid of this next one!
 		inline const char*const FormattedAddress() const { return Address.c_str(); }
 		inline const addrinfo*const AddrInfo() const { return Results; }
+		//	Where a peer's packets go; filled in by Assign or AddressPool::WriteAddress
+		inline const sockaddr*const SockAddr() const { return (const sockaddr*)Memory; }
 	};
 
 	//
 	//
 	//	AddressPool
-	//	Manages a pool of addresses in memory
-	//	Supporting a maximum of MaxObjects addresses
+	//	Slab of addresses backed by registered memory, handed out and taken back in O(1)
+	//	Starts with MaxObjects addresses and registers another chunk of as many whenever it runs dry
+	//	Every address carries a generation tagged handle that goes stale once it is released
 	class AddressPool
 	{
+		struct Chunk
+		{
+			NetAddress* Addresses;
+			PCHAR Buffer;
+			RIO_BUFFERID BufferID;
+		};
+
+		RIO_EXTENSION_FUNCTION_TABLE& RIO;
+		const unsigned long ChunkSize;
+		const bool Growable;
 		std::mutex AddrMutex;
-		std::deque<NetAddress*> UsedAddr;
-		std::deque<NetAddress*> UnusedAddr;
-		RIO_BUFFERID Addr_BufferID;
-		PCHAR Addr_Buffer;
+		std::atomic<Chunk*> Chunks[PN_SlabChunks];
+		unsigned long ChunkCount;
+		std::deque<NetAddress*> UnusedAddr;	//	Reused first in first out so a released handle stays stale as long as possible
 
-	public:
-
-		inline AddressPool(RIO_EXTENSION_FUNCTION_TABLE &RIO, size_t MaxObjects) :
-			AddrMutex(), Addr_BufferID(), Addr_Buffer(new char[MaxObjects * sizeof(SOCKADDR_INET)]), UsedAddr(), UnusedAddr()
+		//	Must be called with AddrMutex held
+		inline const bool Grow()
 		{
-			//	Initialize Address Memory Buffer
-			printf("Address Buffer: ");
-			Addr_BufferID = RIO.RIORegisterBuffer(Addr_Buffer, (DWORD)(sizeof(SOCKADDR_INET)*MaxObjects));
-			if (Addr_BufferID == RIO_INVALID_BUFFERID)
+			if (ChunkCount == PN_SlabChunks || (ChunkCount + 1) * ChunkSize > (1ul << PN_HandleIndexBits)) { return false; }
+			Chunk*const NewChunk = new Chunk{ new NetAddress[ChunkSize], new char[ChunkSize * sizeof(SOCKADDR_INET)], RIO_INVALID_BUFFERID };
+			ZeroMemory(NewChunk->Buffer, ChunkSize * sizeof(SOCKADDR_INET));
+			NewChunk->BufferID = RIO.RIORegisterBuffer(NewChunk->Buffer, (DWORD)(sizeof(SOCKADDR_INET)*ChunkSize));
+			if (NewChunk->BufferID == RIO_INVALID_BUFFERID)
 			{
-				printf("Invalid Memory BufferID\n");
+				printf("Address Buffer: Invalid Memory BufferID\n");
+				delete[] NewChunk->Addresses;
+				delete[] NewChunk->Buffer;
+				delete NewChunk;
+				return false;
 			}
-			else {
-				for (ULONG i = 0, AddressOffset = 0; i < MaxObjects; i++)
-				{
-					NetAddress*const Address = new NetAddress();
-					Address->BufferId = Addr_BufferID;
-					Address->Offset = AddressOffset;
-					Address->Length = sizeof(SOCKADDR_INET);
-					UnusedAddr.push_front(Address);
-
-					AddressOffset += sizeof(SOCKADDR_INET);
-				}
-				printf("%zu\n", UnusedAddr.size());
+			for (unsigned long i = 0; i < ChunkSize; i++)
+			{
+				NetAddress*const Address = &NewChunk->Addresses[i];
+				Address->BufferId = NewChunk->BufferID;
+				Address->Offset = i * sizeof(SOCKADDR_INET);
+				Address->Length = sizeof(SOCKADDR_INET);
+				Address->Memory = (SOCKADDR_INET*)&NewChunk->Buffer[Address->Offset];
+				Address->Handle.store(MakeHandle(ChunkCount * ChunkSize + i, 1));
+				UnusedAddr.push_back(Address);
 			}
+			Chunks[ChunkCount].store(NewChunk);
+			++ChunkCount;
+			printf("Address Buffer: %lu\n", ChunkCount * ChunkSize);
+			return true;
+		}
+
+	public:
+
+		inline AddressPool(RIO_EXTENSION_FUNCTION_TABLE &RIOTable, size_t MaxObjects, const bool Grows = true) :
+			RIO(RIOTable), ChunkSize((std::max)((unsigned long)MaxObjects, 1ul)), Growable(Grows), AddrMutex(), Chunks(), ChunkCount(0), UnusedAddr()
+		{
+			for (auto& C : Chunks) { C.store(nullptr); }
+			Grow();
 		}
 
 		inline ~AddressPool()
 		{
-			delete[] Addr_Buffer;
-			while (!UnusedAddr.empty())
+			for (auto& C : Chunks)
 			{
-				NetAddress* Addr = UnusedAddr.front();
-				delete Addr;
-				UnusedAddr.pop_front();
+				Chunk*const Used = C.load();
+				if (Used == nullptr) { continue; }
+				RIO.RIODeregisterBuffer(Used->BufferID);
+				delete[] Used->Addresses;
+				delete[] Used->Buffer;
+				delete Used;
 			}
 		}
 
 		//	Must be called after ->Resolve to write the resolved data to the address buffer
 		inline void WriteAddress(NetAddress*const Addr)
 		{
-			std::memcpy(&Addr_Buffer[(size_t)Addr->Offset], Addr->AddrInfo()->ai_addr, sizeof(sockaddr));
+			std::memcpy(Addr->Memory, Addr->AddrInfo()->ai_addr, (std::min)((size_t)Addr->AddrInfo()->ai_addrlen, sizeof(SOCKADDR_INET)));
 		}
 
 		//	Returns a free and empty address
+		//	Returns nullptr only if the pool is full and may not grow
 		inline NetAddress*const FreeAddress()
 		{
 #ifdef _PERF_SPINLOCK
@@ -116,11 +172,10 @@ namespace PeerNet
 #else
 			AddrMutex.lock();
 #endif
-			if (UnusedAddr.empty()) { AddrMutex.unlock(); return nullptr; }
+			if (UnusedAddr.empty() && (!Growable || !Grow())) { AddrMutex.unlock(); printf("Address Pool Exhausted\n"); return nullptr; }
 
-			NetAddress*const NewAddress = UnusedAddr.back();
-			UsedAddr.push_front(UnusedAddr.back());
-			UnusedAddr.pop_back();
+			NetAddress*const NewAddress = UnusedAddr.front();
+			UnusedAddr.pop_front();
 			AddrMutex.unlock();
 			return NewAddress;
 		}
@@ -128,19 +183,36 @@ namespace PeerNet
 		//	Returns a free address from an existing SOCKADDR_INET
 		inline NetAddress*const FreeAddress(SOCKADDR_INET*const AddrBuff)
 		{
+			NetAddress*const NewAddress = FreeAddress();
+			if (NewAddress != nullptr) { std::memcpy(NewAddress->Memory, AddrBuff, sizeof(SOCKADDR_INET)); }
+			return NewAddress;
+		}
+
+		//	Hands an address back; every copy of its handle is stale afterwards
+		inline void ReleaseAddress(NetAddress*const Addr)
+		{
+			if (Addr == nullptr) { return; }
+			Addr->Reset();
 #ifdef _PERF_SPINLOCK
 			while (!AddrMutex.try_lock()) {}
 #else
 			AddrMutex.lock();
 #endif
-			if (UnusedAddr.empty()) { AddrMutex.unlock(); return nullptr; }
-
-			NetAddress*const NewAddress = UnusedAddr.back();
-			UsedAddr.push_front(UnusedAddr.back());
-			UnusedAddr.pop_back();
+			const SlotHandle Handle = Addr->Handle.load();
+			Addr->Handle.store(MakeHandle(HandleIndex(Handle), NextGeneration(Handle >> PN_HandleIndexBits)));
+			UnusedAddr.push_back(Addr);
 			AddrMutex.unlock();
-			std::memcpy(&Addr_Buffer[(size_t)NewAddress->Offset], AddrBuff, sizeof(SOCKADDR_INET));
-			return NewAddress;
+		}
+
+		//	Returns nullptr if Handle is stale
+		inline NetAddress*const GetAddress(const SlotHandle Handle) const
+		{
+			const unsigned long Index = HandleIndex(Handle);
+			if (Index / ChunkSize >= PN_SlabChunks) { return nullptr; }
+			Chunk*const Owner = Chunks[Index / ChunkSize].load();
+			if (Owner == nullptr) { return nullptr; }
+			NetAddress*const Addr = &Owner->Addresses[Index % ChunkSize];
+			return Addr->Handle.load() == Handle ? Addr : nullptr;
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,341 @@
+#pragma once
+//	Coroutines need C++20; older builds simply go without these
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L) || __cplusplus >= 202002L
+#define PN_Coroutines
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <atomic>
+
+#define PN_FrameClasses 32	//	Coroutine frames up to PN_FrameClasses * 64 bytes are recycled instead of freed
+
+namespace PeerNet
+{
+	//
+	//	Frame Pool
+	//	Recycles coroutine frames by 64 byte size class so long running sessions stop touching the global heap
+	//	Frames bigger than the largest class go straight to operator new
+	class FramePool
+	{
+		struct FreeFrame { FreeFrame* Next; };
+		struct SizeClass
+		{
+			std::mutex Mutex;
+			FreeFrame* Free = nullptr;
+		};
+		SizeClass Classes[PN_FrameClasses];
+
+		inline static const size_t ClassOf(const size_t Size) { return (Size + 63) / 64 - 1; }
+
+	public:
+		inline ~FramePool()
+		{
+			for (auto& Class : Classes)
+			{
+				while (Class.Free != nullptr)
+				{
+					FreeFrame*const Frame = Class.Free;
+					Class.Free = Frame->Next;
+					::operator delete(Frame);
+				}
+			}
+		}
+
+		//	Every NetTask shares this one
+		inline static FramePool& Instance()
+		{
+			static FramePool Pool;
+			return Pool;
+		}
+
+		inline void* Allocate(const size_t Size)
+		{
+			const size_t Index = ClassOf(Size);
+			if (Index >= PN_FrameClasses) { return ::operator new(Size); }
+			SizeClass& Class = Classes[Index];
+			Class.Mutex.lock();
+			FreeFrame*const Frame = Class.Free;
+			if (Frame != nullptr) { Class.Free = Frame->Next; }
+			Class.Mutex.unlock();
+			return Frame != nullptr ? (void*)Frame : ::operator new((Index + 1) * 64);
+		}
+
+		inline void Release(void*const Memory, const size_t Size)
+		{
+			const size_t Index = ClassOf(Size);
+			if (Index >= PN_FrameClasses) { ::operator delete(Memory); return; }
+			SizeClass& Class = Classes[Index];
+			FreeFrame*const Frame = static_cast<FreeFrame*>(Memory);
+			Class.Mutex.lock();
+			Frame->Next = Class.Free;
+			Class.Free = Frame;
+			Class.Mutex.unlock();
+		}
+	};
+
+	//	Return type for a coroutine that runs on its own once called
+	//	Nothing waits on it; its frame comes from the FramePool and goes back there when it finishes
+	struct NetTask
+	{
+		struct promise_type
+		{
+			inline NetTask get_return_object() noexcept { return {}; }
+			inline std::suspend_never initial_suspend() noexcept { return {}; }
+			inline std::suspend_never final_suspend() noexcept { return {}; }
+			inline void return_void() noexcept {}
+			inline void unhandled_exception() noexcept { std::terminate(); }
+
+			inline static void* operator new(const size_t Size) { return FramePool::Instance().Allocate(Size); }
+			inline static void operator delete(void*const Frame, const size_t Size) { FramePool::Instance().Release(Frame, Size); }
+		};
+	};
+
+	class AwaiterList;
+
+	//	How a co_await on a peer ended
+	enum AwaitStatus : unsigned char
+	{
+		Await_Packet = 0,		//	The packet we waited for arrived
+		Await_Confirmed = 1,	//	Our packet was acknowledged
+		Await_Timeout = 2,		//	The timeout passed first
+		Await_Closed = 3,		//	The peer went away
+		Await_Invalid = 4		//	There was nothing to wait on; no packet, or one that is never acknowledged on its own
+	};
+
+	//	What co_await gives for an incoming packet
+	//	Packet is nullptr unless Status is Await_Packet, and then belongs to the coroutine which must delete it
+	struct ReceiveResult
+	{
+		AwaitStatus Status;
+		ReceivePacket* Packet;
+	};
+
+	//	Something a coroutine is waiting on a peer for
+	//	It lives in the waiting coroutine's frame and links into its peer's AwaiterList, so waiting never allocates
+	struct PeerAwaiter
+	{
+		AwaiterList*const List;
+		PeerAwaiter* Next = nullptr;
+		std::coroutine_handle<> Handle;
+		const PacketType Channel;
+		const unsigned long OP;
+		const steady_clock::time_point Deadline;
+		const unsigned long RequestID;	//	Only a response carrying this ID is ours; 0 takes any packet of the operation
+		SendPacket* Outgoing;	//	Sent once we're waiting, so its answer can't beat us to the list
+		bool Ready = false;		//	Already resolved; don't suspend at all
+		bool Confirms = false;	//	Waiting on an acknowledgement rather than a packet
+		AwaitStatus Status = Await_Invalid;	//	Set by whoever resolves us, before we're queued to resume
+
+		inline PeerAwaiter(AwaiterList*const Waiters, const PacketType Chan, const unsigned long OperationID,
+			const steady_clock::duration& Timeout, SendPacket*const Out, const unsigned long Request = 0)
+			: List(Waiters), Handle(), Channel(Chan), OP(OperationID),
+			Deadline(Timeout.count() > 0 ? steady_clock::now() + Timeout : steady_clock::time_point::max()), RequestID(Request), Outgoing(Out) {}
+
+		//	Nothing may touch us after this, the coroutine may already be past its co_await
+		inline void Resume() { Handle.resume(); }
+
+		inline bool await_ready() const noexcept { return Ready; }
+		inline void await_suspend(std::coroutine_handle<> Coroutine);
+	};
+
+	//	co_await gives the next packet of an operation, or why there isn't one
+	struct ReceiveAwaiter : public PeerAwaiter
+	{
+		ReceivePacket* Packet = nullptr;
+
+		inline ReceiveAwaiter(AwaiterList*const Waiters, const PacketType Chan, const unsigned long OperationID,
+			const steady_clock::duration& Timeout, SendPacket*const Request = nullptr, const unsigned long RequestID = 0)
+			: PeerAwaiter(Waiters, Chan, OperationID, Timeout, Request, RequestID) {}
+
+		inline ReceiveResult await_resume() noexcept { return { Status, Packet }; }
+	};
+
+	//	co_await gives Await_Confirmed once the packet is acknowledged, or why it wasn't
+	//	A null Packet resolves to Await_Invalid straight away
+	struct ConfirmAwaiter : public PeerAwaiter
+	{
+		const unsigned long PacketID;
+
+		inline ConfirmAwaiter(AwaiterList*const Waiters, SendPacket*const Packet, const steady_clock::duration& Timeout)
+			: PeerAwaiter(Waiters, Packet != nullptr ? Packet->GetType() : PN_NotInialized, Packet != nullptr ? Packet->GetOperationID() : 0, Timeout, Packet),
+			PacketID(Packet != nullptr ? Packet->GetPacketID() : 0)
+		{
+			Ready = Packet == nullptr;
+			Confirms = true;
+		}
+
+		inline AwaitStatus await_resume() noexcept { return Status; }
+	};
+
+	//
+	//	Awaiter List
+	//	Every coroutine currently waiting on one peer
+	//	Receives are matched first come first served per operation, except that a Call only takes the response to its own request
+	//	Whatever thread resolves an awaiter only queues it; the peer resumes them all from its tick, see ResumeReady
+	class AwaiterList
+	{
+		NetPeerBase*const Owner;
+
+		std::mutex Mutex;
+		PeerAwaiter* Receiving = nullptr;
+		PeerAwaiter* Confirming = nullptr;
+		PeerAwaiter* Ready = nullptr;		//	Resolved and waiting for ResumeReady, in the order they were resolved
+		PeerAwaiter** ReadyTail = &Ready;
+		std::atomic<unsigned long> Waiting;	//	Listed or ready; lets the hot path skip the mutex when there are none
+		std::atomic<unsigned long> Requests;	//	Last request ID handed out
+
+		inline static void Append(PeerAwaiter*& Head, PeerAwaiter*const Awaiter)
+		{
+			PeerAwaiter** Tail = &Head;
+			while (*Tail != nullptr) { Tail = &(*Tail)->Next; }
+			*Tail = Awaiter;
+		}
+
+		//	Move every awaiter Matches() accepts from List onto the ready list with Status; Mutex must be held
+		//	Returns the last one moved
+		template <typename Predicate>
+		inline PeerAwaiter* Extract(PeerAwaiter*& List, const AwaitStatus Status, Predicate Matches, const bool First = false)
+		{
+			PeerAwaiter* Moved = nullptr;
+			PeerAwaiter** Link = &List;
+			while (*Link != nullptr)
+			{
+				PeerAwaiter*const Awaiter = *Link;
+				if (!Matches(Awaiter)) { Link = &Awaiter->Next; continue; }
+				*Link = Awaiter->Next;
+				Awaiter->Next = nullptr;
+				Awaiter->Status = Status;
+				*ReadyTail = Awaiter;
+				ReadyTail = &Awaiter->Next;
+				Moved = Awaiter;
+				if (First) { break; }
+			}
+			return Moved;
+		}
+
+		inline static void ResumeAll(PeerAwaiter* Resolved)
+		{
+			while (Resolved != nullptr)
+			{
+				PeerAwaiter*const Next = Resolved->Next;
+				Resolved->Resume();
+				Resolved = Next;
+			}
+		}
+
+	public:
+		inline AwaiterList(NetPeerBase*const Peer) : Owner(Peer), Mutex(), Waiting(0), Requests(0) {}
+
+		inline void Wait(PeerAwaiter*const Awaiter)
+		{
+			Mutex.lock();
+			Append(Awaiter->Confirms ? Confirming : Receiving, Awaiter);
+			++Waiting;
+			Mutex.unlock();
+		}
+
+		//	Defined once NetPeerBase is complete
+		inline void Send(SendPacket*const Packet);
+
+		//	A fresh ID for a request; never 0
+		inline const unsigned long NextRequestID()
+		{
+			unsigned long ID = ++Requests;
+			while (ID == 0) { ID = ++Requests; }
+			return ID;
+		}
+
+		//	Hands a packet to the oldest coroutine waiting on its operation
+		//	Calls only take a packet that starts with their request ID, which is read off before they see it
+		//	Returns false, keeping the packet, if there isn't one
+		inline const bool Take(ReceivePacket*const Packet)
+		{
+			if (Waiting.load() == 0) { return false; }
+			//	Read at most once, and only if a Call is waiting on this operation
+			bool Peeked = false;
+			unsigned long ID = 0;
+			Mutex.lock();
+			PeerAwaiter*const Taker = Extract(Receiving, Await_Packet, [&](PeerAwaiter*const Awaiter) {
+				if (Awaiter->Channel != Packet->GetType() || Awaiter->OP != Packet->GetOperationID()) { return false; }
+				if (Awaiter->RequestID == 0) { return true; }
+				if (!Peeked) {
+					Peeked = true;
+					if (Packet->GetRemaining() >= sizeof(unsigned long)) { ID = Packet->PeekData<unsigned long>(); }
+				}
+				return ID == Awaiter->RequestID;
+			}, true);
+			if (Taker != nullptr) {
+				if (Taker->RequestID != 0) { Packet->ReadData<unsigned long>(); }
+				static_cast<ReceiveAwaiter*>(Taker)->Packet = Packet;
+			}
+			Mutex.unlock();
+			return Taker != nullptr;
+		}
+
+		//	Resolves every coroutine whose packet an acknowledgement covers
+		inline void Confirm(const PacketType Channel, const unsigned long OP,
+			const unsigned long Cumulative, const unsigned long Latest, const unsigned long long Mask)
+		{
+			if (Waiting.load() == 0) { return; }
+			Mutex.lock();
+			Extract(Confirming, Await_Confirmed, [&](PeerAwaiter*const Awaiter) {
+				const unsigned long ID = static_cast<ConfirmAwaiter*>(Awaiter)->PacketID;
+				return Awaiter->Channel == Channel && Awaiter->OP == OP
+					&& (ID <= Cumulative || ID == Latest || (ID < Latest && Latest - ID <= 64 && (Mask & (1ull << (Latest - 1 - ID)))));
+			});
+			Mutex.unlock();
+		}
+
+		//	Gives up on every coroutine whose timeout has passed
+		//	Called every tick, so timeouts are only as precise as the tick interval
+		inline void Expire(const steady_clock::time_point& Now)
+		{
+			if (Waiting.load() == 0) { return; }
+			Mutex.lock();
+			const auto Expired = [&](PeerAwaiter*const Awaiter) { return Awaiter->Deadline <= Now; };
+			Extract(Receiving, Await_Timeout, Expired);
+			Extract(Confirming, Await_Timeout, Expired);
+			Mutex.unlock();
+		}
+
+		//	Resumes every coroutine resolved since the last call, in the order they were resolved
+		//	The peer calls this once per tick while holding the lock Receive() is called under,
+		//	so its coroutines never run alongside each other, its Receive() or ReceiveBatch(), or its Tick()
+		//	Anything they resolve while running is resumed next tick
+		inline void ResumeReady()
+		{
+			if (Waiting.load() == 0) { return; }
+			Mutex.lock();
+			PeerAwaiter*const Resolved = Ready;
+			unsigned long Count = 0;
+			for (PeerAwaiter* Awaiter = Resolved; Awaiter != nullptr; Awaiter = Awaiter->Next) { ++Count; }
+			Ready = nullptr;
+			ReadyTail = &Ready;
+			Waiting -= Count;
+			Mutex.unlock();
+			ResumeAll(Resolved);
+		}
+
+		//	Gives up on everything and resumes it straight away, along with whatever was already resolved; the peer is going away
+		inline void Cancel()
+		{
+			Mutex.lock();
+			const auto All = [](PeerAwaiter*const) { return true; };
+			Extract(Receiving, Await_Closed, All);
+			Extract(Confirming, Await_Closed, All);
+			Mutex.unlock();
+			ResumeReady();
+		}
+	};
+
+	inline void PeerAwaiter::await_suspend(std::coroutine_handle<> Coroutine)
+	{
+		Handle = Coroutine;
+		//	Once listed we may be resumed on another thread at any moment
+		AwaiterList*const Waiters = List;
+		SendPacket*const Out = Outgoing;
+		Waiters->Wait(this);
+		if (Out != nullptr) { Waiters->Send(Out); }
+	}
+}
+#endif
\ No newline at end of file
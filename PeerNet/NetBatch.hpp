@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#define PN_ArenaBlockSize 65536	//	Bytes each arena block holds; bigger payloads get a block of their own
+
+namespace PeerNet
+{
+	//
+	//	Packet Arena
+	//	Bump allocator for one tick's worth of received payloads
+	//	Everything is released at once by Reset; the blocks are kept for the next tick
+	class PacketArena
+	{
+		std::vector<std::unique_ptr<char[]>> Blocks;
+		std::vector<size_t> Sizes;
+		size_t Current;	//	Block being filled
+		size_t Used;	//	Bytes used in it
+
+	public:
+		inline PacketArena() : Blocks(), Sizes(), Current(0), Used(0) {}
+
+		inline char*const Allocate(const size_t Size)
+		{
+			while (Current < Blocks.size() && Used + Size > Sizes[Current]) { ++Current; Used = 0; }
+			if (Current == Blocks.size()) {
+				const size_t BlockSize = (std::max)((size_t)PN_ArenaBlockSize, Size);
+				Blocks.emplace_back(new char[BlockSize]);
+				Sizes.push_back(BlockSize);
+				Used = 0;
+			}
+			char*const Memory = Blocks[Current].get() + Used;
+			Used += Size;
+			return Memory;
+		}
+
+		//	Everything handed out so far is invalid after this
+		inline void Reset()
+		{
+			Current = 0;
+			Used = 0;
+		}
+	};
+
+	//	A received packet whose payload lives in a PacketArena
+	//	Only valid during the ReceiveBatch call it was handed to
+	struct PacketView
+	{
+		PacketType Channel;
+		unsigned long OperationID;
+		unsigned long PacketID;
+		steady_clock::time_point CreationTime;
+		const char* Data;	//	Unread payload, exactly as written with WriteData
+		size_t Size;
+
+		//	Reads the next value at Offset and moves Offset past it
+		//	Mirrors WriteData for arithmetic types on little endian hosts; bit packed data needs a ReceivePacket
+		template <typename T> inline T Read(size_t& Offset) const
+		{
+			static_assert(std::is_arithmetic<T>::value, "PacketView only reads arithmetic types");
+			T Value = T();
+			if (Offset + sizeof(T) <= Size) { std::memcpy(&Value, Data + Offset, sizeof(T)); }
+			Offset += sizeof(T);
+			return Value;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+#include <cmath>
+#include <streambuf>
+
+namespace PeerNet
+{
+	//	Number of bits needed to hold every value from 0 to Range
+	inline const unsigned char BitsRequired(unsigned long Range)
+	{
+		unsigned char Bits = 0;
+		while (Range) { ++Bits; Range >>= 1; }
+		return Bits;
+	}
+
+	//	Maps a float inside [Min, Max] onto an integer of Bits width
+	inline const unsigned long Quantize(float Value, const float Min, const float Max, const unsigned char Bits)
+	{
+		const double Steps = (double)((1ull << Bits) - 1);
+		if (Value < Min) { Value = Min; }
+		if (Value > Max) { Value = Max; }
+		return (unsigned long)(((double)Value - Min) / ((double)Max - Min) * Steps + 0.5);
+	}
+
+	//	Maps an integer of Bits width back onto a float inside [Min, Max]
+	inline const float Dequantize(const unsigned long Value, const float Min, const float Max, const unsigned char Bits)
+	{
+		const double Steps = (double)((1ull << Bits) - 1);
+		return (float)(Min + (double)Value / Steps * ((double)Max - Min));
+	}
+
+	//	The three smallest components of a unit quaternion always fall inside +-1/sqrt(2)
+	static const float SmallestThreeLimit = 0.707107f;
+
+	//
+	//	Packs values of arbitrary bit width into whole bytes
+	//	Bits gather in a 64bit scratch word and are handed to the stream 32 at a time
+	class BitWriter
+	{
+		unsigned long long Scratch;
+		unsigned char ScratchBits;
+
+	public:
+		inline BitWriter() : Scratch(0), ScratchBits(0) {}
+
+		//	Write the low Bits (1-32) of Value
+		inline void Write(std::streambuf*const Stream, const unsigned long Value, const unsigned char Bits)
+		{
+			Scratch |= ((unsigned long long)Value & ((1ull << Bits) - 1)) << ScratchBits;
+			ScratchBits += Bits;
+			if (ScratchBits >= 32)
+			{
+				const char Word[4] = { (char)Scratch, (char)(Scratch >> 8), (char)(Scratch >> 16), (char)(Scratch >> 24) };
+				Stream->sputn(Word, 4);
+				Scratch >>= 32;
+				ScratchBits -= 32;
+			}
+		}
+
+		//	Write any partially filled bytes, padding the last one with zeros
+		inline void Flush(std::streambuf*const Stream)
+		{
+			while (ScratchBits > 0)
+			{
+				Stream->sputc((char)Scratch);
+				Scratch >>= 8;
+				ScratchBits = ScratchBits > 8 ? ScratchBits - 8 : 0;
+			}
+			Scratch = 0;
+		}
+
+		inline const bool Pending() const { return ScratchBits > 0; }
+	};
+
+	//
+	//	Unpacks values written by a BitWriter
+	//	Only pulls as many bytes from the stream as the requested bits need
+	//	so regular archive data following the bits is left untouched
+	class BitReader
+	{
+		unsigned long long Scratch;
+		unsigned char ScratchBits;
+
+	public:
+		inline BitReader() : Scratch(0), ScratchBits(0) {}
+
+		//	Read Bits (1-32) into the low bits of the result
+		inline const unsigned long Read(std::streambuf*const Stream, const unsigned char Bits)
+		{
+			while (ScratchBits < Bits)
+			{
+				const auto Byte = Stream->sbumpc();
+				Scratch |= (unsigned long long)(Byte == std::char_traits<char>::eof() ? 0 : (unsigned char)Byte) << ScratchBits;
+				ScratchBits += 8;
+			}
+			const unsigned long Value = (unsigned long)(Scratch & ((1ull << Bits) - 1));
+			Scratch >>= Bits;
+			ScratchBits -= Bits;
+			return Value;
+		}
+
+		//	Throw away the padding bits left in the last byte
+		inline void Align() { Scratch = 0; ScratchBits = 0; }
+	};
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+#include <deque>
+
+namespace PeerNet
+{
+	//	Everything a channel may need from its peer
+	struct ChannelContext
+	{
+		NetAddress*const Address;
+		AckTracker*const Acks;
+		RTTEstimator*const Estimator;
+		SendPacer*const Pacer;
+		const bool Polled;	//	Only the thread calling PeerNet::Poll touches the peer, so its locks are switched off
+	};
+
+	//	Stores one channel inline and knows which PacketType it carries and how to construct it
+	template <typename Channel> struct ChannelSlot;
+
+	template <> struct ChannelSlot<UnreliableChannel>
+	{
+		static const PacketType Type = PN_Unreliable;
+		UnreliableChannel Channel;
+		inline ChannelSlot(const ChannelContext& Context) : Channel(Context.Address, PN_Unreliable, Context.Acks, Context.Polled) {}
+	};
+	template <> struct ChannelSlot<ReliableChannel>
+	{
+		static const PacketType Type = PN_Reliable;
+		ReliableChannel Channel;
+		inline ChannelSlot(const ChannelContext& Context) : Channel(Context.Address, PN_Reliable, Context.Acks, Context.Estimator, Context.Pacer, Context.Polled) {}
+	};
+	template <> struct ChannelSlot<OrderedChannel>
+	{
+		static const PacketType Type = PN_Ordered;
+		OrderedChannel Channel;
+		inline ChannelSlot(const ChannelContext& Context) : Channel(Context.Address, PN_Ordered, Context.Acks, Context.Estimator, Context.Pacer, Context.Polled) {}
+	};
+	template <> struct ChannelSlot<SnapshotChannel>
+	{
+		static const PacketType Type = PN_Snapshot;
+		SnapshotChannel Channel;
+		inline ChannelSlot(const ChannelContext& Context) : Channel(Context.Address, PN_Snapshot, Context.Acks, Context.Polled) {}
+	};
+	template <> struct ChannelSlot<FECChannel>
+	{
+		static const PacketType Type = PN_FEC;
+		FECChannel Channel;
+		inline ChannelSlot(const ChannelContext& Context) : Channel(Context.Address, PN_FEC, Context.Acks, Context.Polled) {}
+	};
+	template <> struct ChannelSlot<KeyedChannel>
+	{
+		static const PacketType Type = PN_Keyed;
+		KeyedChannel Channel;
+		inline ChannelSlot(const ChannelContext& Context) : Channel(Context.Address, PN_Keyed, Context.Acks, Context.Estimator, Context.Polled) {}
+	};
+
+	//
+	//	Channel Table
+	//	Composes a set of data channels at compile time and stores them inline, in the order given
+	//	A channel left out of the set takes no memory and has no entry to branch on
+	//	Incoming packets reach their channel through a jump table indexed by PacketType
+	template <typename... Channels>
+	class ChannelTable : private ChannelSlot<Channels>...
+	{
+		typedef void(*Receiver)(ChannelTable*const, ReceivePacket*const);
+		typedef void(*Swapper)(ChannelTable*const, std::deque<ReceivePacket*>&);
+
+		template <typename Channel>
+		inline static void ReceiveInto(ChannelTable*const Table, ReceivePacket*const Packet) { Table->template Get<Channel>()->Receive(Packet); }
+		template <typename Channel>
+		inline static void SwapFrom(ChannelTable*const Table, std::deque<ReceivePacket*>& Queue) { Table->template Get<Channel>()->SwapProcessingQueue(Queue); }
+
+		//	Built once per channel set; PacketTypes without a channel stay null
+		struct JumpTable
+		{
+			Receiver Receivers[PN_Keyed + 1];
+			Swapper Swappers[PN_Keyed + 1];
+
+			inline JumpTable() : Receivers(), Swappers()
+			{
+				const int Fill[] = { 0, (Receivers[ChannelSlot<Channels>::Type] = &ReceiveInto<Channels>, Swappers[ChannelSlot<Channels>::Type] = &SwapFrom<Channels>, 0)... };
+				(void)Fill;
+			}
+		};
+		inline static const JumpTable& Jumps()
+		{
+			static const JumpTable Table;
+			return Table;
+		}
+
+		//	Overload resolution picks the first only when Channel is one of ours
+		template <typename Channel>
+		inline static Channel*const FindIn(ChannelSlot<Channel>*const Slot) { return &Slot->Channel; }
+		template <typename Channel>
+		inline static Channel*const FindIn(...) { return nullptr; }
+
+		//	Same again for With; a pointer converts to its base before it converts to void
+		template <typename Channel, typename Callback>
+		inline static void WithIn(ChannelSlot<Channel>*const Slot, Callback& Fn) { Fn(&Slot->Channel); }
+		template <typename Channel, typename Callback>
+		inline static void WithIn(const void*const, Callback&) {}
+
+		template <typename Channel, typename Callback>
+		inline static void VisitWith(ChannelTable*const Table, Callback& Fn) { Fn(Table->template Get<Channel>()); }
+
+	public:
+		inline ChannelTable(const ChannelContext& Context) : ChannelSlot<Channels>(Context)... {}
+
+		template <typename Channel>
+		inline Channel*const Get() { return &static_cast<ChannelSlot<Channel>*>(this)->Channel; }
+
+		//	Like Get, but compiles for any channel and gives nullptr for one left out of the set
+		template <typename Channel>
+		inline Channel*const Find() { return FindIn<Channel>(this); }
+
+		//	Calls Fn(Channel*) only if Channel is part of the set; compiles to nothing otherwise
+		template <typename Channel, typename Callback>
+		inline void With(Callback Fn) { WithIn<Channel>(this, Fn); }
+
+		//	Calls Fn(Channel*) for every channel in the order they were composed
+		template <typename Callback>
+		inline void ForEach(Callback Fn)
+		{
+			const int Each[] = { 0, (Fn(Get<Channels>()), 0)... };
+			(void)Each;
+		}
+
+		//	Hands a packet to the channel for its type
+		//	Returns false, leaving the packet alone, if no channel carries that type
+		inline const bool Receive(const PacketType Type, ReceivePacket*const Packet)
+		{
+			if (Type > PN_Keyed || Jumps().Receivers[Type] == nullptr) { return false; }
+			Jumps().Receivers[Type](this, Packet);
+			return true;
+		}
+
+		//	Calls Fn(Channel*) with the channel carrying Type, one jump away like Receive
+		//	Fn is instantiated for every channel in the set, so overloads pick what each one does
+		//	Returns false, without calling Fn, if no channel carries that type
+		template <typename Callback>
+		inline const bool Visit(const PacketType Type, Callback Fn)
+		{
+			typedef void(*Visitor)(ChannelTable*const, Callback&);
+			struct VisitTable
+			{
+				Visitor Visitors[PN_Keyed + 1];
+
+				inline VisitTable() : Visitors()
+				{
+					const int Fill[] = { 0, (Visitors[ChannelSlot<Channels>::Type] = &VisitWith<Channels, Callback>, 0)... };
+					(void)Fill;
+				}
+			};
+			static const VisitTable Table;
+			if (Type > PN_Keyed || Table.Visitors[Type] == nullptr) { return false; }
+			Table.Visitors[Type](this, Fn);
+			return true;
+		}
+
+		//	Swaps the processing queue of the channel for a type with Queue
+		inline void SwapProcessingQueue(const PacketType Type, std::deque<ReceivePacket*>& Queue)
+		{
+			if (Type > PN_Keyed || Jumps().Swappers[Type] == nullptr) { return; }
+			Jumps().Swappers[Type](this, Queue);
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,510 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+
+#define PN_InitialWindow 10		//	Packets allowed in flight before the first acknowledgement arrives
+#define PN_MinWindow 2			//	Packets always allowed in flight, even after a timeout
+#define PN_PacingBurst 4		//	Packets the pacer may release back to back
+#define PN_BBR_Rounds 10		//	Round trips the bottleneck bandwidth filter remembers
+#define PN_BBR_MinRTTWindow 10	//	Seconds the minimum Round-Trip-Time is trusted before it is allowed to rise
+
+namespace PeerNet
+{
+	//
+	//	Congestion Controller Interface
+	//	Decides how many bytes a peer may have in flight and how fast to release them
+	//	Always called from inside a SendPacer so implementations need no locking of their own
+	class CongestionControl
+	{
+	public:
+		inline virtual ~CongestionControl() {}
+		//	Bytes were acknowledged by the remote peer
+		inline virtual void OnAcked(const size_t Bytes, const steady_clock::time_point& Now, const duration<double, std::milli>& RTT) = 0;
+		//	A packet needed retransmitted; Timeout is false for fast retransmits
+		inline virtual void OnLost(const size_t Bytes, const steady_clock::time_point& Now, const duration<double, std::milli>& RTT, const bool Timeout) = 0;
+		//	Bytes allowed in flight
+		inline virtual const size_t Window() const = 0;
+		//	Bytes per millisecond the pacer should release
+		inline virtual const double PacingRate(const duration<double, std::milli>& RTT) const = 0;
+		inline virtual const char* Name() const = 0;
+	};
+
+	//
+	//	Additive-Increase Multiplicative-Decrease (TCP Reno style)
+	//	Slow start doubles the window every round trip until the first loss
+	//	after which it grows by one packet per round trip and halves on loss
+	class CongestionAIMD : public CongestionControl
+	{
+		size_t CWND;
+		size_t SSThresh;
+		steady_clock::time_point LastReduction;	//	Losses within one RTT of a reduction belong to the same event
+
+	public:
+		inline CongestionAIMD()
+			: CWND(PN_InitialWindow * PN_MaxPacketSize), SSThresh(SIZE_MAX), LastReduction() {}
+
+		inline void OnAcked(const size_t Bytes, const steady_clock::time_point& Now, const duration<double, std::milli>& RTT)
+		{
+			if (CWND < SSThresh) { CWND += Bytes; }
+			else { CWND += (std::max)((size_t)1, PN_MaxPacketSize * Bytes / CWND); }
+		}
+
+		inline void OnLost(const size_t Bytes, const steady_clock::time_point& Now, const duration<double, std::milli>& RTT, const bool Timeout)
+		{
+			if (Now - LastReduction < RTT) { return; }
+			LastReduction = Now;
+			SSThresh = (std::max)(CWND / 2, (size_t)(PN_MinWindow * PN_MaxPacketSize));
+			CWND = Timeout ? (size_t)(PN_MinWindow * PN_MaxPacketSize) : SSThresh;
+		}
+
+		inline const size_t Window() const { return CWND; }
+
+		inline const double PacingRate(const duration<double, std::milli>& RTT) const
+		{
+			//	Run ahead of the window a little so pacing never becomes the bottleneck
+			const double Gain = CWND < SSThresh ? 2.0 : 1.25;
+			return Gain * CWND / (std::max)(RTT.count(), 1.0);
+		}
+
+		inline const char* Name() const { return "AIMD"; }
+	};
+
+	//
+	//	Model based controller in the spirit of BBR
+	//	Estimates the bottleneck bandwidth (max delivery rate over the last few rounds)
+	//	and the propagation delay (min RTT) and keeps roughly one bandwidth-delay product in flight
+	//	Loss is not treated as a congestion signal
+	class CongestionBBR : public CongestionControl
+	{
+		double BtlBw[PN_BBR_Rounds];			//	Delivery rate per round in bytes/ms
+		unsigned char Round;
+		double RTProp;							//	Minimum RTT in ms
+		steady_clock::time_point RTPropStamp;
+		size_t RoundDelivered;					//	Bytes acknowledged this round
+		steady_clock::time_point RoundStart;
+		double RoundTime;						//	How long the last round took to close in ms; ACKs arriving in bursts stretch it past RTProp
+		bool Startup;
+		double StartupBw;						//	Bandwidth when the startup plateau check last grew
+		unsigned char StartupPlateau;			//	Rounds without 25% growth
+		unsigned char Cycle;					//	Position in the pacing gain cycle
+
+		inline const double MaxBw() const
+		{
+			double Max = 0;
+			for (unsigned char i = 0; i < PN_BBR_Rounds; i++) { Max = (std::max)(Max, BtlBw[i]); }
+			return Max;
+		}
+
+	public:
+		inline CongestionBBR()
+			: BtlBw(), Round(0), RTProp(0), RTPropStamp(), RoundDelivered(0), RoundStart(steady_clock::now()), RoundTime(0),
+			Startup(true), StartupBw(0), StartupPlateau(0), Cycle(0) {}
+
+		inline void OnAcked(const size_t Bytes, const steady_clock::time_point& Now, const duration<double, std::milli>& RTT)
+		{
+			if (RTT.count() > 0 && (RTProp == 0 || RTT.count() < RTProp || Now - RTPropStamp > std::chrono::seconds(PN_BBR_MinRTTWindow))) {
+				RTProp = RTT.count();
+				RTPropStamp = Now;
+			}
+			RoundDelivered += Bytes;
+			const double Elapsed = duration<double, std::milli>(Now - RoundStart).count();
+			//	Close the round once an RTT has passed
+			if (RTT.count() <= 0 || Elapsed < RTT.count()) { return; }
+			Round = (Round + 1) % PN_BBR_Rounds;
+			BtlBw[Round] = RoundDelivered / Elapsed;
+			RoundDelivered = 0;
+			RoundStart = Now;
+			RoundTime = Elapsed;
+			Cycle = (Cycle + 1) % 8;
+			//	Leave startup once bandwidth stops growing by 25% for three rounds
+			if (Startup) {
+				const double Bw = MaxBw();
+				if (Bw >= StartupBw * 1.25) { StartupBw = Bw; StartupPlateau = 0; }
+				else if (++StartupPlateau >= 3) { Startup = false; }
+			}
+		}
+
+		inline void OnLost(const size_t Bytes, const steady_clock::time_point& Now, const duration<double, std::milli>& RTT, const bool Timeout) {}
+
+		inline const size_t Window() const
+		{
+			const double Bw = MaxBw();
+			if (Bw == 0 || RTProp == 0) { return PN_InitialWindow * PN_MaxPacketSize; }
+			const double Gain = Startup ? 2.89 : 2.0;
+			//	A peer that only acknowledges on its tick delivers a whole round's worth at once
+			//	Covering the gap between those bursts keeps the window from shrinking every round
+			return (std::max)((size_t)(Gain * Bw * (std::max)(RTProp, RoundTime)), (size_t)(PN_MinWindow * PN_MaxPacketSize));
+		}
+
+		inline const double PacingRate(const duration<double, std::milli>& RTT) const
+		{
+			const double Bw = MaxBw();
+			if (Bw == 0) { return 2.89 * PN_InitialWindow * PN_MaxPacketSize / (std::max)(RTT.count(), 1.0); }
+			if (Startup) { return 2.89 * Bw; }
+			//	Probe for more bandwidth one round, drain the queue we built the next, then cruise
+			static const double Gains[8] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+			return Gains[Cycle] * Bw;
+		}
+
+		inline const char* Name() const { return "BBR"; }
+	};
+
+	//	Per channel operation queue served by deficit round robin
+	struct SendClass
+	{
+		std::deque<SendPacket*> Queue;
+		unsigned short Weight = 0;	//	Packets worth of bytes this class may send each round
+		size_t Deficit = 0;							//	Bytes this class is still owed
+		unsigned long Limit = 0;					//	Highest packet ID the receiver has room for; 0 for no limit
+	};
+
+	//
+	//	Send Pacer
+	//	Every packet a peer sends other than Keep-Alives and ACKs passes through here
+	//
+	//	Retransmissions go first, then each channel operation gets a share of each round
+	//	proportional to its weight so bulk transfers can't hold up small latency sensitive updates
+	//	Reliable and ordered packets are held until the congestion window has room for them
+	//	and spaced out at the controllers pacing rate instead of released in one burst
+	//	An optional token bucket caps the peers total outgoing bandwidth
+	//	Released whenever a packet is queued, acknowledgements arrive, or the peer ticks
+	class SendPacer
+	{
+		NetSocket*const Socket;
+		RTTEstimator*const Estimator;
+		AckTracker*const Acks;
+
+		PeerMutex Mutex;
+		std::unique_ptr<CongestionControl> Controller;
+		std::deque<SendPacket*> Retransmits;			//	Lost packets waiting to go out again
+		std::map<unsigned long long, SendClass> Classes;	//	Keyed by (Channel << 32 | OP)
+		unsigned short ChannelWeights[PN_Keyed + 1];	//	Weight given to new operations of each channel
+		//	Latest generation sent for each (Channel, OP, SupersedeKey)
+		//	Owned by the packets carrying that key; an entry whose packets are all gone has nothing left to supersede
+		std::map<std::tuple<unsigned short, unsigned long, unsigned long long>, std::weak_ptr<std::atomic<unsigned long>>> Generations;
+		size_t GenerationsSwept;			//	Entries left after the last sweep for expired ones
+		size_t InFlight;					//	Bytes sent but not yet acknowledged
+		double Tokens;						//	Bytes the pacer may release right now
+		double RateTokens;					//	Bytes the bandwidth limit allows right now
+		double RateLimit;					//	Bytes per millisecond; 0 for unlimited
+		double RateBurst;					//	Most bytes the bandwidth limit lets through at once
+		steady_clock::time_point LastRefill;
+
+		unsigned long long Stats_Paced;		//	Times a packet had to wait for the pacer
+		unsigned long long Stats_Limited;	//	Times a packet had to wait for the bandwidth limit
+		unsigned long long Stats_Dropped;	//	Obsolete packets discarded before reaching the socket
+		unsigned long long Stats_Resent;	//	Packets that went out again after being lost
+		unsigned long long Stats_ResentBytes;
+
+		//	Until the first sample arrives the initial retransmission timeout stands in for the RTT
+		inline const duration<double, std::milli> CurrentRTT()
+		{
+			const duration<double, std::milli> RTT = Estimator->RTT();
+			return RTT.count() > 0 ? RTT : Estimator->RTO();
+		}
+
+		inline static const unsigned long long ClassKey(const PacketType Channel, const unsigned long OP)
+		{
+			return ((unsigned long long)Channel << 32) | OP;
+		}
+
+		inline SendClass& GetClass(const PacketType Channel, const unsigned long OP)
+		{
+			SendClass& Class = Classes[ClassKey(Channel, OP)];
+			if (Class.Weight == 0) { Class.Weight = Channel <= PN_Keyed ? ChannelWeights[Channel] : 1; }
+			return Class;
+		}
+
+		inline static const bool Controlled(const SendPacket*const Packet)
+		{
+			return Packet->GetType() == PN_Reliable || Packet->GetType() == PN_Ordered;
+		}
+
+		enum Gate { Gate_Open, Gate_Class, Gate_All };
+
+		//	Can this packet go out right now
+		//	Gate_Class means only packets under congestion control need to wait
+		inline const Gate Check(const SendPacket*const Packet, const size_t Size)
+		{
+			if (RateLimit > 0 && RateTokens < Size) { ++Stats_Limited; return Gate_All; }
+			if (!Controlled(Packet)) { return Gate_Open; }
+			//	Always let one packet through an empty window so we can never stall
+			if (Packet->GetSendCount() == 0 && InFlight > 0 && InFlight + Size > Controller->Window()) { ++Stats_Paced; return Gate_Class; }
+			if (Tokens < Size) { ++Stats_Paced; return Gate_Class; }
+			return Gate_Open;
+		}
+
+		//	Take an obsolete packet out of circulation
+		inline void Drop(SendPacket*const Packet)
+		{
+			++Stats_Dropped;
+			//	It was already counted in flight if this was a retransmission
+			if (Controlled(Packet) && Packet->GetSendCount() > 0 && Packet->NeedsDelete.exchange(1) == 0) {
+				InFlight -= (std::min)(InFlight, Packet->GetSize());
+			}
+			Packet->NeedsDelete.store(1);
+			Packet->IsSending.store(0);
+		}
+
+		inline void Release(SendPacket*const Packet, const size_t Size)
+		{
+			if (RateLimit > 0) { RateTokens -= Size; }
+			if (Controlled(Packet)) {
+				Tokens -= Size;
+				if (Packet->GetSendCount() == 0) { InFlight += Size; }
+				else { ++Stats_Resent; Stats_ResentBytes += Size; }
+			}
+			Acks->Write(Packet);
+			Socket->SendPacket(Packet);
+		}
+
+	public:
+		inline SendPacer(NetSocket*const DefaultSocket, RTTEstimator*const RTT, AckTracker*const AckTrack, CongestionControl*const CC, const bool Polled = false)
+			: Socket(DefaultSocket), Estimator(RTT), Acks(AckTrack), Mutex(Polled), Controller(CC), Retransmits(), Classes(), Generations(), GenerationsSwept(0), InFlight(0),
+			Tokens(PN_PacingBurst * PN_MaxPacketSize), RateTokens(0), RateLimit(0), RateBurst(0),
+			LastRefill(steady_clock::now()), Stats_Paced(0), Stats_Limited(0), Stats_Dropped(0), Stats_Resent(0), Stats_ResentBytes(0)
+		{
+			//	Small latest-state updates get a bigger share than bulk reliable streams
+			for (auto& Weight : ChannelWeights) { Weight = 1; }
+			ChannelWeights[PN_Reliable] = 2;
+			ChannelWeights[PN_Unreliable] = 4;
+			ChannelWeights[PN_Snapshot] = 4;
+			ChannelWeights[PN_FEC] = 2;
+			ChannelWeights[PN_Keyed] = 4;
+		}
+
+		//	Swap in a different congestion controller; takes ownership
+		inline void SetController(CongestionControl*const CC)
+		{
+			Mutex.lock();
+			Controller.reset(CC);
+			Mutex.unlock();
+		}
+
+		//	Cap the outgoing bandwidth in bytes per second; 0 removes the cap
+		//	Burst is how many bytes may go out back to back after the peer has been idle
+		inline void SetRateLimit(const unsigned long BytesPerSecond, const unsigned long Burst)
+		{
+			Mutex.lock();
+			RateLimit = BytesPerSecond / 1000.0;
+			RateBurst = (std::max)((double)Burst, (double)PN_MaxPacketSize);
+			RateTokens = RateBurst;
+			Mutex.unlock();
+		}
+
+		//	Set the share of bandwidth a channel operation receives relative to the others
+		inline void SetWeight(const PacketType Channel, const unsigned long OP, const unsigned short Weight)
+		{
+			Mutex.lock();
+			GetClass(Channel, OP).Weight = (std::max)(Weight, (unsigned short)1);
+			Mutex.unlock();
+		}
+
+		//	Set the weight given to operations of a channel which haven't had their own set
+		inline void SetWeight(const PacketType Channel, const unsigned short Weight)
+		{
+			if (Channel > PN_Keyed) { return; }
+			Mutex.lock();
+			ChannelWeights[Channel] = (std::max)(Weight, (unsigned short)1);
+			Mutex.unlock();
+		}
+
+		//	The receiver has room for packets up to this ID
+		//	Acknowledgements can arrive out of order so the limit only ever moves forward
+		inline void SetSendLimit(const PacketType Channel, const unsigned long OP, const unsigned long Limit)
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			SendClass& Class = GetClass(Channel, OP);
+			if (Limit > Class.Limit) { Class.Limit = Limit; }
+			Mutex.unlock();
+		}
+
+		//	Queue a packet for its first transmission
+		inline void Send(SendPacket*const Packet)
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			//	Make every older packet with the same key obsolete
+			unsigned long long Key = 0;
+			if (Packet->GetSupersedeKey(Key))
+			{
+				auto& Entry = Generations[std::make_tuple((unsigned short)Packet->GetType(), Packet->GetOperationID(), Key)];
+				std::shared_ptr<std::atomic<unsigned long>> Generation = Entry.lock();
+				if (!Generation) { Generation = std::make_shared<std::atomic<unsigned long>>(0); Entry = Generation; }
+				Packet->Supersedes(Generation, ++(*Generation));
+				//	Forget keys no packet carries any more once enough have built up; keeps the map the size of what's in flight
+				if (Generations.size() >= 2 * (std::max)(GenerationsSwept, (size_t)64))
+				{
+					for (auto Expired = Generations.begin(); Expired != Generations.end();) {
+						if (Expired->second.expired()) { Expired = Generations.erase(Expired); }
+						else { ++Expired; }
+					}
+					GenerationsSwept = Generations.size();
+				}
+			}
+			GetClass(Packet->GetType(), Packet->GetOperationID()).Queue.push_back(Packet);
+			Mutex.unlock();
+		}
+
+		//	Queue a retransmission ahead of new data
+		//	The packet is already counted in flight so only pacing applies
+		inline void Retransmit(SendPacket*const Packet, const bool Timeout)
+		{
+			const steady_clock::time_point Now = steady_clock::now();
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			Controller->OnLost(Packet->GetSize(), Now, CurrentRTT(), Timeout);
+			Retransmits.push_back(Packet);
+			Mutex.unlock();
+		}
+
+		//	A sent packet was acknowledged
+		//	Must only be called once per packet
+		inline void Acked(SendPacket*const Packet)
+		{
+			if (Packet->GetSendCount() == 0) { return; }
+			const size_t Size = Packet->GetSize();
+			const steady_clock::time_point Now = steady_clock::now();
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			InFlight -= (std::min)(InFlight, Size);
+			Controller->OnAcked(Size, Now, Estimator->RTT());
+			Mutex.unlock();
+		}
+
+		//	A sent packet was given up on without being acknowledged
+		//	Must only be called once per packet
+		inline void Discarded(SendPacket*const Packet)
+		{
+			if (Packet->GetSendCount() == 0) { return; }
+			const size_t Size = Packet->GetSize();
+			Mutex.lock();
+			InFlight -= (std::min)(InFlight, Size);
+			Mutex.unlock();
+		}
+
+		//	A channel gave up resending an obsolete packet
+		inline void Obsolete(SendPacket*const Packet)
+		{
+			Mutex.lock();
+			Drop(Packet);
+			Mutex.unlock();
+		}
+
+		//	Release as many queued packets as the window, pacing rate and bandwidth limit allow
+		inline void Flush()
+		{
+			const steady_clock::time_point Now = steady_clock::now();
+			const duration<double, std::milli> RTT = CurrentRTT();
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			const double Elapsed = duration<double, std::milli>(Now - LastRefill).count();
+			Tokens = (std::min)((double)(PN_PacingBurst * PN_MaxPacketSize), Tokens + Elapsed * Controller->PacingRate(RTT));
+			if (RateLimit > 0) { RateTokens = (std::min)(RateBurst, RateTokens + Elapsed * RateLimit); }
+			LastRefill = Now;
+
+			//	Retransmissions first; they're holding up everything the receiver has buffered behind them
+			//	One that has to wait only holds up those behind it if the whole peer is out of bandwidth
+			auto Next = Retransmits.begin();
+			while (Next != Retransmits.end())
+			{
+				SendPacket*const Packet = *Next;
+				//	Acknowledged or abandoned while it waited
+				if (Packet->NeedsDelete.load() == 1) {
+					Next = Retransmits.erase(Next);
+					Packet->IsSending.store(0);
+					continue;
+				}
+				if (Packet->IsObsolete(Now)) {
+					Next = Retransmits.erase(Next);
+					Drop(Packet);
+					continue;
+				}
+				const size_t Size = Packet->GetSize();
+				const Gate Result = Check(Packet, Size);
+				if (Result == Gate_All) { Mutex.unlock(); return; }
+				if (Result == Gate_Class) { ++Next; continue; }
+				Next = Retransmits.erase(Next);
+				Release(Packet, Size);
+			}
+
+			//	Deficit round robin across channel operations
+			bool Progress = true;
+			while (Progress)
+			{
+				Progress = false;
+				for (auto& Entry : Classes)
+				{
+					SendClass& Class = Entry.second;
+					if (Class.Queue.empty()) { Class.Deficit = 0; continue; }
+					Class.Deficit += Class.Weight * PN_MaxPacketSize;
+					while (!Class.Queue.empty())
+					{
+						SendPacket*const Packet = Class.Queue.front();
+						if (Packet->NeedsDelete.load() == 1) {
+							Class.Queue.pop_front();
+							Packet->IsSending.store(0);
+							continue;
+						}
+						if (Packet->IsObsolete(Now)) {
+							Class.Queue.pop_front();
+							Drop(Packet);
+							continue;
+						}
+						//	Wait for the receiver to make room
+						if (Class.Limit != 0 && Packet->GetPacketID() > Class.Limit) { Class.Deficit = 0; ++Stats_Paced; break; }
+						const size_t Size = Packet->GetSize();
+						if (Size > Class.Deficit) { Progress = true; break; }
+						const Gate Result = Check(Packet, Size);
+						if (Result == Gate_All) { Mutex.unlock(); return; }
+						//	Don't let a blocked class bank credit it can't use
+						if (Result == Gate_Class) { Class.Deficit = (std::min)(Class.Deficit, (size_t)(Class.Weight * PN_MaxPacketSize)); break; }
+						Class.Deficit -= Size;
+						Class.Queue.pop_front();
+						Release(Packet, Size);
+						Progress = true;
+					}
+					if (Class.Queue.empty()) { Class.Deficit = 0; }
+				}
+			}
+			Mutex.unlock();
+		}
+
+		inline void PrintStats()
+		{
+			Mutex.lock();
+			size_t Queued = Retransmits.size();
+			for (auto& Entry : Classes) { Queued += Entry.second.Queue.size(); }
+			printf("Congestion (%s) Window: %zu In Flight: %zu Queued: %zu Paced: %llu Limited: %llu Dropped: %llu Resent: %llu (%llu bytes)\n",
+				Controller->Name(), Controller->Window(), InFlight, Queued, Stats_Paced, Stats_Limited, Stats_Dropped, Stats_Resent, Stats_ResentBytes);
+			Mutex.unlock();
+		}
+
+		//	Bytes of reliable and ordered packets sent again after being lost
+		inline const unsigned long long GetResentBytes()
+		{
+			Mutex.lock();
+			const unsigned long long Bytes = Stats_ResentBytes;
+			Mutex.unlock();
+			return Bytes;
+		}
+	};
+}
\ No newline at end of file
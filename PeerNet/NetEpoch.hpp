@@ -0,0 +1,199 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PeerNet
+{
+	//
+	//	Epoch Manager
+	//	Epoch based reclamation for anything another thread may still be reading when it is let go of
+	//	Readers pin the global epoch for as long as they hold pointers; that is a thread local store and nothing else
+	//	Retired objects wait in the limbo list of the epoch they were retired in,
+	//	and are destroyed in bulk once every pinned thread has moved three epochs past it
+	class EpochManager
+	{
+		static const unsigned long long Idle = ~0ull;
+
+		//	Slots are only ever pushed onto the front of the list and live as long as the manager
+		//	A thread that exits gives its slot back for the next new thread to claim
+		struct alignas(64) ThreadSlot
+		{
+			std::atomic<unsigned long long> Epoch;	//	Epoch this thread pinned, or Idle
+			std::atomic<bool> Claimed;
+			ThreadSlot* Next;						//	Never changes once the slot is published
+			inline ThreadSlot() : Epoch(Idle), Claimed(true), Next(nullptr) {}
+		};
+
+		struct Retired
+		{
+			void* Object;
+			void(*Destroy)(void*);
+			const std::atomic<unsigned long>* Busy;	//	Held back while this is non-zero; nullptr if never
+			bool Carried;							//	Already held back at least once
+		};
+
+		//	Every thread keeps the same slot until it exits
+		struct LocalState
+		{
+			ThreadSlot* Slot = nullptr;
+			unsigned long Depth = 0;	//	Pins nest; only the outermost one touches the slot
+			inline ~LocalState() { if (Slot != nullptr) { Slot->Epoch.store(Idle); Slot->Claimed.store(false); } }
+		};
+
+		std::atomic<unsigned long long> Global;
+		std::atomic<ThreadSlot*> Slots;	//	One per thread that ever entered, lock free so Enter never waits on the mutex
+		std::mutex Mutex;
+		std::vector<Retired> Limbo[3];
+		std::atomic<size_t> Pending;	//	Retired and not yet destroyed; lets Collect skip the scan
+		std::atomic<size_t> Held;		//	Unreachable but still busy, so carried over into the next epoch
+
+		inline static LocalState& Local()
+		{
+			thread_local LocalState State;
+			return State;
+		}
+
+		//	Reuses a slot left behind by an exited thread, otherwise adds a new one
+		inline ThreadSlot*const Claim()
+		{
+			for (ThreadSlot* Slot = Slots.load(); Slot != nullptr; Slot = Slot->Next)
+			{
+				bool Free = false;
+				if (Slot->Claimed.compare_exchange_strong(Free, true)) { return Slot; }
+			}
+			ThreadSlot*const Slot = new ThreadSlot();
+			Slot->Next = Slots.load();
+			while (!Slots.compare_exchange_weak(Slot->Next, Slot)) {}
+			return Slot;
+		}
+
+		//	Moves the global epoch on if every pinned thread has seen it
+		//	Whatever was retired three epochs ago can no longer be reached and is destroyed
+		inline void Advance()
+		{
+			if (!Mutex.try_lock()) { return; }
+			const unsigned long long Current = Global.load();
+			for (ThreadSlot* Slot = Slots.load(); Slot != nullptr; Slot = Slot->Next)
+			{
+				const unsigned long long Pinned = Slot->Epoch.load();
+				if (Pinned != Idle && Pinned != Current) { Mutex.unlock(); return; }
+			}
+			Global.store(Current + 1);
+			std::vector<Retired> Reclaim;
+			Reclaim.swap(Limbo[(Current + 1) % 3]);
+			//	Anything still busy waits out another round
+			for (size_t i = 0; i < Reclaim.size();)
+			{
+				Retired& Object = Reclaim[i];
+				if (Object.Carried) { Object.Carried = false; --Held; }
+				if (Object.Busy == nullptr || Object.Busy->load() == 0) { ++i; continue; }
+				Object.Carried = true;
+				++Held;
+				Limbo[(Current + 1) % 3].push_back(Object);
+				Object = Reclaim.back();
+				Reclaim.pop_back();
+			}
+			Pending -= Reclaim.size();
+			Mutex.unlock();
+			//	Destructors may retire more, so run them with the mutex released
+			for (auto& Object : Reclaim) { Object.Destroy(Object.Object); }
+		}
+
+		template <typename T>
+		inline static void Delete(void*const Object) { delete static_cast<T*>(Object); }
+
+		inline EpochManager() : Global(0), Slots(nullptr), Mutex(), Limbo(), Pending(0), Held(0) {}
+
+	public:
+		//	Anything still in limbo goes with the process
+		inline ~EpochManager()
+		{
+			for (auto& List : Limbo) {
+				for (auto& Object : List) { Object.Destroy(Object.Object); }
+			}
+			ThreadSlot* Slot = Slots.load();
+			while (Slot != nullptr)
+			{
+				ThreadSlot*const Next = Slot->Next;
+				delete Slot;
+				Slot = Next;
+			}
+		}
+
+		//	Every PeerNet instance shares this one
+		inline static EpochManager& Instance()
+		{
+			static EpochManager Manager;
+			return Manager;
+		}
+
+		//	Pointers read after this stay valid until the matching Leave
+		inline void Enter()
+		{
+			LocalState& State = Local();
+			if (State.Depth++ > 0) { return; }
+			if (State.Slot == nullptr) { State.Slot = Claim(); }
+			State.Slot->Epoch.store(Global.load());
+		}
+
+		inline void Leave()
+		{
+			LocalState& State = Local();
+			if (--State.Depth == 0) { State.Slot->Epoch.store(Idle); }
+		}
+
+		//	Deletes Object once no thread can still be reading it
+		//	It must already be unreachable for anyone entering from now on
+		//	If Busy is given Object is also held until it reads zero, however many epochs that takes
+		template <typename T>
+		inline void Retire(T*const Object, const std::atomic<unsigned long>*const Busy = nullptr)
+		{
+			if (Object == nullptr) { return; }
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			Limbo[Global.load() % 3].push_back({ (void*)Object, &Delete<T>, Busy, false });
+			++Pending;
+			Mutex.unlock();
+		}
+
+		//	Destroys whatever has become unreachable; cheap when nothing is waiting
+		//	Safe to call while pinned, but our own pin holds back anything retired since we entered
+		inline void Collect()
+		{
+			if (Pending.load() == 0) { return; }
+			Advance();
+		}
+
+		//	Returns once everything retired before the call has been destroyed
+		//	Waits for busy objects too, so whatever they're waiting on must be able to finish without the caller
+		//	Must not be called while pinned, it would wait on itself forever
+		inline void Synchronize()
+		{
+			const unsigned long long Target = Global.load() + 3;
+			while (Global.load() < Target || Held.load() > 0)
+			{
+				Advance();
+				if (Global.load() < Target || Held.load() > 0) { std::this_thread::yield(); }
+			}
+		}
+	};
+
+	//	Pins the epoch for as long as it is in scope
+	class EpochGuard
+	{
+	public:
+		inline EpochGuard() { EpochManager::Instance().Enter(); }
+		inline ~EpochGuard() { EpochManager::Instance().Leave(); }
+		EpochGuard(const EpochGuard&) = delete;
+		EpochGuard& operator=(const EpochGuard&) = delete;
+	};
+
+	//	Hands an object another thread may still be touching to the epoch manager instead of deleting it
+	template <typename T>
+	inline void Retire(T*const Object, const std::atomic<unsigned long>*const Busy = nullptr) { EpochManager::Instance().Retire(Object, Busy); }
+}
\ No newline at end of file
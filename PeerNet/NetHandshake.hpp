@@ -0,0 +1,172 @@
+#pragma once
+#include <algorithm>
+#include <random>
+
+#define PN_CookieLifetime 10	//	Seconds a handshake cookie stays valid for; it is accepted for up to twice this
+#define PN_ChallengeRate 1000	//	Hellos answered per second
+#define PN_ChallengeBurst 100	//	Hellos answered at once after a quiet period
+#define PN_AdmissionRate 1000	//	Verified Responses let in per second
+#define PN_AdmissionBurst 100	//	Verified Responses let in at once after a quiet period
+
+namespace PeerNet
+{
+	//	OperationID of a PN_Handshake packet
+	//	A stranger says Hello, we answer with a Challenge holding a cookie only we can make,
+	//	and only a Response echoing that cookie from the same address gets a peer created for it
+	enum HandshakeStage : unsigned long
+	{
+		HS_Hello = 0,
+		HS_Challenge = 1,
+		HS_Response = 2
+	};
+
+	//	Serializes a handshake; every stage carries a cookie, Hello's is just zero
+	//	Nothing else is in them, so they're always exactly the same size
+	inline const string HandshakePacket(const HandshakeStage Stage, const unsigned long long Cookie)
+	{
+		SendPacket Packet(0, PN_Handshake, Stage, nullptr, true);
+		Packet.WriteData<unsigned long long>(Cookie);
+		return Packet.GetData()->str();
+	}
+
+	inline const size_t HandshakeSize()
+	{
+		static const size_t Size = HandshakePacket(HS_Hello, 0).size();
+		return Size;
+	}
+
+	//
+	//	Cookie Jar
+	//	Cookies are a SipHash-2-4 MAC of the remote address and the current time window under a secret key
+	//	Checking one needs nothing but the key, so no state exists for anybody until they answer
+	class CookieJar
+	{
+		unsigned long long Key[2];
+
+		inline static unsigned long long Rotate(const unsigned long long X, const int B) { return (X << B) | (X >> (64 - B)); }
+
+		inline static void Round(unsigned long long V[4])
+		{
+			V[0] += V[1]; V[1] = Rotate(V[1], 13); V[1] ^= V[0]; V[0] = Rotate(V[0], 32);
+			V[2] += V[3]; V[3] = Rotate(V[3], 16); V[3] ^= V[2];
+			V[0] += V[3]; V[3] = Rotate(V[3], 21); V[3] ^= V[0];
+			V[2] += V[1]; V[1] = Rotate(V[1], 17); V[1] ^= V[2]; V[2] = Rotate(V[2], 32);
+		}
+
+		//	SipHash-2-4 of Count little endian 64 bit words
+		inline const unsigned long long SipHash(const unsigned long long*const Words, const unsigned char Count) const
+		{
+			unsigned long long V[4] = {
+				Key[0] ^ 0x736F6D6570736575ull, Key[1] ^ 0x646F72616E646F6Dull,
+				Key[0] ^ 0x6C7967656E657261ull, Key[1] ^ 0x7465646279746573ull };
+			for (unsigned char i = 0; i < Count; i++)
+			{
+				V[3] ^= Words[i];
+				Round(V); Round(V);
+				V[0] ^= Words[i];
+			}
+			const unsigned long long Last = (unsigned long long)(Count * 8) << 56;
+			V[3] ^= Last;
+			Round(V); Round(V);
+			V[0] ^= Last;
+			V[2] ^= 0xFF;
+			Round(V); Round(V); Round(V); Round(V);
+			return V[0] ^ V[1] ^ V[2] ^ V[3];
+		}
+
+		inline static const unsigned long long Window()
+		{
+			return (unsigned long long)std::chrono::duration_cast<std::chrono::seconds>(steady_clock::now().time_since_epoch()).count() / PN_CookieLifetime;
+		}
+
+		inline const unsigned long long Make(const PeerKey& Remote, const unsigned long long When) const
+		{
+			const unsigned long long Words[4] = { Remote.Address[0], Remote.Address[1], Remote.Port | ((unsigned long long)Remote.Family << 16), When };
+			return SipHash(Words, 4);
+		}
+
+	public:
+		//	A fresh random key every run; cookies never outlive the process that made them
+		inline CookieJar()
+		{
+			std::random_device Random;
+			for (auto& Word : Key) { Word = ((unsigned long long)Random() << 32) | Random(); }
+		}
+
+		inline const unsigned long long Issue(const PeerKey& Remote) const { return Make(Remote, Window()); }
+
+		//	Accepts cookies from this time window and the one before it
+		inline const bool Verify(const PeerKey& Remote, const unsigned long long Cookie) const
+		{
+			const unsigned long long Now = Window();
+			return Cookie == Make(Remote, Now) || Cookie == Make(Remote, Now - 1);
+		}
+	};
+
+	//
+	//	Admission Bucket
+	//	Token bucket limiting how many strangers we answer or let in per second
+	//	A flood of Hellos then costs a bounded number of replies however fast it arrives
+	class AdmissionBucket
+	{
+		const double Rate;
+		const double Burst;
+		std::mutex Mutex;
+		double Tokens;
+		steady_clock::time_point LastFill;
+
+	public:
+		//	Starts full
+		inline AdmissionBucket(const double PerSecond, const double AtOnce)
+			: Rate(PerSecond), Burst(AtOnce), Mutex(), Tokens(AtOnce), LastFill(steady_clock::now()) {}
+
+		//	Returns false if the bucket is empty
+		inline const bool Take()
+		{
+			const steady_clock::time_point Now = steady_clock::now();
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			Tokens = (std::min)(Burst, Tokens + std::chrono::duration<double>(Now - LastFill).count() * Rate);
+			LastFill = Now;
+			const bool Admitted = Tokens >= 1.0;
+			if (Admitted) { Tokens -= 1.0; }
+			Mutex.unlock();
+			return Admitted;
+		}
+	};
+	//
+	//	Handshake Gate
+	//	Decides which strangers get answered and which get in
+	//	Hellos and verified Responses draw on separate buckets; a Hello costs the sender nothing,
+	//	so sharing one would let a spoofed flood keep out clients that already proved their address
+	class HandshakeGate
+	{
+		CookieJar Cookies;
+		AdmissionBucket Challenges;
+		AdmissionBucket Admissions;
+
+	public:
+		inline HandshakeGate()
+			: Cookies(), Challenges(PN_ChallengeRate, PN_ChallengeBurst), Admissions(PN_AdmissionRate, PN_AdmissionBurst) {}
+
+		inline const unsigned long long Issue(const PeerKey& Remote) const { return Cookies.Issue(Remote); }
+
+		//	Returns false if the Hello goes unanswered; otherwise Cookie holds the Challenge to send back
+		inline const bool Hello(const PeerKey& Remote, unsigned long long& Cookie)
+		{
+			if (!Challenges.Take()) { return false; }
+			Cookie = Cookies.Issue(Remote);
+			return true;
+		}
+
+		//	Returns false unless Cookie is ours for this address and there is room for another peer
+		//	Forged cookies are refused before they can spend an admission
+		inline const bool Response(const PeerKey& Remote, const unsigned long long Cookie)
+		{
+			return Cookies.Verify(Remote, Cookie) && Admissions.Take();
+		}
+	};
+}
\ No newline at end of file
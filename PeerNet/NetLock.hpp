@@ -0,0 +1,39 @@
+#pragma once
+#include <mutex>
+
+namespace PeerNet
+{
+	//
+	//	Peer Mutex
+	//	Guards state that belongs to a single peer
+	//	A polled PeerNet only ever touches its peers from the thread calling Poll,
+	//	so their locks are switched off and cost one predictable branch instead of an atomic
+	//	Keeps the std::mutex names so the _PERF_SPINLOCK loops work unchanged
+	class PeerMutex
+	{
+		std::mutex Mutex;
+		bool Enabled;
+
+	public:
+		inline PeerMutex(const bool Polled = false) : Mutex(), Enabled(!Polled) {}
+
+		//	Only before anything has taken the lock
+		inline void Disable() { Enabled = false; }
+		inline const bool Locking() const { return Enabled; }
+
+		inline void lock() { if (Enabled) { Mutex.lock(); } }
+		inline bool try_lock() { return !Enabled || Mutex.try_lock(); }
+		inline void unlock() { if (Enabled) { Mutex.unlock(); } }
+	};
+
+	//	Switches off the locks of a freshly created operation
+	//	The first overload catches operations carrying IN_Mutex and OUT_Mutex, the second the ones with nothing to lock
+	template <typename Operation>
+	inline auto DisableLocks(Operation& Op, int) -> decltype(Op.IN_Mutex.Disable(), Op.OUT_Mutex.Disable(), void())
+	{
+		Op.IN_Mutex.Disable();
+		Op.OUT_Mutex.Disable();
+	}
+	template <typename Operation>
+	inline void DisableLocks(Operation& Op, long) {}
+}
\ No newline at end of file
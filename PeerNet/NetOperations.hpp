@@ -0,0 +1,53 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "NetLock.hpp"
+
+#define PN_MaxOperations 16	//	OperationIDs available to each channel; every ID must be below this
+
+namespace PeerNet
+{
+	//
+	//	Operation Table
+	//	Owns the per-operation state of a channel in a dense array indexed by OperationID
+	//	Operations are registered while the owning peer is constructed and never removed,
+	//	so looking one up is a bounds check and an indexed load with no locking
+	//	Unregistered IDs, including garbage from the network, find nothing and never create state
+	template <typename Operation>
+	class OperationTable
+	{
+		std::unique_ptr<Operation> Operations[PN_MaxOperations];
+		std::vector<unsigned long> Registered;	//	IDs in use, so ForEach skips the empty slots
+		const bool Polled;						//	Operations are created with their locks switched off
+
+	public:
+		inline OperationTable(const bool PolledPeer = false) : Operations(), Registered(), Polled(PolledPeer) {}
+
+		//	Create the state for an operation
+		//	Only call before the owning peer sends or receives anything
+		//	Returns false if the ID is out of range
+		inline const bool Register(const unsigned long OP)
+		{
+			if (OP >= PN_MaxOperations) { return false; }
+			if (!Operations[OP]) {
+				Operations[OP].reset(new Operation());
+				if (Polled) { DisableLocks(*Operations[OP], 0); }
+				Registered.push_back(OP);
+			}
+			return true;
+		}
+
+		//	Returns nullptr if the operation was never registered
+		inline Operation*const Find(const unsigned long OP) const
+		{
+			return OP < PN_MaxOperations ? Operations[OP].get() : nullptr;
+		}
+
+		//	Calls Fn(OP, Operation&) for every registered operation
+		template <typename Callback>
+		inline void ForEach(Callback Fn)
+		{
+			for (auto OP : Registered) { Fn(OP, *Operations[OP]); }
+		}
+	};
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include "TimedEvent.hpp"
+#include "NetBitStream.hpp"
 #include <atomic>
+#include <memory>
 
 namespace PeerNet
 {
@@ -25,38 +27,145 @@ namespace PeerNet
 		const steady_clock::time_point CreationTime;	//	The creation time for this packet used for RTT calculations
 		//
 		NetAddress*const MyAddress;
+		std::streamoff PayloadOffset;					//	Where the header ends and the written data begins
+		string AckSection;								//	Acknowledgements spliced in after the header when transmitted
+		BitWriter Bits;									//	Holds bits until a full word or regular data is written
+		steady_clock::time_point Deadline;				//	Not worth sending after this
+		bool HasSupersedeKey;
+		unsigned long long SupersedeKey;				//	A newer packet with the same key makes this one worthless
+		std::shared_ptr<const std::atomic<unsigned long>> Generation;	//	Bumped every time a packet with our key is sent
+		unsigned long MyGeneration;						//	Generation when we were sent
+		unsigned long RequestID;						//	Set for requests made by CreateRequest; 0 otherwise
 
 	public:
 		//	IsSending flag = true to stop ACK cleanups
 		std::atomic<unsigned char> IsSending;
 		std::atomic<unsigned char> NeedsDelete;
+		//	Retransmission bookkeeping
+		std::atomic<unsigned char> SendCount;			//	Times this packet has been handed to a socket
+		std::atomic<steady_clock::rep> LastSent;		//	When it was last handed to a socket
+		unsigned char GapReports;						//	Newer packets acknowledged while this one wasn't; guarded by its channel
 
 		//	Managed == true ONLY for non-user accessible packets
 		inline SendPacket(const unsigned long pID, const PacketType pType, const unsigned long OpID, NetAddress*const Address, const bool Managed = false, steady_clock::time_point CT = steady_clock::now())
 			: DataStream(std::ios::in | std::ios::out | std::ios::binary), BinaryIn(DataStream),
 			PacketID(pID), TypeID(pType), OperationID(OpID),
 			InternallyManaged(Managed), CreationTime(CT),
-			MyAddress(Address), IsSending(1), NeedsDelete(0)
+			MyAddress(Address), AckSection(1, '\0'), Deadline((steady_clock::time_point::max)()),
+			HasSupersedeKey(false), SupersedeKey(0), Generation(nullptr), MyGeneration(0), RequestID(0),
+			IsSending(1), NeedsDelete(0), SendCount(0), LastSent(0), GapReports(0)
 		{
 			BinaryIn(pID);
 			BinaryIn(pType);
 			BinaryIn(OpID);
 			BinaryIn(CreationTime);
+			PayloadOffset = DataStream.tellp();
 		}
 
 		inline ~SendPacket() {}
 
 		// Write data into the packet
 		// MUST be read in the same order it was written
-		template <typename T> inline void WriteData(T Data) { BinaryIn(Data); }
+		template <typename T> inline void WriteData(T Data) { FlushBits(); BinaryIn(Data); }
+
+		//	Bit packed writes
+		//	Consecutive bit writes share bytes; the next WriteData pads out to a whole byte
+		//	MUST be read back with the matching Read function using the same ranges
+		//
+		//	Write the low Count (1-32) bits of Value
+		inline void WriteBits(const unsigned long Value, const unsigned char Count) { Bits.Write(DataStream.rdbuf(), Value, Count); }
+		//	Write a single bit
+		inline void WriteBit(const bool Value) { Bits.Write(DataStream.rdbuf(), Value, 1); }
+		//	Write an integer known to lie within [Min, Max] using only as many bits as the range needs
+		//	Values outside the range are clamped to it, like WriteQuantized does, instead of spilling into the next field
+		inline void WriteRanged(long Value, const long Min, const long Max)
+		{
+			if (Value < Min) { Value = Min; }
+			if (Value > Max) { Value = Max; }
+			WriteBits((unsigned long)(Value - Min), BitsRequired((unsigned long)(Max - Min)));
+		}
+		//	Write a float within [Min, Max] with Count bits of precision
+		inline void WriteQuantized(const float Value, const float Min, const float Max, const unsigned char Count)
+		{
+			WriteBits(Quantize(Value, Min, Max, Count), Count);
+		}
+		//	Write a vector whose components all lie within [Min, Max]
+		inline void WriteQuantizedVector(const float X, const float Y, const float Z, const float Min, const float Max, const unsigned char Count)
+		{
+			WriteQuantized(X, Min, Max, Count);
+			WriteQuantized(Y, Min, Max, Count);
+			WriteQuantized(Z, Min, Max, Count);
+		}
+		//	Write a unit quaternion as its three smallest components plus the index of the largest
+		inline void WriteQuaternion(const float W, const float X, const float Y, const float Z, const unsigned char Count)
+		{
+			const float Q[4] = { W, X, Y, Z };
+			unsigned char Largest = 0;
+			for (unsigned char i = 1; i < 4; i++) {
+				if (std::fabs(Q[i]) > std::fabs(Q[Largest])) { Largest = i; }
+			}
+			//	q and -q are the same rotation; flip so the dropped component is positive
+			const float Sign = Q[Largest] < 0 ? -1.0f : 1.0f;
+			WriteBits(Largest, 2);
+			for (unsigned char i = 0; i < 4; i++) {
+				if (i != Largest) { WriteQuantized(Q[i] * Sign, -SmallestThreeLimit, SmallestThreeLimit, Count); }
+			}
+		}
+		//	Drop this packet instead of sending it if it hasn't gone out Within this long from now
+		//	Ignored for ordered packets, which can never skip an ID
+		inline void SetDeadline(const steady_clock::duration& Within) { Deadline = steady_clock::now() + Within; }
+		//	Drop this packet instead of sending it once a newer packet with the same Key on the same operation is sent
+		//	Ignored for ordered packets, which can never skip an ID
+		inline void SetSupersedeKey(const unsigned long long Key) { HasSupersedeKey = true; SupersedeKey = Key; }
+		inline const bool GetSupersedeKey(unsigned long long& Key) const { Key = SupersedeKey; return HasSupersedeKey; }
+		//	Called by the sender when this packet is queued
+		inline void Supersedes(const std::shared_ptr<const std::atomic<unsigned long>>& Gen, const unsigned long Mine) { Generation = Gen; MyGeneration = Mine; }
+		//	Has this packet expired or been replaced by a newer one
+		inline const bool IsObsolete(const steady_clock::time_point& Now) const
+		{
+			if (TypeID == PN_Ordered) { return false; }
+			return Now > Deadline || (Generation != nullptr && Generation->load() != MyGeneration);
+		}
+
+		//	Mark this packet as a request and write ID in front of its data; call before writing anything else
+		inline void SetRequestID(const unsigned long ID) { RequestID = ID; WriteData(ID); }
+		inline const unsigned long GetRequestID() const { return RequestID; }
+
+		//	Push any pending bits into the data stream
+		inline void FlushBits() { if (Bits.Pending()) { Bits.Flush(DataStream.rdbuf()); } }
+
 		// Get the packets data buffer
 		inline const auto GetData() const { return DataStream.rdbuf(); }
+		//	Replace the acknowledgements this packet carries; done right before every transmission so they're never stale
+		//	Until then it carries an empty section, a zero count
+		inline void SetAcks(const string& Section) { AckSection = Section; }
+		//	Get exactly what goes on the wire: the header, our acknowledgements, then the written data
+		inline const string GetWire() const
+		{
+			const string Data(DataStream.str());
+			string Wire;
+			Wire.reserve(Data.size() + AckSection.size());
+			Wire.append(Data, 0, (size_t)PayloadOffset);
+			Wire.append(AckSection);
+			Wire.append(Data, (size_t)PayloadOffset, string::npos);
+			return Wire;
+		}
+		//	Get the serialized size in bytes, not counting acknowledgements
+		inline const size_t GetSize() const { return (size_t)DataStream.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::out); }
+		//	Get everything written after the header
+		inline const string GetPayload() const { return DataStream.str().substr((size_t)PayloadOffset); }
 		//	Return our underlying destination NetPeer
 		inline auto GetAddress() const { return MyAddress; }
 		//	Is this an internally managed packet
 		inline const auto& GetManaged() const { return InternallyManaged; }
 		//	Get the creation time
 		inline const auto& GetCreationTime() const { return CreationTime; }
+		//	Record a transmission
+		inline void MarkSent() { LastSent.store(steady_clock::now().time_since_epoch().count()); if (SendCount.load() < 255) { ++SendCount; } }
+		//	Get how many times this packet has been transmitted
+		inline const unsigned char GetSendCount() const { return SendCount.load(); }
+		//	Get the time of the last transmission
+		inline const steady_clock::time_point GetLastSent() const { return steady_clock::time_point(steady_clock::duration(LastSent.load())); }
 		// Get the packets ID
 		inline const auto& GetPacketID() const { return PacketID; }
 		// Get the packets Operation ID
@@ -77,6 +186,8 @@ namespace PeerNet
 		PacketType TypeID = PN_NotInialized;
 		unsigned long OperationID = 0;
 
+		BitReader Bits;
+
 	public:
 		//	Managed == true ONLY for non-user accessible packets
 		inline ReceivePacket(const string Data)
@@ -89,18 +200,96 @@ namespace PeerNet
 			BinaryOut(CreationTime);
 		}
 
+		//	Rebuilds a packet from its header values and an already decoded payload
+		//	Used by channels which transmit something other than the payload itself
+		inline ReceivePacket(const unsigned long pID, const PacketType pType, const unsigned long OpID, const steady_clock::time_point CT, const string& Payload)
+			: ReceivePacket(Compose(pID, pType, OpID, CT, Payload)) {}
+
 		inline ~ReceivePacket() {}
 
+		//	Serializes a header the same way SendPacket does and appends a payload to it
+		inline static const string Compose(const unsigned long pID, const PacketType pType, const unsigned long OpID, const steady_clock::time_point CT, const string& Payload)
+		{
+			stringstream Stream(std::ios::in | std::ios::out | std::ios::binary);
+			{
+				PortableBinaryOutputArchive Archive(Stream);
+				Archive(pID);
+				Archive(pType);
+				Archive(OpID);
+				Archive(CT);
+			}
+			Stream.write(Payload.data(), Payload.size());
+			return Stream.str();
+		}
+
+		//	Size of the smallest packet the constructor can parse
+		inline static const size_t HeaderSize()
+		{
+			static const size_t Size = Compose(0, PN_NotInialized, 0, steady_clock::time_point(), string()).size();
+			return Size;
+		}
+
 		// Read data from the packet
 		// MUST be read in the same order it was written
 		template <typename T> inline auto ReadData()
 		{
+			Bits.Align();
+			T Temp;
+			BinaryOut(Temp);
+			return Temp;
+		}
+
+		//	Read the next value without moving past it; there must be at least that much left
+		template <typename T> inline auto PeekData()
+		{
+			Bits.Align();
+			const auto Position = DataStream.tellg();
 			T Temp;
 			BinaryOut(Temp);
+			DataStream.seekg(Position);
 			return Temp;
 		}
+
+		//	Bit packed reads
+		//	Each MUST mirror the Write call used on the SendPacket
+		//
+		inline const unsigned long ReadBits(const unsigned char Count) { return Bits.Read(DataStream.rdbuf(), Count); }
+		inline const bool ReadBit() { return Bits.Read(DataStream.rdbuf(), 1) != 0; }
+		//	A malformed packet can hold more than the range allows; that is clamped to Max
+		inline const long ReadRanged(const long Min, const long Max)
+		{
+			const unsigned long Offset = ReadBits(BitsRequired((unsigned long)(Max - Min)));
+			return Offset > (unsigned long)(Max - Min) ? Max : Min + (long)Offset;
+		}
+		inline const float ReadQuantized(const float Min, const float Max, const unsigned char Count)
+		{
+			return Dequantize(ReadBits(Count), Min, Max, Count);
+		}
+		inline void ReadQuantizedVector(float& X, float& Y, float& Z, const float Min, const float Max, const unsigned char Count)
+		{
+			X = ReadQuantized(Min, Max, Count);
+			Y = ReadQuantized(Min, Max, Count);
+			Z = ReadQuantized(Min, Max, Count);
+		}
+		inline void ReadQuaternion(float& W, float& X, float& Y, float& Z, const unsigned char Count)
+		{
+			float Q[4];
+			const unsigned char Largest = (unsigned char)ReadBits(2);
+			float Sum = 0.0f;
+			for (unsigned char i = 0; i < 4; i++) {
+				if (i == Largest) { continue; }
+				Q[i] = ReadQuantized(-SmallestThreeLimit, SmallestThreeLimit, Count);
+				Sum += Q[i] * Q[i];
+			}
+			Q[Largest] = Sum < 1.0f ? std::sqrt(1.0f - Sum) : 0.0f;
+			W = Q[0]; X = Q[1]; Y = Q[2]; Z = Q[3];
+		}
 		// Get the packets data buffer
 		inline const auto GetData() const { return DataStream.rdbuf(); }
+		//	Bytes not read yet
+		inline const size_t GetRemaining() const { return (size_t)DataStream.rdbuf()->in_avail(); }
+		//	Copy everything not read yet into Out, which must hold GetRemaining() bytes
+		inline void ReadRemaining(char*const Out, const size_t Size) { Bits.Align(); DataStream.rdbuf()->sgetn(Out, (std::streamsize)Size); }
 		//	Get the creation time
 		inline const auto& GetCreationTime() const { return CreationTime; }
 		// Get the packets ID
@@ -1,156 +1,565 @@
 #pragma once
 #include "TimedEvent.hpp"
+#include "NetLock.hpp"
+#include "NetAckTracker.hpp"
+#include "NetRTT.hpp"
+#include "NetCongestion.hpp"
+#include "NetOperations.hpp"
+#include "NetAwait.hpp"
+#include "NetBatch.hpp"
 #include "Channel_KeepAlive.hpp"
 #include "Channel_Unreliable.hpp"
 #include "Channel_Reliable.hpp"
 #include "Channel_Ordered.hpp"
+#include "Channel_Snapshot.hpp"
+#include "Channel_FEC.hpp"
+#include "Channel_Keyed.hpp"
+#include "NetChannels.hpp"
 
 namespace PeerNet
 {
-	class NetPeer : public TimedEvent
+	//	Data channels a NetPeer<Channels...> carries, drained in the order given each tick
+	//	NetPeer<> carries every one of them
+	template <typename... Channels> struct PeerChannels { typedef ChannelTable<Channels...> Table; };
+	template <> struct PeerChannels<> { typedef ChannelTable<UnreliableChannel, ReliableChannel, OrderedChannel, SnapshotChannel, FECChannel, KeyedChannel> Table; };
+
+	//	Everything a peer does that doesn't depend on which channels it carries
+	//	PeerNet and NetPeerFactory only ever see a peer as one of these
+	class NetPeerBase : public TimedEvent
 	{
+		friend class PeerNet;
+		template <typename... ChannelSet> friend class NetPeer;
 		PeerNet* _PeerNet = nullptr;
 
 		NetAddress*const Address;
+		SlotHandle Handle = 0;	//	Our slot in PeerNet's peer slab; set by PeerNet once we're created
 
 		const long long RollingRTT;			//	Keep a rolling average of the last estimated 6 Round Trip Times
 											//	- That should equate to about 30 seconds worth of averaging with a 250ms average RTT
 		duration<double, std::milli> Avg_RTT;	//	Start the system off assuming a 300ms ping. Let the algorythms adjust from that point.
 
-		KeepAliveChannel* CH_KOL;
-		OrderedChannel* CH_Ordered;
-		ReliableChannel* CH_Reliable;
-		UnreliableChannel* CH_Unreliable;
+		AckTracker Acks;
+		RTTEstimator Estimator;
+		SendPacer Pacer;
 
+		KeepAliveChannel KOL;	//	Not part of any channel set; every peer keeps the connection alive
 		inline virtual void Tick() = 0;
 		inline virtual void Receive(ReceivePacket* Packet) = 0;
+		//	Called once per tick instead of Receive() while batched receive is on
+		//	Views are grouped by channel then operation, each group in the order it arrived
+		//	Their payloads share one arena that is released as soon as this returns
+		inline virtual void ReceiveBatch(const PacketView*const Views, const size_t Count) {}
 
 		std::deque<ReceivePacket*> ProcessingQueue_RAW;
+		std::deque<ReceivePacket*> Deferred;	//	Taken off a channel by Dispatch but not immediate; delivered first next tick
+		PeerMutex DispatchMutex;	//	Held while calling Receive(); keeps delivery in queue order whichever thread does it
+
+		std::atomic<bool> ImmediateDispatch;						//	Every operation is delivered from the receive thread
+		bool ImmediateOperations[PN_Keyed + 1][PN_MaxOperations];	//	Operations registered for immediate delivery, by channel
+		unsigned short MaxSizes[PN_Keyed + 1][PN_MaxOperations];	//	Most data an incoming packet of each operation may carry; 0 for no limit
+
+#ifdef PN_Coroutines
+		AwaiterList Waiters;	//	Coroutines waiting on this peer
+#endif
+
+		std::atomic<bool> Connected;		//	The remote side has answered our handshake or sent us data
+
+		//	Handshakes skip the channels and the send threads entirely
+		inline void SendHandshake(const HandshakeStage Stage, const unsigned long long Cookie)
+		{
+			Socket->SendStateless(Address->SockAddr(), HandshakePacket(Stage, Cookie));
+		}
+
+		//	A peer we know already can answer every stage straight away
+		inline void ReceiveHandshake(ReceivePacket*const Packet)
+		{
+			switch (Packet->GetOperationID())
+			{
+				case HS_Hello: SendHandshake(HS_Challenge, _PeerNet->IssueCookie(PeerKey(Address->SockAddr()))); break;
+				case HS_Challenge: SendHandshake(HS_Response, Packet->ReadData<unsigned long long>()); break;
+				case HS_Response: Connected.store(true); break;
+			}
+		}
+
+		std::atomic<bool> Batched;			//	Ticks hand ReceiveBatch everything at once
+		bool Gathering;						//	This tick is gathering a batch; guarded by DispatchMutex
+		PacketArena Arena;					//	Payloads of the batch being gathered
+		std::vector<PacketView> Batch;		//	In the order they were gathered
+		std::vector<PacketView> Sorted;		//	Grouped by operation
+
+		//	Copy a packets payload into the arena and add it to this ticks batch
+		inline void Gather(ReceivePacket*const Packet)
+		{
+			const size_t Size = Packet->GetRemaining();
+			char*const Data = Arena.Allocate(Size);
+			Packet->ReadRemaining(Data, Size);
+			Batch.push_back({ Packet->GetType(), Packet->GetOperationID(), Packet->GetPacketID(), Packet->GetCreationTime(), Data, Size });
+			delete Packet;
+		}
+
+		//	Hand the gathered batch to ReceiveBatch grouped by operation, then release it
+		//	A counting sort keeps each group in arrival order without allocating
+		inline void FlushBatch()
+		{
+			if (!Batch.empty())
+			{
+				size_t Offsets[(PN_Keyed + 1) * PN_MaxOperations + 1] = {};
+				for (auto& View : Batch) { ++Offsets[View.Channel * PN_MaxOperations + View.OperationID + 1]; }
+				for (size_t i = 1; i <= (PN_Keyed + 1) * PN_MaxOperations; i++) { Offsets[i] += Offsets[i - 1]; }
+				Sorted.resize(Batch.size());
+				for (auto& View : Batch) { Sorted[Offsets[View.Channel * PN_MaxOperations + View.OperationID]++] = View; }
+				ReceiveBatch(Sorted.data(), Sorted.size());
+			}
+			Batch.clear();
+			Arena.Reset();
+		}
+
+		//	Hand a packet to a coroutine waiting on its operation, otherwise to Receive()
+		//	Or into the batch, when this tick is gathering one
+		inline void Deliver(ReceivePacket*const Packet)
+		{
+#ifdef PN_Coroutines
+			if (Waiters.Take(Packet)) { return; }
+#endif
+			if (Gathering) { Gather(Packet); return; }
+			Receive(Packet);
+			//	Cleanup the ReceivePacket
+			delete Packet;
+		}
+
+		inline void OnExpire()
+		{
+			printf("\tClient Tick Expire\n");
+		}
+
+		//	Constructed only as part of a NetPeer<Channels...>, which registers the operations and starts ticking
+		inline NetPeerBase(PeerNet* PNInstance, NetSocket*const DefaultSocket, NetAddress*const NetAddr)
+			: _PeerNet(PNInstance), Address(NetAddr), Socket(DefaultSocket), RollingRTT(6), Avg_RTT(100),
+			Acks(Address, PNInstance->Polled()), Estimator(PNInstance->Polled()), Pacer(DefaultSocket, &Estimator, &Acks, new CongestionAIMD(), PNInstance->Polled()),
+			KOL(Address, PN_KeepAlive, &Acks, &Estimator, PNInstance->Polled()),
+			ProcessingQueue_RAW(), Deferred(), DispatchMutex(PNInstance->Polled()), ImmediateDispatch(false), ImmediateOperations(), MaxSizes(),
+#ifdef PN_Coroutines
+			Waiters(this),
+#endif
+			Connected(false), Batched(false), Gathering(false), Arena(), Batch(), Sorted(),
+			TimedEvent(std::chrono::milliseconds(100), 0)	//	Start with value of Avg_RTT
+		{}
+
+		//	Builds a packet on the channel carrying Type; nullptr if there is none or OP was never registered
+		inline virtual SendPacket* NewPacket(const PacketType Type, const unsigned long& OP, const unsigned long& Key) = 0;
+
+	public:
+		NetSocket*const Socket;
+
+		unsigned short FakePacketLoss = 0;	//	Percent of reliable, ordered, FEC and keyed packets dropped on arrival to emulate a lossy link
+
+		inline virtual void PrintChannelStats() = 0;
+
+		//	Destructor
+		inline virtual ~NetPeerBase()
+		{
+			for (auto Packet : Deferred) { delete Packet; }
+			printf("\tDisconnect Peer - %s\n", Address->FormattedAddress());
+			//	Return our NetAddress to the pool
+			_PeerNet->ReleaseAddress(Address);
+		}
+
+		//	Every Create*Packet returns nullptr if OP was never registered with PeerNet::RegisterOperation,
+		//	or if this peer's channel set leaves its channel out
+		//	Check before writing into it; Send_Packet accepts the nullptr and does nothing
+
+		//	Construct and return a reliable NetPacket to fill and send to this NetPeer
+		inline SendPacket* CreateOrderedPacket(const unsigned long& OP) { return NewPacket(PN_Ordered, OP, 0); }
+
+		//	Construct and return a reliable NetPacket to fill and send to this NetPeer
+		inline SendPacket* CreateReliablePacket(const unsigned long& OP) { return NewPacket(PN_Reliable, OP, 0); }
+
+		//	Construct and return a unreliable NetPacket to fill and send to this NetPeer
+		inline SendPacket* CreateUnreliablePacket(const unsigned long& OP) { return NewPacket(PN_Unreliable, OP, 0); }
+
+		//	Construct and return a forward error corrected NetPacket to fill and send to this NetPeer
+		//	Lost packets are rebuilt by the receiver from parity instead of being resent
+		inline SendPacket* CreateFECPacket(const unsigned long& OP) { return NewPacket(PN_FEC, OP, 0); }
+
+		//	Set how many parity packets are sent for every Data packets of an FEC operation
+		inline virtual void SetFECRatio(const unsigned long& OP, const unsigned char Data, const unsigned char Parity) = 0;
+
+		//	Construct and return a NetPacket to fill with the newest value of Key
+		//	Values written to the same key before the next tick replace each other; only the latest is sent
+		inline SendPacket* CreateKeyedPacket(const unsigned long& OP, const unsigned long& Key) { return NewPacket(PN_Keyed, OP, Key); }
+
+		//	Should the keys of an operation be resent until their newest value is acknowledged
+		inline virtual void SetKeyedReliable(const unsigned long& OP, const bool Reliable) = 0;
+
+		//	Construct and return a snapshot NetPacket to fill with state and send to this NetPeer
+		//	Only the difference from the last snapshot this NetPeer acknowledged goes out on the wire
+		inline SendPacket* CreateSnapshotPacket(const unsigned long& OP) { return NewPacket(PN_Snapshot, OP, 0); }
+
+		//	Deliver every operation to Receive() from the receive thread as soon as it arrives
+		//	Ordered operations still arrive in order and Receive() is never called twice at once
+		//	Receive() then competes with the socket for time, so keep it short
+		inline void SetImmediateDispatch(const bool Immediate) {
+			ImmediateDispatch.store(Immediate);
+		}
+		inline const bool ImmediateDispatching() const { return ImmediateDispatch.load(); }
+
+		//	Called by PeerNet once a stranger has echoed our handshake cookie
+		inline void Admit() { Connected.store(true); }
+
+		//	Has the remote side answered our handshake or sent us anything yet
+		inline const bool IsConnected() const { return Connected.load(); }
+
+		//	Hand each ticks packets to ReceiveBatch all at once instead of to Receive() one by one
+		//	Immediate operations and packets a coroutine is waiting on are still delivered on their own
+		inline void SetBatchedReceive(const bool Batch) {
+			Batched.store(Batch);
+		}
+
+		//	Called by PeerNet with every decompressed datagram from this peer
+		inline virtual void Receive_Packet(const string& IncomingData) = 0;
+		//	Hands a packet to its channel or straight to the socket; accepts the nullptr Create*Packet may give
+		inline virtual void Send_Packet(SendPacket* Packet) = 0;
+
+		//	Release whatever pacing has allowed since the last flush
+		//	Polled instances call this every Poll so paced packets aren't left waiting for the next tick or ACK
+		inline void PollPacer() { Pacer.Flush(); }
+
+		//	Swap the congestion controller used for this peer; takes ownership
+		inline void SetCongestionControl(CongestionControl*const Controller) { Pacer.SetController(Controller); }
+
+		//	Bytes of reliable and ordered packets sent to this peer again after being lost
+		inline const unsigned long long GetResentBytes() { return Pacer.GetResentBytes(); }
+
+		//	Cap the bandwidth used sending to this peer in bytes per second; 0 removes the cap
+		inline void SetRateLimit(const unsigned long BytesPerSecond, const unsigned long Burst = PN_MaxPacketSize * PN_PacingBurst) { Pacer.SetRateLimit(BytesPerSecond, Burst); }
+
+		//	Set the share of this peers bandwidth an operation receives relative to the others
+		inline void SetPriority(const PacketType Channel, const unsigned long OP, const unsigned short Weight) { Pacer.SetWeight(Channel, OP, Weight); }
+		inline void SetPriority(const PacketType Channel, const unsigned short Weight) { Pacer.SetWeight(Channel, Weight); }
+
+		inline const auto RTT_KOL() const { return Avg_RTT; }
+
+		//	Smoothed Round-Trip-Time and current retransmission timeout
+		inline const auto RTT() { return Estimator.RTT(); }
+		inline const auto RTO() const { return Estimator.RTO(); }
+
+		inline NetAddress*const GetAddress() const { return Address; }
+
+		//	Stays valid while we're connected; PeerNet::FindPeer turns it back into us
+		inline const SlotHandle GetHandle() const { return Handle; }
+
+		//	Peers, and every class derived from one, are allocated from a slab
+		//	Connection churn then keeps reusing the same memory instead of going back to the heap each time
+		inline static void* operator new(const size_t Size) { return BlockSlabs::Instance().Allocate(Size); }
+		inline static void operator delete(void*const Block, const size_t Size) { BlockSlabs::Instance().Release(Block, Size); }
+
+		//	Construct the response to a request made by CreateRequest, with its request ID carried back in front
+		//	Read that ID off the request first with ReadData<unsigned long>()
+		inline SendPacket* CreateResponse(const PacketType Channel, const unsigned long& OP, const unsigned long RequestID) {
+			SendPacket*const Packet = NewPacket(Channel, OP, 0);
+			if (Packet != nullptr) { Packet->WriteData(RequestID); }
+			return Packet;
+		}
+
+#ifdef PN_Coroutines
+		//	Awaitables for writing a session as a NetTask coroutine instead of switching on OperationID in Receive()
+		//	A zero Timeout waits forever; otherwise it is checked once per tick
+		//	Coroutines resume from this peer's tick, after its packets have been delivered and before Tick() is called
+		//	So they never run alongside each other, Receive(), ReceiveBatch() or Tick(), and need no locks of their own
+		//	They only resume straight away, on the destroying thread, when the peer goes away and they get Await_Closed
+
+		//	co_await NextPacket(Channel, OP) for the next packet of an operation; its Status says why if there isn't one
+		//	Packets nobody is waiting for still go to Receive(); the coroutine deletes the packets it gets
+		inline ReceiveAwaiter NextPacket(const PacketType Channel, const unsigned long OP, const steady_clock::duration& Timeout = steady_clock::duration::zero()) {
+			return ReceiveAwaiter(&Waiters, Channel, OP, Timeout);
+		}
+
+		//	Construct a request for Call, with a fresh request ID already written in front of its data
+		inline SendPacket* CreateRequest(const PacketType Channel, const unsigned long& OP) {
+			SendPacket*const Packet = NewPacket(Channel, OP, 0);
+			if (Packet != nullptr) { Packet->SetRequestID(Waiters.NextRequestID()); }
+			return Packet;
+		}
+
+		//	co_await Call(Request, Channel, OP) sends a Request from CreateRequest, then waits for the response made for it by CreateResponse
+		//	Only a response carrying our request ID is ours, so one arriving after its caller timed out never reaches the next caller
+		//	It goes to Receive() instead, ID still in front; the ID of the response we get has already been read off
+		//	A Request that didn't come from CreateRequest is sent and gives Await_Invalid straight away
+		inline ReceiveAwaiter Call(SendPacket*const Request, const PacketType Channel, const unsigned long OP, const steady_clock::duration& Timeout = steady_clock::duration::zero()) {
+			if (Request != nullptr && Request->GetRequestID() == 0) {
+				Send_Packet(Request);
+				ReceiveAwaiter Awaiter(&Waiters, Channel, OP, Timeout);
+				Awaiter.Ready = true;
+				return Awaiter;
+			}
+			ReceiveAwaiter Awaiter(&Waiters, Channel, OP, Timeout, Request, Request != nullptr ? Request->GetRequestID() : 0);
+			//	Create*Packet gave us nothing to send
+			Awaiter.Ready = Request == nullptr;
+			return Awaiter;
+		}
+
+		//	co_await SendConfirmed(Packet) sends Packet and gives Await_Confirmed once it is acknowledged, or Await_Timeout or Await_Closed
+		//	Only reliable and ordered packets are acknowledged one by one; anything else is sent and gives Await_Invalid straight away
+		//	A reliable packet also counts as acknowledged once a newer one of its operation is
+		inline ConfirmAwaiter SendConfirmed(SendPacket*const Packet, const steady_clock::duration& Timeout = steady_clock::duration::zero()) {
+			if (Packet != nullptr && Packet->GetType() != PN_Reliable && Packet->GetType() != PN_Ordered) {
+				Send_Packet(Packet);
+				return ConfirmAwaiter(&Waiters, nullptr, Timeout);
+			}
+			return ConfirmAwaiter(&Waiters, Packet, Timeout);
+		}
+#endif
+	};
+
+	//	A peer carrying only the data channels it is given, stored inline
+	//	Users derive their peer class from NetPeer<> for every channel, or from NetPeer<ReliableChannel, OrderedChannel> and so on
+	//	A channel left out takes no memory and its packet type is dropped on arrival like any unknown type
+	//	Everything channel specific below resolves at compile time through overloads; missing channels are never checked for
+	template <typename... ChannelSet>
+	class NetPeer : public NetPeerBase
+	{
+		//	Stored inline and drained in this order each tick
+		typename PeerChannels<ChannelSet...>::Table Channels;
+
+		//	Delete managed packets, and protect the tail of any partially filled FEC group that has waited too long to fill
+		inline void Collect(UnreliableChannel*const Channel) { Channel->DeleteUsed(); }
+		inline void Collect(SnapshotChannel*const Channel) { Channel->DeleteUsed(); }
+		inline void Collect(KeyedChannel*const Channel) { Channel->DeleteUsed(); }
+		inline void Collect(FECChannel*const Channel)
+		{
+			Channel->DeleteUsed();
+			std::vector<SendPacket*> Parity;
+			Channel->Flush(Parity);
+			for (auto Packet : Parity) { Pacer.Send(Packet); }
+		}
+		template <typename Channel> inline void Collect(Channel*const) {}
+
+		//	Resend unacknowledged packets whose retransmission timeout expired
+		//	And send the newest value of every key written this tick, plus any still waiting on an ACK
+		inline void Resend(ReliableChannel*const Channel) { Channel->ResendUnacknowledged(); }
+		inline void Resend(OrderedChannel*const Channel) { Channel->ResendUnacknowledged(); }
+		inline void Resend(KeyedChannel*const Channel)
+		{
+			std::vector<SendPacket*> Values;
+			Channel->Flush(Values);
+			for (auto Packet : Values) { Pacer.Send(Packet); }
+		}
+		template <typename Channel> inline void Resend(Channel*const) {}
+
+		//	Settings only some channels have
+		inline void Configure(OrderedChannel*const Channel, const OperationDescriptor& Descriptor) { Channel->SetWindow(Descriptor.ID, Descriptor.Window); }
+		inline void Configure(KeyedChannel*const Channel, const OperationDescriptor& Descriptor)
+		{
+			Channel->SetReliable(Descriptor.ID, Descriptor.Reliable);
+			if (Descriptor.MaxKeys > 0) { Channel->SetMaxKeys(Descriptor.ID, Descriptor.MaxKeys); }
+		}
+		inline void Configure(FECChannel*const Channel, const OperationDescriptor& Descriptor)
+		{
+			if (Descriptor.Data > 0 && Descriptor.Parity > 0) { Channel->SetRatio(Descriptor.ID, Descriptor.Data, Descriptor.Parity); }
+		}
+		template <typename Channel> inline void Configure(Channel*const, const OperationDescriptor&) {}
+
+		//	Each channel reads the part of an acknowledgement it needs; the rest never send any
+		inline void Acknowledge(ReliableChannel*const Channel, const unsigned long OP, const unsigned long Cumulative, const unsigned long Latest, const unsigned long long Mask, const unsigned short Window) { Channel->ACK(Latest, OP); }
+		inline void Acknowledge(OrderedChannel*const Channel, const unsigned long OP, const unsigned long Cumulative, const unsigned long Latest, const unsigned long long Mask, const unsigned short Window) { Channel->ACK(Cumulative, Latest, Mask, OP, Window); }
+		inline void Acknowledge(SnapshotChannel*const Channel, const unsigned long OP, const unsigned long Cumulative, const unsigned long Latest, const unsigned long long Mask, const unsigned short Window) { Channel->ACK(Latest, OP); }
+		inline void Acknowledge(KeyedChannel*const Channel, const unsigned long OP, const unsigned long Cumulative, const unsigned long Latest, const unsigned long long Mask, const unsigned short Window) { Channel->ACK(Latest, Mask, OP); }
+		template <typename Channel> inline void Acknowledge(Channel*const, const unsigned long, const unsigned long, const unsigned long, const unsigned long long, const unsigned short) {}
+
+		//	User filled packets of some channels don't go out as they are
+		//	Returns what should be sent in their place, or nullptr once the channel has taken care of them
+		//	User filled snapshots get swapped for their delta encoded form
+		inline SendPacket* Submit(SnapshotChannel*const Channel, SendPacket*const Packet) { return Channel->Encode(Packet); }
+		//	User filled FEC packets go out as a data shard, possibly followed by parity
+		inline SendPacket* Submit(FECChannel*const Channel, SendPacket*const Packet)
+		{
+			std::vector<SendPacket*> Shards;
+			Channel->Encode(Packet, Shards);
+			for (auto Shard : Shards) { Pacer.Send(Shard); }
+			Pacer.Flush();
+			return nullptr;
+		}
+		//	User filled keyed packets are held until the next tick coalesces them
+		inline SendPacket* Submit(KeyedChannel*const Channel, SendPacket*const Packet)
+		{
+			Channel->Write(Packet);
+			return nullptr;
+		}
+		template <typename Channel> inline SendPacket* Submit(Channel*const, SendPacket*const Packet) { return Packet; }
+
+		inline SendPacket* Create(KeyedChannel*const Channel, const unsigned long& OP, const unsigned long& Key) { return Channel->NewPacket(OP, Key); }
+		template <typename Channel> inline SendPacket* Create(Channel*const Target, const unsigned long& OP, const unsigned long&) { return Target->NewPacket(OP); }
+
+		//	The unreliable channel keeps no statistics
+		inline static void PrintStats(UnreliableChannel*const) {}
+		template <typename Channel> inline static void PrintStats(Channel*const Target) { Target->PrintStats(); }
+
+		inline SendPacket* NewPacket(const PacketType Type, const unsigned long& OP, const unsigned long& Key)
+		{
+			SendPacket* Packet = nullptr;
+			Channels.Visit(Type, [&](auto*const Channel) { Packet = this->Create(Channel, OP, Key); });
+			return Packet;
+		}
+
+		//	Deliver the immediate operations a channel has queued right away instead of waiting for the next tick
+		//	The channels other operations are set aside for the tick, still ahead of anything that arrives after them
+		//	Runs on the receive thread; Receive() is still never called twice at once for this peer
+		inline void Dispatch(const PacketType Channel)
+		{
+			const bool Everything = ImmediateDispatch.load();
+#ifdef _PERF_SPINLOCK
+			while (!DispatchMutex.try_lock()) {}
+#else
+			DispatchMutex.lock();
+#endif
+			Channels.SwapProcessingQueue(Channel, ProcessingQueue_RAW);
+			while (!ProcessingQueue_RAW.empty())
+			{
+				ReceivePacket* Packet = ProcessingQueue_RAW.front();
+				ProcessingQueue_RAW.pop_front();
+				const unsigned long OP = Packet->GetOperationID();
+				if (Everything || (OP < PN_MaxOperations && ImmediateOperations[Channel][OP])) { Deliver(Packet); }
+				else { Deferred.push_back(Packet); }
+			}
+			DispatchMutex.unlock();
+		}
+
+		//	Create the operation on its channel and apply its settings
+		inline void RegisterOperation(const OperationDescriptor& Descriptor)
+		{
+			bool Registered = false;
+			Channels.Visit(Descriptor.Channel, [&](auto*const Channel) {
+				Registered = Channel->Register(Descriptor.ID);
+				if (Registered) { this->Configure(Channel, Descriptor); }
+			});
+			if (!Registered) { printf("\tInvalid Operation %lu On Channel %u\n", Descriptor.ID, (unsigned int)Descriptor.Channel); return; }
+			if (Descriptor.Weight > 0) { Pacer.SetWeight(Descriptor.Channel, Descriptor.ID, Descriptor.Weight); }
+			ImmediateOperations[Descriptor.Channel][Descriptor.ID] = Descriptor.Immediate;
+			MaxSizes[Descriptor.Channel][Descriptor.ID] = Descriptor.MaxSize;
+		}
+
+		//	Hand the acknowledgements carried by an incoming packet to their channels
+		inline void ReceiveACKs(ReceivePacket*const IncomingPacket)
+		{
+			AckTracker::Read(IncomingPacket, [&](const PacketType Channel, const unsigned long OP,
+				const unsigned long Cumulative, const unsigned long Latest, const unsigned long long Mask, const unsigned short Window) {
+				Channels.Visit(Channel, [&](auto*const Target) { this->Acknowledge(Target, OP, Cumulative, Latest, Mask, Window); });
+#ifdef PN_Coroutines
+				Waiters.Confirm(Channel, OP, Cumulative, Latest, Mask);
+#endif
+			});
+		}
 
 		inline void OnTick()
 		{
+			//	Keeps us, and every packet we free, alive until this tick is over even if it disconnects us
+			EpochGuard Guard;
 			//	Check to see if this peer is no longer alive
-			//const unsigned long UnACK = CH_KOL->GetUnacknowledgedCount();
-			//printf("UnAck %zi\n", UnACK);
-			if (CH_KOL->GetUnacknowledgedCount() > 1000) {
+			if (KOL.GetUnacknowledgedCount() > 1000) {
 				_PeerNet->DisconnectPeer(this);
 			} else {
-				//	Keep a rolling average of the last 6 values returned by CH_KOL->RTT()
+				//	Keep a rolling average of the last 6 values returned by KOL.RTT()
 				//	This spreads our RTT up to about 30 seconds for a 250ms ping
 				//	And about 6 seconds for a 50ms ping
 				Avg_RTT -= Avg_RTT / RollingRTT;
-				Avg_RTT += CH_KOL->RTT() / RollingRTT;
+				Avg_RTT += KOL.RTT() / RollingRTT;
 
+				//	Keep saying hello until the remote side lets us in
+				if (!Connected.load()) { SendHandshake(HS_Hello, 0); }
 				//	Send a Keep-Alive
-				Send_Packet(CH_KOL->NewPacket());
+				else { Send_Packet(KOL.NewPacket()); }
 
 				//	Delete managed packets
-				CH_KOL->DeleteUsed();
-				CH_Unreliable->DeleteUsed();
-
+				KOL.DeleteUsed();
+				Channels.ForEach([&](auto*const Channel) { this->Collect(Channel); });
+				Acks.DeleteUsed();
+
+#ifdef PN_Coroutines
+				//	Give up on coroutines that waited too long
+				Waiters.Expire(steady_clock::now());
+#endif
 				//	Call Receive() on all our waiting-to-be-processed packets from each channel
-				CH_Unreliable->SwapProcessingQueue(ProcessingQueue_RAW);
-				while (!ProcessingQueue_RAW.empty())
-				{
-					ReceivePacket* Packet = ProcessingQueue_RAW.front();
-					//printf("Unreliable - %d - %s\tFrom Queue\n", Packet->GetPacketID(), Packet->ReadData<std::string>().c_str());
-					//	Loop through the queue and call Receive
-					Receive(Packet);
-					ProcessingQueue_RAW.pop_front();
-					//	Cleanup the ReceivePacket
-					delete Packet;
-
-				}
-				CH_Reliable->SwapProcessingQueue(ProcessingQueue_RAW);
-				while (!ProcessingQueue_RAW.empty())
+				DispatchMutex.lock();
+				Gathering = Batched.load();
+				//	What Dispatch set aside arrived before anything still queued on the channels
+				while (!Deferred.empty())
 				{
-					ReceivePacket* Packet = ProcessingQueue_RAW.front();
-					//printf("Reliable - %d - %s\tFrom Queue\n", Packet->GetPacketID(), Packet->ReadData<std::string>().c_str());
-					//	Loop through the queue and call Receive
-					Receive(Packet);
-					ProcessingQueue_RAW.pop_front();
-					//	Cleanup the ReceivePacket
-					delete Packet;
-
+					ReceivePacket* Packet = Deferred.front();
+					Deferred.pop_front();
+					Deliver(Packet);
 				}
-				CH_Ordered->SwapProcessingQueue(ProcessingQueue_RAW);
-				while (!ProcessingQueue_RAW.empty())
-				{
-					ReceivePacket* Packet = ProcessingQueue_RAW.front();
-					//printf("Ordered - %d - %s\tFrom Queue\n", Packet->GetPacketID(), Packet->ReadData<std::string>().c_str());
-					//	Loop through the queue and call Receive
-					Receive(Packet);
-					ProcessingQueue_RAW.pop_front();
-					//	Cleanup the ReceivePacket
-					delete Packet;
-
+				Channels.ForEach([&](auto*const Channel) {
+					Channel->SwapProcessingQueue(ProcessingQueue_RAW);
+					while (!ProcessingQueue_RAW.empty())
+					{
+						ReceivePacket* Packet = ProcessingQueue_RAW.front();
+						//	Loop through the queue and call Receive
+						ProcessingQueue_RAW.pop_front();
+						this->Deliver(Packet);
+					}
+				});
+				if (Gathering) {
+					FlushBatch();
+					Gathering = false;
 				}
+#ifdef PN_Coroutines
+				//	Coroutines run here and nowhere else, so never alongside Receive(), Tick() or each other
+				Waiters.ResumeReady();
+#endif
+				DispatchMutex.unlock();
 
 				//	Call derived classes Tick() method after all packets have been processed
 				Tick();
 
-				//	Resend all unacknowledged packets
-				CH_Reliable->ResendUnacknowledged(this->Socket);
-				CH_Ordered->ResendUnacknowledged(this->Socket);
+				//	Resend what went unacknowledged and send the keys written this tick
+				Channels.ForEach([&](auto*const Channel) { this->Resend(Channel); });
+				//	Release whatever the congestion window has room for
+				Pacer.Flush();
+				//	A peer that only ever receives still owes acknowledgements
+				SendPacket*const IdleACK = Acks.NewIdleACK();
+				if (IdleACK != nullptr) { Send_Packet(IdleACK); }
 			}
-		}
-		inline void NetPeer::OnExpire()
-		{
-			printf("\tClient Tick Expire\n");
+			//	Destroy packets and peers nobody can reach any more
+			EpochManager::Instance().Collect();
 		}
 
 	public:
-		NetSocket*const Socket;
-
-		bool FakePacketLoss = false;
-
-		inline void PrintChannelStats()
-		{
-			CH_Reliable->PrintStats();
-			CH_Ordered->PrintStats();
-		}
-
 		//	Constructor
 		inline NetPeer(PeerNet* PNInstance, NetSocket*const DefaultSocket, NetAddress*const NetAddr)
-			: _PeerNet(PNInstance), Address(NetAddr), Socket(DefaultSocket), RollingRTT(6), Avg_RTT(100),
-			CH_KOL(new KeepAliveChannel(Address, PN_KeepAlive)),
-			CH_Ordered(new OrderedChannel(Address, PN_Ordered)),
-			CH_Reliable(new ReliableChannel(Address, PN_Reliable)),
-			CH_Unreliable(new UnreliableChannel(Address, PN_Unreliable)),
-			TimedEvent(std::chrono::milliseconds(100), 0)	//	Start with value of Avg_RTT
+			: NetPeerBase(PNInstance, DefaultSocket, NetAddr), Channels(ChannelContext{ Address, &Acks, &Estimator, &Pacer, PNInstance->Polled() })
 		{
+			for (auto& Descriptor : PNInstance->GetOperations()) { RegisterOperation(Descriptor); }
 			//	Start the Keep-Alive sequence which will initiate the connection
-			this->StartTimer();
+			//	Polled instances tick us from PeerNet::Poll instead
+			if (!PNInstance->Polled()) { this->StartTimer(); }
+			else { this->StartPolling(); }
 			printf("\tConnect Peer - %s\n", Address->FormattedAddress());
 		}
 
 		//	Destructor
+		//	Our channels go before NetPeerBase does, so nothing may tick or resume into them past this point
 		inline virtual ~NetPeer()
 		{
 			this->StopTimer();
-			delete CH_KOL;
-			delete CH_Ordered;
-			delete CH_Reliable;
-			delete CH_Unreliable;
-			printf("\tDisconnect Peer - %s\n", Address->FormattedAddress());
-			//	Cleanup our NetAddress
-			//	TODO: Need to return this address back into the Unused Address Pool instead of deleting it
-			delete Address;
+#ifdef PN_Coroutines
+			Waiters.Cancel();
+#endif
 		}
 
-		//	Construct and return a reliable NetPacket to fill and send to this NetPeer
-		inline SendPacket* CreateOrderedPacket(const unsigned long& OP) {
-			return CH_Ordered->NewPacket(OP);
+		inline void PrintChannelStats()
+		{
+			Channels.ForEach([](auto*const Channel) { PrintStats(Channel); });
+			Pacer.PrintStats();
+			printf("Socket Dropped: %llu\n", Socket->GetDroppedCount());
+			printf("Datagrams Rejected: %llu\n", _PeerNet->GetRejectedCount());
 		}
 
-		//	Construct and return a reliable NetPacket to fill and send to this NetPeer
-		inline SendPacket* CreateReliablePacket(const unsigned long& OP) {
-			return CH_Reliable->NewPacket(OP);
+		inline void SetFECRatio(const unsigned long& OP, const unsigned char Data, const unsigned char Parity) {
+			Channels.template With<FECChannel>([&](FECChannel*const Channel) { Channel->SetRatio(OP, Data, Parity); });
 		}
 
-		//	Construct and return a unreliable NetPacket to fill and send to this NetPeer
-		inline SendPacket* CreateUnreliablePacket(const unsigned long& OP) {
-			return CH_Unreliable->NewPacket(OP);
+		inline void SetKeyedReliable(const unsigned long& OP, const bool Reliable) {
+			Channels.template With<KeyedChannel>([&](KeyedChannel*const Channel) { Channel->SetReliable(OP, Reliable); });
 		}
 
 		//	
@@ -162,82 +571,95 @@ namespace PeerNet
 			//	Instantiate a NetPacket from our decompressed data
 			ReceivePacket*const IncomingPacket = new ReceivePacket(IncomingData);
 
+			//	Handshakes carry no acknowledgements and never reach a channel
+			if (IncomingPacket->GetType() == PN_Handshake) {
+				ReceiveHandshake(IncomingPacket);
+				delete IncomingPacket;
+				return;
+			}
+			//	Anything else means they already know us
+			if (!Connected.load()) { Connected.store(true); }
+
+			//	Drop FakePacketLoss percent of the packets that get resent to simulate packet loss
+			if (FakePacketLoss && (IncomingPacket->GetType() == PN_Reliable || IncomingPacket->GetType() == PN_Ordered || IncomingPacket->GetType() == PN_FEC || IncomingPacket->GetType() == PN_Keyed)
+				&& (unsigned short)(rand() % 100) < FakePacketLoss)
+			{
+				delete IncomingPacket;
+				return;
+			}
+
+			//	Every packet starts with what its sender has received from us
+			ReceiveACKs(IncomingPacket);
+			//	Acknowledgements open up the congestion window
+			Pacer.Flush();
+
+			//	The channels consume the packet, so note where it was headed first
+			const PacketType Type = IncomingPacket->GetType();
+			const unsigned long OP = IncomingPacket->GetOperationID();
+
+			//	Anything bigger than its operation allows is dropped before a channel spends time on it
+			if (Type <= PN_Keyed && OP < PN_MaxOperations && MaxSizes[Type][OP] > 0 && IncomingPacket->GetRemaining() > MaxSizes[Type][OP]) {
+				delete IncomingPacket;
+				return;
+			}
+
 			//	Process the packet as needed
-			switch (IncomingPacket->GetType()) {
+			switch (Type) {
 
 			case PN_KeepAlive:
 			{
 				//	Process the incoming keep-alive
-				if (CH_KOL->Receive(IncomingPacket)) {
+				if (KOL.Receive(IncomingPacket)) {
 					//	Send an ACK if needed
-					Send_Packet(CH_KOL->NewACK(IncomingPacket, Address));
+					Send_Packet(KOL.NewACK(IncomingPacket, Address));
 				}
 				delete IncomingPacket;
 				break;
 			}
 
-			case PN_Unreliable: CH_Unreliable->Receive(IncomingPacket); break;
+				//	Dedicated acknowledgements carry nothing else
+			case PN_ACK: delete IncomingPacket; break;
 
-			case PN_Reliable:
-			{
-				//	If a random number between 1-10 equals another random number between 1-10
-				//	Drop the packet to simulate packet loss
-				if (FakePacketLoss && (rand() % 10 + 1) == 5)
-				{
-					delete IncomingPacket;
-					break;
-				}
-				//	Is this an ACK?
-				if (IncomingPacket->ReadData<bool>())
-				{
-					CH_Reliable->ACK(IncomingPacket->GetPacketID(), IncomingPacket->GetOperationID());
-					delete IncomingPacket;
-				}
-				else {
-					//	Send back an ACK
-					Send_Packet(CH_Reliable->NewACK(IncomingPacket, Address));
-					//	Process the packet
-					CH_Reliable->Receive(IncomingPacket); 
-					break;
+				//	Every data channel is a single jump away
+			default:
+				if (!Channels.Receive(Type, IncomingPacket)) {
+					printf("Recv Unknown Packet Type\n"); delete IncomingPacket;
 				}
-				break;
 			}
 
-				//	Ordered packeds need processed inside their Receive function
-			case PN_Ordered:
-			{
-				//	If a random number between 1-10 equals another random number between 1-10
-				//	Drop the packet to simulate packet loss
-				if (FakePacketLoss && (rand() % 10 + 1) == 5)
-				{
-					delete IncomingPacket;
-					break;
-				}
-				//	Is this an ACK?
-				if (IncomingPacket->ReadData<bool>())
-				{
-					CH_Ordered->ACK(IncomingPacket->GetPacketID(), IncomingPacket->GetOperationID());
-					delete IncomingPacket;
-				}
-				else {
-					//	Send back an ACK
-					Send_Packet(CH_Ordered->NewACK(IncomingPacket, Address));
-					//	Process the packet
-					CH_Ordered->Receive(IncomingPacket);
-				}
-				break;
+			//	Immediate operations don't wait for the next tick to reach Receive()
+			if (Type >= PN_Ordered && Type <= PN_Keyed && Type != PN_ACK && OP < PN_MaxOperations
+				&& (ImmediateDispatch.load() || ImmediateOperations[Type][OP])) {
+				Dispatch(Type);
 			}
 
-				//	Default case for unknown packet type
-			default: printf("Recv Unknown Packet Type\n"); delete IncomingPacket;
-			}
+			//	Acknowledgements normally ride along on outgoing packets
+			//	If nothing has gone out for a while send them on their own
+			SendPacket*const IdleACK = Acks.NewIdleACK();
+			if (IdleACK != nullptr) { Send_Packet(IdleACK); }
 		}
 		inline void Send_Packet(SendPacket* Packet) {
-			Socket->SendPacket(Packet);
+			//	Create*Packet returns nullptr for unregistered operations
+			if (Packet == nullptr) { return; }
+			Packet->FlushBits();
+			//	User filled packets only come from a channel in our set, so theirs is always found
+			if (!Packet->GetManaged()) {
+				Channels.Visit(Packet->GetType(), [&](auto*const Channel) { Packet = this->Submit(Channel, Packet); });
+				if (Packet == nullptr) { return; }
+			}
+			//	Control traffic always goes out immediately
+			if (Packet->GetType() == PN_KeepAlive || Packet->GetType() == PN_ACK) {
+				Acks.Write(Packet);
+				Socket->SendPacket(Packet);
+				return;
+			}
+			//	Everything else waits its turn
+			Pacer.Send(Packet);
+			Pacer.Flush();
 		}
-
-		inline const auto RTT_KOL() const { return Avg_RTT; }
-
-		inline NetAddress*const GetAddress() const { return Address; }
 	};
+
+#ifdef PN_Coroutines
+	inline void AwaiterList::Send(SendPacket*const Packet) { Owner->Send_Packet(Packet); }
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,238 @@
+#pragma once
+#include <atomic>
+
+#define PN_PeerShardBits 6		//	The peer table is split into 2^PN_PeerShardBits independently written shards
+#define PN_PeerShardBuckets 16	//	Buckets each shard starts with; must be a power of two
+
+namespace PeerNet
+{
+	//	Binary form of a remote IPv4 or IPv6 address and port
+	//	Compared and hashed directly instead of formatting a string for every datagram
+	struct PeerKey
+	{
+		unsigned long long Address[2];
+		unsigned short Port;
+		unsigned short Family;
+
+		inline PeerKey(const sockaddr*const Addr) : Address(), Port(0), Family(Addr->sa_family)
+		{
+			if (Family == AF_INET) {
+				const sockaddr_in*const In = (const sockaddr_in*)Addr;
+				Address[0] = In->sin_addr.s_addr;
+				Port = In->sin_port;
+			}
+			else if (Family == AF_INET6) {
+				const sockaddr_in6*const In6 = (const sockaddr_in6*)Addr;
+				std::memcpy(Address, &In6->sin6_addr, sizeof(Address));
+				Port = In6->sin6_port;
+			}
+		}
+		inline PeerKey(const SOCKADDR_INET*const Addr) : PeerKey((const sockaddr*)Addr) {}
+
+		inline const bool operator==(const PeerKey& Other) const
+		{
+			return Address[0] == Other.Address[0] && Address[1] == Other.Address[1] && Port == Other.Port && Family == Other.Family;
+		}
+
+		//	64 bit finalizer so every bit of the address and port reaches every bit of the hash
+		inline const unsigned long long Mix() const
+		{
+			unsigned long long H = Address[0] ^ (Address[1] * 0x9E3779B97F4A7C15ull) ^ ((unsigned long long)Port << 48) ^ Family;
+			H ^= H >> 33;
+			H *= 0xFF51AFD7ED558CCDull;
+			H ^= H >> 33;
+			H *= 0xC4CEB9FE1A85EC53ull;
+			H ^= H >> 33;
+			return H;
+		}
+	};
+
+	struct PeerKeyHash
+	{
+		inline size_t operator()(const PeerKey& Key) const { return (size_t)Key.Mix(); }
+	};
+
+	//
+	//	Peer Table
+	//	Maps remote addresses to their NetPeerBase for every received datagram
+	//	Each shard is a hash table of singly linked buckets; lookups pin the epoch, walk one bucket and never touch a mutex
+	//	Connecting links a single node onto the front of its bucket and disconnecting unlinks and retires it, both under the shard's mutex
+	//	A shard only copies its nodes when it outgrows its buckets, doubling them, so churn costs O(1) however many peers there are
+	//	Shards are picked by the high bits of the hash and buckets by the low bits so the two never correlate
+	class PeerTable
+	{
+		struct Node
+		{
+			const PeerKey Key;
+			NetPeerBase*const Peer;
+			std::atomic<Node*> Next;
+
+			inline Node(const PeerKey& K, NetPeerBase*const P, Node*const N) : Key(K), Peer(P), Next(N) {}
+		};
+
+		//	Owns every node still linked into it
+		struct Buckets
+		{
+			const size_t Mask;
+			std::atomic<Node*>*const Heads;
+
+			inline Buckets(const size_t Count) : Mask(Count - 1), Heads(new std::atomic<Node*>[Count])
+			{
+				for (size_t i = 0; i < Count; i++) { Heads[i].store(nullptr); }
+			}
+			inline ~Buckets()
+			{
+				for (size_t i = 0; i <= Mask; i++)
+				{
+					Node* Current = Heads[i].load();
+					while (Current != nullptr) { Node*const Next = Current->Next.load(); delete Current; Current = Next; }
+				}
+				delete[] Heads;
+			}
+
+			inline std::atomic<Node*>& Head(const PeerKey& Key) const { return Heads[Key.Mix() & Mask]; }
+		};
+
+		struct Shard
+		{
+			std::mutex Mutex;
+			std::atomic<const Buckets*> Table{ new Buckets(PN_PeerShardBuckets) };
+			size_t Count = 0;	//	Peers linked in; only touched with Mutex held
+		};
+		Shard Shards[1 << PN_PeerShardBits];
+
+		inline Shard& ShardOf(const PeerKey& Key) { return Shards[Key.Mix() >> (64 - PN_PeerShardBits)]; }
+
+		inline static Node*const Search(const Buckets*const Table, const PeerKey& Key)
+		{
+			for (Node* Current = Table->Head(Key).load(); Current != nullptr; Current = Current->Next.load())
+			{
+				if (Current->Key == Key) { return Current; }
+			}
+			return nullptr;
+		}
+
+		//	Rebuilds a shard with twice the buckets; must be called with its mutex held
+		//	Readers still walking the old buckets keep them until the epoch lets go
+		inline void Grow(Shard& S)
+		{
+			const Buckets*const Old = S.Table.load();
+			Buckets*const Bigger = new Buckets((Old->Mask + 1) * 2);
+			for (size_t i = 0; i <= Old->Mask; i++)
+			{
+				for (Node* Current = Old->Heads[i].load(); Current != nullptr; Current = Current->Next.load())
+				{
+					std::atomic<Node*>& Head = Bigger->Head(Current->Key);
+					Head.store(new Node(Current->Key, Current->Peer, Head.load()));
+				}
+			}
+			S.Table.store(Bigger);
+			Retire(Old);
+		}
+
+	public:
+		inline ~PeerTable()
+		{
+			for (auto& S : Shards) { delete S.Table.load(); }
+		}
+
+		//	Returns nullptr if no peer has this address
+		//	The peer itself is only safe to use while the caller keeps the epoch pinned
+		inline NetPeerBase*const Find(const PeerKey& Key)
+		{
+			EpochGuard Guard;
+			const Node*const Found = Search(ShardOf(Key).Table.load(), Key);
+			return Found == nullptr ? nullptr : Found->Peer;
+		}
+
+		//	Returns the peer with this address, calling Create() for it if there is none
+		//	Create runs at most once per address even when several threads race to connect it
+		//	Nothing is added if Create returns nullptr
+		template <typename Factory>
+		inline NetPeerBase*const FindOrCreate(const PeerKey& Key, Factory Create)
+		{
+			NetPeerBase* Found = Find(Key);
+			if (Found != nullptr) { return Found; }
+			Shard& S = ShardOf(Key);
+#ifdef _PERF_SPINLOCK
+			while (!S.Mutex.try_lock()) {}
+#else
+			S.Mutex.lock();
+#endif
+			const Node*const Existing = Search(S.Table.load(), Key);
+			if (Existing != nullptr) { Found = Existing->Peer; }
+			else {
+				Found = Create();
+				if (Found == nullptr) { S.Mutex.unlock(); return nullptr; }
+				//	Fully built before it's reachable; readers see either the old head or this node
+				std::atomic<Node*>& Head = S.Table.load()->Head(Key);
+				Head.store(new Node(Key, Found, Head.load()));
+				if (++S.Count > S.Table.load()->Mask + 1) { Grow(S); }
+			}
+			S.Mutex.unlock();
+			return Found;
+		}
+
+		//	Removes the address only while it still belongs to Peer
+		//	Returns false if it didn't
+		inline const bool Erase(const PeerKey& Key, NetPeerBase*const Peer)
+		{
+			Shard& S = ShardOf(Key);
+#ifdef _PERF_SPINLOCK
+			while (!S.Mutex.try_lock()) {}
+#else
+			S.Mutex.lock();
+#endif
+			//	Unlinking leaves the node's own Next alone, so a reader standing on it still finds the rest of the bucket
+			std::atomic<Node*>* Link = &S.Table.load()->Head(Key);
+			Node* Current = Link->load();
+			while (Current != nullptr && !(Current->Key == Key)) { Link = &Current->Next; Current = Link->load(); }
+			if (Current == nullptr || Current->Peer != Peer) { S.Mutex.unlock(); return false; }
+			Link->store(Current->Next.load());
+			--S.Count;
+			S.Mutex.unlock();
+			Retire(Current);
+			return true;
+		}
+
+		//	Empties every shard and returns the peers that were in them
+		//	Each shard is emptied under its mutex, so a peer is either returned or added afterwards, never lost in between
+		inline std::vector<NetPeerBase*> Clear()
+		{
+			std::vector<NetPeerBase*> Removed;
+			for (auto& S : Shards)
+			{
+#ifdef _PERF_SPINLOCK
+				while (!S.Mutex.try_lock()) {}
+#else
+				S.Mutex.lock();
+#endif
+				const Buckets*const Old = S.Table.load();
+				for (size_t i = 0; i <= Old->Mask; i++)
+				{
+					for (Node* Current = Old->Heads[i].load(); Current != nullptr; Current = Current->Next.load()) { Removed.push_back(Current->Peer); }
+				}
+				S.Table.store(new Buckets(PN_PeerShardBuckets));
+				S.Count = 0;
+				S.Mutex.unlock();
+				Retire(Old);
+			}
+			return Removed;
+		}
+
+		//	Calls Fn(NetPeerBase*) for every peer
+		template <typename Callback>
+		inline void ForEach(Callback Fn)
+		{
+			EpochGuard Guard;
+			for (auto& S : Shards)
+			{
+				const Buckets*const Table = S.Table.load();
+				for (size_t i = 0; i <= Table->Mask; i++)
+				{
+					for (Node* Current = Table->Heads[i].load(); Current != nullptr; Current = Current->Next.load()) { Fn(Current->Peer); }
+				}
+			}
+		}
+	};
+}
\ No newline at end of file
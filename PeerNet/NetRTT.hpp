@@ -0,0 +1,78 @@
+#pragma once
+
+#define PN_RTO_Initial 300		//	Milliseconds to wait before the first retransmission until we have an RTT sample
+#define PN_RTO_Min 20			//	Floor for the retransmission timeout in milliseconds
+#define PN_RTO_Max 3000			//	Ceiling for the retransmission timeout in milliseconds
+#define PN_RTO_MaxBackoff 6		//	A packet waits at most RTO * 2^PN_RTO_MaxBackoff between retransmissions
+#define PN_FastRetransmit 3		//	Newer packets acknowledged past a gap before the gap is resent early
+
+namespace PeerNet
+{
+	//
+	//	Round-Trip-Time estimator following RFC 6298
+	//	Fed by keep-alive ACKs and by acknowledged data packets which were only sent once (Karn's algorithm)
+	class RTTEstimator
+	{
+		PeerMutex Mutex;
+		bool HasSample;
+		double SRTT;	//	Smoothed Round-Trip-Time in milliseconds
+		double RTTVAR;	//	Round-Trip-Time variation in milliseconds
+		std::atomic<long long> RTO_Micro;	//	Current retransmission timeout in microseconds
+
+	public:
+		inline RTTEstimator(const bool Polled = false)
+			: Mutex(Polled), HasSample(false), SRTT(0), RTTVAR(0), RTO_Micro(PN_RTO_Initial * 1000) {}
+
+		//	Add a measured Round-Trip-Time
+		inline void Sample(const duration<double, std::milli>& RTT)
+		{
+			const double R = RTT.count();
+			if (R < 0) { return; }
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			if (!HasSample) {
+				SRTT = R;
+				RTTVAR = R / 2;
+				HasSample = true;
+			}
+			else {
+				RTTVAR = 0.75 * RTTVAR + 0.25 * std::fabs(SRTT - R);
+				SRTT = 0.875 * SRTT + 0.125 * R;
+			}
+			double Timeout = SRTT + (std::max)(1.0, 4 * RTTVAR);
+			if (Timeout < PN_RTO_Min) { Timeout = PN_RTO_Min; }
+			if (Timeout > PN_RTO_Max) { Timeout = PN_RTO_Max; }
+			RTO_Micro.store((long long)(Timeout * 1000));
+			Mutex.unlock();
+		}
+
+		//	Has this packet waited longer than its backed-off timeout since it was last sent
+		inline const bool RetransmitDue(const SendPacket*const Packet, const steady_clock::time_point& Now) const
+		{
+			return RetransmitDue(Packet->GetSendCount(), Packet->GetLastSent(), Now);
+		}
+
+		//	Same for anything else sent SendCount times, the last at LastSent
+		//	The timeout doubles with every resend after the first, up to PN_RTO_MaxBackoff times
+		inline const bool RetransmitDue(const unsigned char SendCount, const steady_clock::time_point& LastSent, const steady_clock::time_point& Now) const
+		{
+			const unsigned char Backoff = SendCount > 1 ? (std::min)((unsigned char)(SendCount - 1), (unsigned char)PN_RTO_MaxBackoff) : 0;
+			return Now - LastSent >= std::chrono::microseconds(RTO_Micro.load() << Backoff);
+		}
+
+		//	Smoothed Round-Trip-Time in milliseconds
+		inline const duration<double, std::milli> RTT()
+		{
+			Mutex.lock();
+			const duration<double, std::milli> Value(SRTT);
+			Mutex.unlock();
+			return Value;
+		}
+
+		//	Current retransmission timeout in milliseconds
+		inline const duration<double, std::milli> RTO() const { return duration<double, std::milli>(RTO_Micro.load() / 1000.0); }
+	};
+}
\ No newline at end of file
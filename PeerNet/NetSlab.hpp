@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#define PN_HandleIndexBits 20	//	Low bits of a handle pick its slot; the rest are the slots generation
+#define PN_SlabChunks 64		//	Most chunks a slab can grow to
+#define PN_BlockChunk 64		//	Blocks a block slab carves out of each chunk
+
+namespace PeerNet
+{
+	//	64 bit reference to a slab slot that goes stale once the slot is released
+	//	The generation gets the 44 bits above the index, so a stale handle can't come back to life by wrapping around
+	//	Zero is never handed out
+	typedef unsigned long long SlotHandle;
+
+	inline const SlotHandle MakeHandle(const unsigned long Index, const unsigned long long Generation) { return (Generation << PN_HandleIndexBits) | Index; }
+	inline const unsigned long HandleIndex(const SlotHandle Handle) { return (unsigned long)(Handle & ((1ull << PN_HandleIndexBits) - 1)); }
+
+	//	The generation a slot moves to once released; skips zero so no handle is ever zero
+	inline const unsigned long long NextGeneration(const unsigned long long Generation)
+	{
+		const unsigned long long Next = (Generation + 1) & ((1ull << (64 - PN_HandleIndexBits)) - 1);
+		return Next == 0 ? 1 : Next;
+	}
+
+	//
+	//	Handle Slab
+	//	Hands out generation tagged handles to objects owned elsewhere
+	//	Acquiring and releasing pop and push a free queue; looking a handle up never takes the mutex
+	//	Released slots go to the back of the queue, so a slot rests as long as possible before its next generation
+	//	Slots are added a chunk at a time and never move, so growing doesn't disturb readers
+	template <typename T>
+	class HandleSlab
+	{
+		struct Slot
+		{
+			std::atomic<T*> Object;
+			std::atomic<unsigned long long> Generation;
+		};
+
+		const unsigned long ChunkSize;
+		const bool Growable;
+		std::mutex Mutex;
+		std::atomic<Slot*> Chunks[PN_SlabChunks];
+		unsigned long ChunkCount;
+		std::deque<unsigned long> Free;	//	Released slots, reused first in first out
+
+		//	Must be called with Mutex held
+		inline const bool Grow()
+		{
+			if (ChunkCount == PN_SlabChunks || (ChunkCount + 1) * ChunkSize > (1ul << PN_HandleIndexBits)) { return false; }
+			Slot*const Chunk = new Slot[ChunkSize];
+			for (unsigned long i = 0; i < ChunkSize; i++) { Chunk[i].Object.store(nullptr); Chunk[i].Generation.store(1); }
+			Chunks[ChunkCount].store(Chunk);
+			for (unsigned long i = 0; i < ChunkSize; i++) { Free.push_back(ChunkCount * ChunkSize + i); }
+			++ChunkCount;
+			return true;
+		}
+
+		inline Slot*const SlotOf(const unsigned long Index) const
+		{
+			Slot*const Chunk = Chunks[Index / ChunkSize].load();
+			return Chunk == nullptr ? nullptr : &Chunk[Index % ChunkSize];
+		}
+
+	public:
+		//	Starts with one chunk of Size slots; a growable slab adds another whenever it fills up
+		inline HandleSlab(const size_t Size, const bool Grows = true)
+			: ChunkSize((std::max)((unsigned long)Size, 1ul)), Growable(Grows), Mutex(), Chunks(), ChunkCount(0), Free()
+		{
+			for (auto& Chunk : Chunks) { Chunk.store(nullptr); }
+			Grow();
+		}
+
+		inline ~HandleSlab()
+		{
+			for (auto& Chunk : Chunks) { delete[] Chunk.load(); }
+		}
+
+		//	Returns 0 if the slab is full and may not grow
+		inline const SlotHandle Acquire(T*const Object)
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			if (Free.empty() && (!Growable || !Grow())) { Mutex.unlock(); return 0; }
+			const unsigned long Index = Free.front();
+			Free.pop_front();
+			Mutex.unlock();
+			Slot*const S = SlotOf(Index);
+			S->Object.store(Object);
+			return MakeHandle(Index, S->Generation.load());
+		}
+
+		//	Points an acquired handle at its object; reserve a slot with Acquire(nullptr) before the object exists
+		inline void Assign(const SlotHandle Handle, T*const Object)
+		{
+			Slot*const S = SlotOf(HandleIndex(Handle));
+			if (S != nullptr && MakeHandle(HandleIndex(Handle), S->Generation.load()) == Handle) { S->Object.store(Object); }
+		}
+
+		//	Every copy of Handle is stale after this
+		//	Returns false if it already was
+		inline const bool Release(const SlotHandle Handle)
+		{
+			const unsigned long Index = HandleIndex(Handle);
+			if (Index / ChunkSize >= PN_SlabChunks) { return false; }
+			Slot*const S = SlotOf(Index);
+			if (S == nullptr) { return false; }
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			if (MakeHandle(Index, S->Generation.load()) != Handle) { Mutex.unlock(); return false; }
+			S->Generation.store(NextGeneration(S->Generation.load()));
+			S->Object.store(nullptr);
+			Free.push_back(Index);
+			Mutex.unlock();
+			return true;
+		}
+
+		//	Returns nullptr if Handle is stale
+		inline T*const Get(const SlotHandle Handle) const
+		{
+			const unsigned long Index = HandleIndex(Handle);
+			if (Index / ChunkSize >= PN_SlabChunks) { return nullptr; }
+			Slot*const S = SlotOf(Index);
+			if (S == nullptr) { return nullptr; }
+			T*const Object = S->Object.load();
+			return MakeHandle(Index, S->Generation.load()) == Handle ? Object : nullptr;
+		}
+	};
+	//
+	//	Block Slab
+	//	Raw memory for objects that all have the same size
+	//	Blocks are carved a chunk at a time and go on a free list once released, so allocating and freeing are O(1)
+	//	and a steady churn of objects keeps reusing the same memory; chunks are only given back with the slab
+	class BlockSlab
+	{
+		const size_t BlockSize;
+		std::mutex Mutex;
+		std::vector<char*> Chunks;
+		void* Free;	//	Each free block holds a pointer to the next
+
+	public:
+		inline BlockSlab(const size_t Size)
+			: BlockSize((((std::max)(Size, sizeof(void*)) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)) * alignof(std::max_align_t)),
+			Mutex(), Chunks(), Free(nullptr) {}
+
+		inline ~BlockSlab()
+		{
+			for (auto Chunk : Chunks) { ::operator delete(Chunk); }
+		}
+
+		inline const size_t GetSize() const { return BlockSize; }
+
+		//	Throws std::bad_alloc like new when a chunk can't be had
+		inline void*const Allocate()
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			if (Free == nullptr)
+			{
+				char*const Chunk = static_cast<char*>(::operator new(BlockSize * PN_BlockChunk, std::nothrow));
+				if (Chunk == nullptr) { Mutex.unlock(); throw std::bad_alloc(); }
+				Chunks.push_back(Chunk);
+				for (size_t i = PN_BlockChunk; i-- > 0;)
+				{
+					*reinterpret_cast<void**>(&Chunk[i * BlockSize]) = Free;
+					Free = &Chunk[i * BlockSize];
+				}
+			}
+			void*const Block = Free;
+			Free = *static_cast<void**>(Block);
+			Mutex.unlock();
+			return Block;
+		}
+
+		inline void Release(void*const Block)
+		{
+			if (Block == nullptr) { return; }
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			*static_cast<void**>(Block) = Free;
+			Free = Block;
+			Mutex.unlock();
+		}
+	};
+
+	//
+	//	Block Slabs
+	//	A block slab for every size of object allocated through it
+	//	A class routes its operator new and delete here so it and everything derived from it are slab allocated
+	//	Only a handful of sizes are ever seen, so finding the slab is a short scan
+	class BlockSlabs
+	{
+		std::mutex Mutex;
+		std::vector<BlockSlab*> Slabs;
+
+		inline BlockSlabs() : Mutex(), Slabs() {}
+
+		inline BlockSlab*const SlabOf(const size_t Size)
+		{
+#ifdef _PERF_SPINLOCK
+			while (!Mutex.try_lock()) {}
+#else
+			Mutex.lock();
+#endif
+			for (auto Slab : Slabs) {
+				if (Slab->GetSize() >= Size && Slab->GetSize() - Size < alignof(std::max_align_t)) { Mutex.unlock(); return Slab; }
+			}
+			BlockSlab*const Slab = new BlockSlab(Size);
+			Slabs.push_back(Slab);
+			Mutex.unlock();
+			return Slab;
+		}
+
+	public:
+		//	Never destroyed; objects retired at exit may still be freed after every static is gone
+		inline static BlockSlabs& Instance()
+		{
+			static BlockSlabs*const Slabs = new BlockSlabs();
+			return *Slabs;
+		}
+
+		inline void*const Allocate(const size_t Size) { return SlabOf(Size)->Allocate(); }
+		inline void Release(void*const Block, const size_t Size) { SlabOf(Size)->Release(Block); }
+	};
+}
\ No newline at end of file
@@ -99,23 +99,77 @@ namespace PeerNet
 		RIO_BUFFERID Data_BufferID_Send;
 		PCHAR const Data_Buffer_Send;
 		std::stack<thread> Threads_Send;
+		//	Polled
+		const bool Polled;								//	Driven by PeerNet::Poll instead of our own threads
+		ZSTD_DCtx* Decompression_Polled = nullptr;
+		ZSTD_CCtx* Compression_Polled = nullptr;
+		char* Uncompressed_Polled = nullptr;
+		std::deque<RIO_BUF_SEND*> Buffers_Polled;		//	Free send buffers
+		std::deque<::PeerNet::SendPacket*> Sends_Polled;	//	Packets waiting for the next Poll
 
 		//	Request Queue
 		RIO_RQ RequestQueue;
+
+		std::atomic<unsigned long long> Stats_Dropped;	//	Obsolete packets discarded before compression
+
+		//	Hand a received datagram to PeerNet, which decompresses it for its peer
+		inline void Deliver(const RIORESULT& Result, ZSTD_DCtx*const Context, char*const Uncompressed)
+		{
+			RIO_BUF_RECV* pBuffer = reinterpret_cast<RIO_BUF_RECV*>(Result.RequestContext);
+			_PeerNet->TranslateData(this, (SOCKADDR_INET*)&Address_Buffer_Receive[(size_t)pBuffer->pAddrBuff->Offset],
+				&Data_Buffer_Receive[(size_t)pBuffer->Offset], (size_t)Result.BytesTransferred, Context, Uncompressed);
+		}
+
+		//	Drop a packet nobody wants any more before it costs a buffer, compression and bandwidth
+		//	Returns true if it was dropped
+		inline const bool Discard(::PeerNet::SendPacket*const OutPacket)
+		{
+			if (!OutPacket->IsObsolete(std::chrono::steady_clock::now())) { return false; }
+			++Stats_Dropped;
+			Sent(OutPacket);
+			return true;
+		}
+
+		//	Compress a packet into a send buffer
+		//	Returns false if compression failed
+		inline const bool Compress(::PeerNet::SendPacket*const OutPacket, RIO_BUF_SEND*const pBuffer, ZSTD_CCtx*const Context)
+		{
+			const string Wire(OutPacket->GetWire());
+			pBuffer->Length = (ULONG)ZSTD_compressCCtx(Context,
+				&Data_Buffer_Send[(size_t)pBuffer->Offset], PN_MaxPacketSize, Wire.c_str(), Wire.size(), 1);
+			if (pBuffer->Length == 0) { printf("Packet Compression Failed - %i\n", pBuffer->Length); }
+			return pBuffer->Length > 0;
+		}
+
+		//	The packet has left our hands
+		//	Its peer may be destroyed the moment its address stops counting it, so that is the very last thing we touch
+		inline void Sent(::PeerNet::SendPacket*const OutPacket)
+		{
+			//	Mark packet as not sending
+			OutPacket->IsSending.store(0);
+			//	Mark managed SendPackets for cleanup
+			if (OutPacket->GetManaged())
+			{
+				OutPacket->NeedsDelete.store(1);
+			}
+			--OutPacket->GetAddress()->Sending;
+		}
+
 	public:
 
 		//
 		//	NetSocket Constructor
 		//
+		//	Polled sockets start no threads of their own
 		inline NetSocket(PeerNet* PNInstance, NetAddress* MyAddress) : _PeerNet(PNInstance), Address(MyAddress), RIO(_PeerNet->RIO()), RioMutex(),
 			Socket(WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, NULL, WSA_FLAG_REGISTERED_IO | WSA_FLAG_OVERLAPPED)),
-			ThreadCount_Receive(thread::hardware_concurrency()), ThreadCount_Send(thread::hardware_concurrency()),
+			ThreadCount_Receive(_PeerNet->Polled() ? 0 : thread::hardware_concurrency()), ThreadCount_Send(_PeerNet->Polled() ? 0 : thread::hardware_concurrency()),
 			IOCP_Receive(CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, ThreadCount_Receive)),
 			IOCP_Send(CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, ThreadCount_Send)),
 			Address_Buffer_Receive(new char[sizeof(SOCKADDR_INET)*PN_MaxReceivePackets]),
 			Data_Buffer_Receive(new char[PN_MaxPacketSize*PN_MaxReceivePackets]),
 			Data_Buffer_Send(new char[PN_MaxPacketSize*PN_MaxSendPackets]),
-			Buffers_Receive()
+			Buffers_Receive(), Polled(_PeerNet->Polled()), Buffers_Polled(), Sends_Polled(), Stats_Dropped(0)
 		{
 			//	Make sure our socket was created properly
 			if (Socket == INVALID_SOCKET) { printf("Socket Failed(%i)\n", WSAGetLastError()); }
@@ -124,10 +178,18 @@ namespace PeerNet
 			//	Create Receive Completion Queue
 			OVERLAPPED Overlap_Receive;
 			RIO_NOTIFICATION_COMPLETION Completion_Receive;
-			Completion_Receive.Type = RIO_IOCP_COMPLETION;
-			Completion_Receive.Iocp.IocpHandle = IOCP_Receive;
-			Completion_Receive.Iocp.CompletionKey = (void*)CK_RIO_RECV; //-V566
-			Completion_Receive.Iocp.Overlapped = &Overlap_Receive;
+			if (Polled) {
+				//	Signal the event the application waits on; Poll resets it
+				Completion_Receive.Type = RIO_EVENT_COMPLETION;
+				Completion_Receive.Event.EventHandle = _PeerNet->GetPollEvent();
+				Completion_Receive.Event.NotifyReset = FALSE;
+			}
+			else {
+				Completion_Receive.Type = RIO_IOCP_COMPLETION;
+				Completion_Receive.Iocp.IocpHandle = IOCP_Receive;
+				Completion_Receive.Iocp.CompletionKey = (void*)CK_RIO_RECV; //-V566
+				Completion_Receive.Iocp.Overlapped = &Overlap_Receive;
+			}
 			CompletionQueue_Receive = RIO.RIOCreateCompletionQueue(PN_MaxReceivePackets, &Completion_Receive);
 			if (CompletionQueue_Receive == RIO_INVALID_CQ) { printf("Create Receive Completion Queue Failed: %i\n", WSAGetLastError()); }
 			//	Create Send Completion Queue
@@ -137,7 +199,8 @@ namespace PeerNet
 			Completion_Send.Iocp.IocpHandle = IOCP_Send;
 			Completion_Send.Iocp.CompletionKey = (void*)CK_RIO_SEND; //-V566
 			Completion_Send.Iocp.Overlapped = &Overlap_Send;
-			CompletionQueue_Send = RIO.RIOCreateCompletionQueue(PN_MaxSendPackets, &Completion_Send);
+			//	Polled send completions are only ever collected by Poll itself
+			CompletionQueue_Send = RIO.RIOCreateCompletionQueue(PN_MaxSendPackets, Polled ? NULL : &Completion_Send);
 			if (CompletionQueue_Send == RIO_INVALID_CQ) { printf("Create Send Completion Queue Failed: %i\n", WSAGetLastError()); }
 
 			//	Create Request Queue
@@ -220,24 +283,9 @@ namespace PeerNet
 							//	Actually read the data from each received packet
 							for (ULONG CurResult = 0; CurResult < NumResults; CurResult++)
 							{
-								//	Get the raw packet data into our buffer
-								RIO_BUF_RECV* pBuffer = reinterpret_cast<RIO_BUF_RECV*>(CompletionResults[CurResult].RequestContext);
-
-								const size_t DecompressResult = ZSTD_decompressDCtx(Decompression_Context,
-									Uncompressed_Data, PN_MaxPacketSize, &Data_Buffer_Receive[(size_t)pBuffer->Offset],
-									(size_t)CompletionResults[CurResult].BytesTransferred);
-
-								//	Return if decompression fails
-								//	TODO: Should be < 0; Will randomly crash at 0 though.
-								if (DecompressResult < 1) {
-									printf("Receive Packet - Decompression Failed!\n"); continue;
-								}
-								//	Grab
-								//	"show" packet to peer for processing
-								//	
-
-								_PeerNet->TranslateData((SOCKADDR_INET*)&Address_Buffer_Receive[(size_t)pBuffer->pAddrBuff->Offset], std::string(Uncompressed_Data, DecompressResult));
+								Deliver(CompletionResults[CurResult], Decompression_Context, Uncompressed_Data);
 
+								RIO_BUF_RECV* pBuffer = reinterpret_cast<RIO_BUF_RECV*>(CompletionResults[CurResult].RequestContext);
 								RioMutex.lock();
 								//	Push another read request into the queue
 								if (!RIO.RIOReceiveEx(RequestQueue, pBuffer, 1, NULL, pBuffer->pAddrBuff, NULL, NULL, 0, pBuffer)) { printf("RIO Receive2 Failed\n"); }
@@ -335,6 +383,10 @@ namespace PeerNet
 						//	Start Sending Event
 						case CK_SEND:
 						{
+							//	Its channel may free the packet the moment we mark it sent; the epoch holds that off until we're done
+							::PeerNet::EpochGuard Guard;
+							::PeerNet::SendPacket* OutPacket = static_cast<::PeerNet::SendPacket*>(pOverlapped);
+							if (Discard(OutPacket)) { break; }
 							RIO_BUF_SEND*const pBuffer = MyBuffers->Pull();
 							//	If we are out of buffers push the request back out for another thread to pick up
 							if (pBuffer == nullptr) {
@@ -343,28 +395,14 @@ namespace PeerNet
 								}
 							break;
 							}
-							::PeerNet::SendPacket* OutPacket = static_cast<::PeerNet::SendPacket*>(pOverlapped);
-
-							//	Compress our outgoing packets data payload into the rest of the data buffer
-							pBuffer->Length = (ULONG)ZSTD_compressCCtx(Compression_Context,
-								&Data_Buffer_Send[(size_t)pBuffer->Offset], PN_MaxPacketSize, OutPacket->GetData()->str().c_str(), OutPacket->GetData()->str().size(), 1);
 
 							//	If compression was successful, actually transmit our packet
-							if (pBuffer->Length > 0) {
-								//printf("Compressed: %i->%i\n", SendPacket->GetData().size(), pBuffer->Length);
-
+							if (Compress(OutPacket, pBuffer, Compression_Context)) {
 								RioMutex.lock();
 								RIO.RIOSendEx(RequestQueue, pBuffer, 1, NULL, OutPacket->GetAddress(), NULL, NULL, NULL, pBuffer);
 								RioMutex.unlock();
 							}
-							else { printf("Packet Compression Failed - %i\n", pBuffer->Length); }
-							//	Mark packet as not sending
-							OutPacket->IsSending.store(0);
-							//	Mark managed SendPackets for cleanup
-							if (OutPacket->GetManaged())
-							{
-								OutPacket->NeedsDelete.store(1);
-							}
+							Sent(OutPacket);
 						}
 						break;
 
@@ -379,8 +417,24 @@ namespace PeerNet
 				}));
 			}
 
+			//	Polled sockets share every send buffer between themselves and Poll
+			if (Polled) {
+				Decompression_Polled = ZSTD_createDCtx();
+				Compression_Polled = ZSTD_createCCtx();
+				Uncompressed_Polled = new char[PN_MaxPacketSize];
+				for (unsigned long b = 0; b < PN_MaxSendPackets; b++)
+				{
+					RIO_BUF_SEND* pBuf = new RIO_BUF_SEND;
+					pBuf->BufferId = Data_BufferID_Send;
+					pBuf->Offset = SendOffset;
+					pBuf->Length = PN_MaxPacketSize;
+					pBuf->BufferContainer = nullptr;
+					Buffers_Polled.push_back(pBuf);
+					SendOffset += PN_MaxPacketSize;
+				}
+			}
 			//	Notify sends are ready
-			if (RIO.RIONotify(CompletionQueue_Send) != ERROR_SUCCESS) { printf("\tRIO Send Notify Failed\n"); }
+			else if (RIO.RIONotify(CompletionQueue_Send) != ERROR_SUCCESS) { printf("\tRIO Send Notify Failed\n"); }
 
 			//	Finally bind our socket so we can send/receive data
 			if (bind(Socket, Address->AddrInfo()->ai_addr, (int)Address->AddrInfo()->ai_addrlen) == SOCKET_ERROR)
@@ -410,6 +464,20 @@ namespace PeerNet
 			//	Wait for each send/receive thread to exit
 			while (!Threads_Receive.empty()) { Threads_Receive.top().join(); Threads_Receive.pop(); }
 			while (!Threads_Send.empty()) { Threads_Send.top().join(); Threads_Send.pop(); }
+			//	Release sends nobody got to; their peers are held until we do
+			DWORD Bytes = 0;
+			ULONG_PTR Key = 0;
+			LPOVERLAPPED Overlapped = nullptr;
+			while (GetQueuedCompletionStatus(IOCP_Send, &Bytes, &Key, &Overlapped, 0)) {
+				if (Key == CK_SEND) { Sent(static_cast<::PeerNet::SendPacket*>(Overlapped)); }
+			}
+			for (auto OutPacket : Sends_Polled) { Sent(OutPacket); }
+			//	Buffers posted since the last Poll only come back through the completion queue
+			if (Polled) { ReclaimPolled(); }
+			for (auto Buff : Buffers_Polled) { delete Buff; }
+			if (Decompression_Polled != nullptr) { ZSTD_freeDCtx(Decompression_Polled); }
+			if (Compression_Polled != nullptr) { ZSTD_freeCCtx(Compression_Polled); }
+			delete[] Uncompressed_Polled;
 			//	Close each send/receive completion queue
 			RIO.RIOCloseCompletionQueue(CompletionQueue_Receive);
 			RIO.RIOCloseCompletionQueue(CompletionQueue_Send);
@@ -436,16 +504,98 @@ namespace PeerNet
 			closesocket(Socket);
 
 			printf("\tShutdown Socket - %s\n", Address->FormattedAddress());
-			//	Cleanup our NetAddress
-			//	TODO: Need to return this address back into the Unused Address Pool instead of deleting it
-			delete Address;
+			//	Return our NetAddress to the pool
+			_PeerNet->ReleaseAddress(Address);
 		}
 
+		//	Obsolete packets the send threads discarded
+		inline const unsigned long long GetDroppedCount() const { return Stats_Dropped.load(); }
+
+		//	Sends a serialized packet straight from the calling thread with a plain sendto
+		//	Needs no registered buffer or address slot, so answering a stranger leaves nothing behind to clean up
+		inline void SendStateless(const sockaddr*const To, const string& Data)
+		{
+			char Compressed[PN_MaxPacketSize];
+			const size_t Length = ZSTD_compress(Compressed, PN_MaxPacketSize, Data.c_str(), Data.size(), 1);
+			if (ZSTD_isError(Length)) { printf("Stateless Compression Failed\n"); return; }
+			const int ToLength = To->sa_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+			if (sendto(Socket, Compressed, (int)Length, 0, To, ToLength) == SOCKET_ERROR) {
+				printf("Stateless Send Error: %i\n", WSAGetLastError());
+			}
+		}
+
+		//	The packet's address counts it until Sent, which keeps its peer from being destroyed underneath us
 		inline void SendPacket(SendPacket* Packet)
 		{
+			++Packet->GetAddress()->Sending;
+			Packet->MarkSent();
+			//	Polled sockets hold sends until the next Poll flushes them together
+			if (Polled) { Sends_Polled.push_back(Packet); return; }
 			if (PostQueuedCompletionStatus(IOCP_Send, NULL, CK_SEND, Packet) == 0) {
 				printf("PostQueuedCompletionStatus Error: %i\n", GetLastError());
 			}
 		}
+
+		//	Polled sockets only; called from PeerNet::Poll
+		//	Delivers up to Budget received datagrams to their peers and returns how many it did
+		//	Anything left over keeps the poll event signaled
+		inline const unsigned long PollReceive(const unsigned long Budget)
+		{
+			RIORESULT CompletionResults[RIO_ResultsPerThread];
+			unsigned long Delivered = 0;
+			while (Delivered < Budget)
+			{
+				const ULONG NumResults = RIO.RIODequeueCompletion(CompletionQueue_Receive, CompletionResults,
+					(std::min)((ULONG)RIO_ResultsPerThread, (ULONG)(Budget - Delivered)));
+				if (NumResults == 0 || NumResults == RIO_CORRUPT_CQ) { break; }
+				for (ULONG CurResult = 0; CurResult < NumResults; CurResult++)
+				{
+					Deliver(CompletionResults[CurResult], Decompression_Polled, Uncompressed_Polled);
+					//	Push another read request into the queue
+					RIO_BUF_RECV* pBuffer = reinterpret_cast<RIO_BUF_RECV*>(CompletionResults[CurResult].RequestContext);
+					if (!RIO.RIOReceiveEx(RequestQueue, pBuffer, 1, NULL, pBuffer->pAddrBuff, NULL, NULL, 0, pBuffer)) { printf("RIO Receive2 Failed\n"); }
+				}
+				Delivered += NumResults;
+			}
+			//	Signals straight away if completions are still waiting
+			RIO.RIONotify(CompletionQueue_Receive);
+			return Delivered;
+		}
+
+		//	Polled sockets only; returns the send buffers of finished sends to Buffers_Polled
+		inline void ReclaimPolled()
+		{
+			RIORESULT CompletionResults[RIO_ResultsPerThread];
+			ULONG NumResults;
+			while ((NumResults = RIO.RIODequeueCompletion(CompletionQueue_Send, CompletionResults, RIO_ResultsPerThread)) > 0 && NumResults != RIO_CORRUPT_CQ) {
+				for (ULONG CurResult = 0; CurResult < NumResults; CurResult++) {
+					Buffers_Polled.push_back(reinterpret_cast<RIO_BUF_SEND*>(CompletionResults[CurResult].RequestContext));
+				}
+			}
+		}
+
+		//	Polled sockets only; called from PeerNet::Poll
+		//	Reclaims finished send buffers then compresses and posts every waiting send with a single commit
+		inline void PollSend()
+		{
+			ReclaimPolled();
+			bool Deferred = false;
+			::PeerNet::EpochGuard Guard;
+			while (!Sends_Polled.empty() && !Buffers_Polled.empty())
+			{
+				::PeerNet::SendPacket*const OutPacket = Sends_Polled.front();
+				Sends_Polled.pop_front();
+				if (Discard(OutPacket)) { continue; }
+				RIO_BUF_SEND*const pBuffer = Buffers_Polled.front();
+				if (Compress(OutPacket, pBuffer, Compression_Polled)) {
+					Buffers_Polled.pop_front();
+					RIO.RIOSendEx(RequestQueue, pBuffer, 1, NULL, OutPacket->GetAddress(), NULL, NULL, RIO_MSG_DEFER, pBuffer);
+					Deferred = true;
+				}
+				Sent(OutPacket);
+			}
+			//	Out of buffers; the rest wait for the next Poll
+			if (Deferred) { RIO.RIOSendEx(RequestQueue, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL); }
+		}
 	};
 }
\ No newline at end of file
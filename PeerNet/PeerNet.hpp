@@ -24,6 +24,7 @@
 #include <mutex>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 //#define _DEBUG_COMPRESSION
 //#define _DEBUG_THREADS
@@ -33,6 +34,8 @@
 //#define _DEBUG_PACKETS_UNRELIABLE
 //#define _DEBUG_PACKETS_RELIABLE_ACK
 //#define _DEBUG_PACKETS_ORDERED_ACK
+//#define _DEBUG_PACKETS_SNAPSHOT
+//#define _DEBUG_PACKETS_FEC
 
 //	Performance Tuning
 //#define _PERF_SPINLOCK	//	Higher CPU Usage for more responsive packet handling; lower latencies
@@ -47,15 +50,41 @@ namespace PeerNet
 		PN_Ordered = 1,
 		PN_Reliable = 2,
 		PN_Unreliable = 3,
+		PN_Snapshot = 4,
+		PN_ACK = 5,
+		PN_FEC = 6,
+		PN_Keyed = 7,
+		PN_Handshake = 8,
 		PN_NotInialized = 1001
 	};
-	class NetPeer;
+
+	//	Declares an operation before any traffic uses it
+	//	A channel only sends and accepts the OperationIDs registered for it
+	struct OperationDescriptor
+	{
+		PacketType Channel;
+		unsigned long ID;				//	Must be below PN_MaxOperations
+		unsigned short Weight = 0;		//	Share of a peers bandwidth relative to other operations; 0 keeps the channel default
+		bool Reliable = false;			//	Keyed operations resend each key until its newest value is acknowledged
+		unsigned char Data = 0;			//	FEC data packets per group; 0 keeps the default
+		unsigned char Parity = 0;		//	FEC parity packets per group; 0 keeps the default
+		bool Immediate = false;			//	Deliver to Receive() from the receive thread instead of on the next tick
+		//	Limits
+		unsigned short MaxSize = 0;		//	Incoming packets carrying more than this many bytes of data are dropped unread; 0 for no limit
+		unsigned short Window = 0;		//	Ordered packets held waiting on a gap or to be processed; 0 keeps PN_OrderedWindow
+		unsigned long MaxKeys = 0;		//	Keys a keyed operation tracks for the remote side; packets bringing more are dropped; 0 keeps PN_KeyedMaxKeys
+	};
+	class NetPeerBase;
 	class NetSocket;
 	class NetPeerFactory;
 }
 
+#include "NetSlab.hpp"
 #include "NetAddress.hpp"
 #include "NetPacket.hpp"
+#include "NetEpoch.hpp"
+#include "NetPeerTable.hpp"
+#include "NetHandshake.hpp"
 
 namespace PeerNet
 {
@@ -67,22 +96,64 @@ namespace PeerNet
 		AddressPool* Addresses = nullptr;
 
 		std::unordered_map<string, NetSocket*const> Sockets;
-		std::unordered_map<string, NetPeer*const> Peers;
+		PeerTable Peers;
+		HandleSlab<NetPeerBase> PeerSlots;	//	Handles applications can hold on to without keeping a peer alive
 
 		std::mutex SocketMutex;
-		std::mutex PeerMutex;
 
 		NetSocket* DefaultSocket = nullptr;
 		NetPeerFactory* _PeerFactory;
 
+		std::vector<OperationDescriptor> Operations;	//	Registered with every peer as it is created
+
+		const bool PollMode;	//	No internal threads; the application calls Poll
+		HANDLE PollEvent;		//	Signaled when a polled socket has received something
+
+		std::atomic<bool> Closing;	//	Set by the destructor; no more peers are created
+
+		HandshakeGate Gate;								//	Proves a stranger can receive at the address it claims and bounds how fast they're answered and let in
+		std::atomic<unsigned long long> Stats_Rejected;	//	Datagrams that were malformed or came from strangers that got no peer
+
+		//	Takes an address from the pool and creates a peer for it
+		//	Returns nullptr if the pool is exhausted
+		inline NetPeerBase*const CreatePeer(const SOCKADDR_INET*const AddrBuff);
+
+		//	Everything a peer needs once it's out of the table
+		inline void Disconnected(NetPeerBase*const Peer);
+
+		//	Answers a datagram from an address without a peer
+		//	Nothing is allocated for the sender until it echoes a valid cookie back
+		inline void Handshake(NetSocket*const Socket, const SOCKADDR_INET*const AddrBuff, const string& IncomingData);
+
 	public:
 
-		inline PeerNet(NetPeerFactory* PeerFactory, size_t MaxPeers, size_t MaxSockets);
+		//	Polled instances never start a thread of their own
+		//	Everything, from sending to Receive() and Tick(), then happens on the thread calling Poll
+		inline PeerNet(NetPeerFactory* PeerFactory, size_t MaxPeers, size_t MaxSockets, const bool Polled = false);
 		inline ~PeerNet();
 
+		inline const bool Polled() const { return PollMode; }
+
+		//	Polled instances only
+		//	Signaled whenever Poll has received datagrams to process
+		//	Wait on it alongside the applications own handles to sleep until there's network work
+		inline HANDLE GetPollEvent() const { return PollEvent; }
+
+		//	Polled instances only; call once per frame
+		//	Delivers up to Budget received datagrams, ticks every peer that is due, then flushes every send in one batch per socket
+		//	Returns how many datagrams were delivered
+		inline const unsigned long Poll(const unsigned long Budget);
+
 		//	Sets the default socket used by new peers
 		inline void SetDefaultSocket(NetSocket* Socket) { DefaultSocket = Socket; }
 
+		//	Declare an operation for every peer created from now on
+		//	Call before opening sockets or discovering peers; existing peers are not updated
+		inline void RegisterOperation(const OperationDescriptor& Descriptor) { Operations.push_back(Descriptor); }
+
+		//	Every operation peers should register
+		inline const std::vector<OperationDescriptor>& GetOperations() const { return Operations; }
+
 		//	Returns access to the RIO Function Table
 		inline RIO_EXTENSION_FUNCTION_TABLE& RIO() { return g_rio; }
 
@@ -93,16 +164,31 @@ namespace PeerNet
 		//	Need DisconnectPeer/CloseSocket to properly cleanup our internal containers
 		//	Or split those functions up into their respective files
 		//	And let their respective classes destructors handle it <--
-		inline void DisconnectPeer(NetPeer*const Peer);
+		inline void DisconnectPeer(NetPeerBase*const Peer);
 
-		//	Takes raw incoming uncompressed data and an address buffer
-		//	Gets a peer from the buffer and passes the data to them for processing
-		inline void TranslateData(const SOCKADDR_INET*const AddrBuff, const string& IncomingData);
+		//	Takes a raw incoming datagram, still compressed, the socket it arrived on and an address buffer
+		//	Decompresses it into Uncompressed, which holds PN_MaxPacketSize bytes, and passes it to the peer at that address
+		//	or to the handshake if there isn't one; anything malformed is dropped and counted as rejected
+		inline void TranslateData(NetSocket*const Socket, const SOCKADDR_INET*const AddrBuff, const char*const Compressed, const size_t Size, ZSTD_DCtx*const Context, char*const Uncompressed);
+
+		//	Handshake cookie for a remote address
+		inline const unsigned long long IssueCookie(const PeerKey& Remote) const { return Gate.Issue(Remote); }
+
+		//	Malformed datagrams, and datagrams from unknown addresses that were dropped or rate limited
+		inline const unsigned long long GetRejectedCount() const { return Stats_Rejected.load(); }
 
 		//	Gets an existing peer from a provided AddrBuff
-		//	Creates a new peer if one does not exist
-		inline NetPeer*const GetPeer(const SOCKADDR_INET*const AddrBuff);
-		inline NetPeer*const GetPeer(string IP, string Port);
+		//	Creates a new peer if one does not exist; only the handshake should call this for remote initiated peers
+		inline NetPeerBase*const GetPeer(const SOCKADDR_INET*const AddrBuff);
+		inline NetPeerBase*const GetPeer(string IP, string Port);
+
+		//	Gets the peer a handle from NetPeerBase::GetHandle refers to
+		//	Returns nullptr once that peer has disconnected, even if its slot went to another peer since
+		//	The caller must hold an EpochGuard for as long as it uses the peer; a disconnect only retires it, and it's destroyed once no thread is pinned
+		inline NetPeerBase*const FindPeer(const SlotHandle Handle) const { return PeerSlots.Get(Handle); }
+
+		//	Hands an address back to the pool once its peer or socket is done with it
+		inline void ReleaseAddress(NetAddress*const Address) { Addresses->ReleaseAddress(Address); }
 	};
 }
 
@@ -112,16 +198,17 @@ namespace PeerNet
 namespace PeerNet
 {
 	//	Base NetPeer Factory Class
-	//	Users can provide their own peer class as long as it inherits from NetPeer
+	//	Users can provide their own peer class as long as it inherits from NetPeer<Channels...>
 	class NetPeerFactory
 	{
 	public:
-		inline virtual NetPeer* Create(PeerNet* PNInstance, NetSocket*const DefaultSocket, NetAddress*const NetAddr) = 0;
+		inline virtual NetPeerBase* Create(PeerNet* PNInstance, NetSocket*const DefaultSocket, NetAddress*const NetAddr) = 0;
 	};
 
 
-	inline PeerNet::PeerNet(NetPeerFactory* PeerFactory, size_t MaxPeers, size_t MaxSockets)
-		: _PeerFactory(PeerFactory) {
+	inline PeerNet::PeerNet(NetPeerFactory* PeerFactory, size_t MaxPeers, size_t MaxSockets, const bool Polled)
+		: PeerSlots(MaxPeers), _PeerFactory(PeerFactory), PollMode(Polled), PollEvent(Polled ? CreateEvent(NULL, TRUE, FALSE, NULL) : NULL),
+		Closing(false), Gate(), Stats_Rejected(0) {
 		printf("Initializing PeerNet\n");
 		SetPriorityClass(GetCurrentProcess(), ABOVE_NORMAL_PRIORITY_CLASS);
 		//	Startup WinSock 2.2
@@ -155,84 +242,135 @@ namespace PeerNet
 	inline PeerNet::~PeerNet()
 	{
 		printf("Deinitializing PeerNet\n");
-		for (auto Peer : Peers) {
-			delete Peer.second;
-		}
+		//	Peers stop ticking before the sockets they send on go away, and no handshake can create another
+		//	Receive threads may still be inside one, so they're retired rather than deleted
+		Closing.store(true);
+		for (auto Peer : Peers.Clear()) { Disconnected(Peer); }
+		//	Joins every receive and send thread and lets go of any send still queued
 		for (auto Socket : Sockets) {
 			delete Socket.second;
 		}
-		WSACleanup();
+		//	Now nothing can reach a peer or be sending to one, so every one of them is destroyed here, before their addresses are
+		EpochManager::Instance().Synchronize();
+		//	Registered address buffers are deregistered before WinSock goes away
 		delete Addresses;
+		WSACleanup();
+		if (PollEvent != NULL) { CloseHandle(PollEvent); }
 		printf("Deinitialization Complete\n");
 	}
-	inline void PeerNet::TranslateData(const SOCKADDR_INET*const AddrBuff, const string& IncomingData)
+	inline const unsigned long PeerNet::Poll(const unsigned long Budget)
 	{
-		GetPeer(AddrBuff)->Receive_Packet(IncomingData);
+		if (!PollMode) { return 0; }
+		//	Reset before draining; anything arriving from here on signals again
+		ResetEvent(PollEvent);
+		unsigned long Delivered = 0;
+		for (auto Socket : Sockets) {
+			Delivered += Socket.second->PollReceive(Budget - Delivered);
+		}
+		const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+		Peers.ForEach([&](NetPeerBase*const Peer) { Peer->PollPacer(); Peer->PollTimer(Now); });
+		for (auto Socket : Sockets) {
+			Socket.second->PollSend();
+		}
+		EpochManager::Instance().Collect();
+		return Delivered;
 	}
-	inline void PeerNet::DisconnectPeer(NetPeer*const Peer)
+	inline void PeerNet::TranslateData(NetSocket*const Socket, const SOCKADDR_INET*const AddrBuff, const char*const Compressed, const size_t Size, ZSTD_DCtx*const Context, char*const Uncompressed)
 	{
-		auto it = Peers.find(Peer->GetAddress()->GetFormatted());
-		if (it != Peers.end())
-		{
-#ifdef _PERF_SPINLOCK
-			while (!PeerMutex.try_lock()) {}
-#else
-			PeerMutex.lock();
-#endif
-			Peers.erase(it);
-			PeerMutex.unlock();
-			delete Peer;
+		//	The peer may be disconnected meanwhile; the epoch keeps it alive until we're done with it
+		EpochGuard Guard;
+		NetPeerBase*const Peer = Peers.Find(PeerKey(AddrBuff));
+		//	Strangers can only be handshaking, and zstd records how big a frame decompresses to in its header
+		//	Anything else from them is dropped before a single byte of it is decompressed
+		if (Peer == nullptr && (Size > ZSTD_compressBound(HandshakeSize()) || ZSTD_getFrameContentSize(Compressed, Size) != HandshakeSize())) {
+			++Stats_Rejected; return;
 		}
+		const size_t Length = ZSTD_decompressDCtx(Context, Uncompressed, PN_MaxPacketSize, Compressed, Size);
+		if (ZSTD_isError(Length) || Length < ReceivePacket::HeaderSize()) { ++Stats_Rejected; return; }
+		if (Peer != nullptr) { Peer->Receive_Packet(string(Uncompressed, Length)); }
+		else { Handshake(Socket, AddrBuff, string(Uncompressed, Length)); }
 	}
-	inline NetPeer*const PeerNet::GetPeer(const SOCKADDR_INET*const AddrBuff)
+	inline void PeerNet::Handshake(NetSocket*const Socket, const SOCKADDR_INET*const AddrBuff, const string& IncomingData)
 	{
-		//	Check if we already have a connected object with this address
-		//const string Formatted(IP + string(":") + Port);
-		const string Formatted(inet_ntoa(AddrBuff->Ipv4.sin_addr) + std::string(":") + std::to_string(ntohs(AddrBuff->Ipv4.sin_port)));
-		auto it = Peers.find(Formatted);
-		if (it != Peers.end())
+		//	Handshakes are always the same size; anything else is dropped before it's parsed
+		if (IncomingData.size() != HandshakeSize()) { ++Stats_Rejected; return; }
+		ReceivePacket Packet(IncomingData);
+		if (Packet.GetType() != PN_Handshake) { ++Stats_Rejected; return; }
+		const PeerKey Remote(AddrBuff);
+		switch (Packet.GetOperationID())
 		{
-			return it->second;	//	Already have a connected object for this ip/port
-		}
-		else {
-			//NetAddress* NewAddr = Addresses->FreeAddress(AddrBuff);
-			NetAddress*const NewAddr = Addresses->FreeAddress();
-			NewAddr->Resolve(string(inet_ntoa(AddrBuff->Ipv4.sin_addr)), string(std::to_string(ntohs(AddrBuff->Ipv4.sin_port))));
-			Addresses->WriteAddress(NewAddr);
-			NetPeer*const ThisPeer = _PeerFactory->Create(this, DefaultSocket, NewAddr);
-#ifdef _PERF_SPINLOCK
-			while (!PeerMutex.try_lock()) {}
-#else
-			PeerMutex.lock();
-#endif
-			Peers.emplace(Formatted, ThisPeer);
-			PeerMutex.unlock();
-			return ThisPeer;
+			case HS_Hello:
+				//	Answer statelessly; the cookie is all we'll remember of them
+				{
+					unsigned long long Cookie = 0;
+					if (!Gate.Hello(Remote, Cookie)) { ++Stats_Rejected; return; }
+					Socket->SendStateless((const sockaddr*)AddrBuff, HandshakePacket(HS_Challenge, Cookie));
+				}
+				break;
+			case HS_Response:
+				//	They received our challenge at this address; let them in
+				//	Echoing the Response back tells them they're in
+				{
+					const unsigned long long Cookie = Packet.ReadData<unsigned long long>();
+					if (!Gate.Response(Remote, Cookie)) { ++Stats_Rejected; return; }
+					NetPeerBase*const Peer = GetPeer(AddrBuff);
+					if (Peer == nullptr) { ++Stats_Rejected; return; }
+					Peer->Admit();
+					Socket->SendStateless((const sockaddr*)AddrBuff, HandshakePacket(HS_Response, Cookie));
+				}
+				break;
+			default:
+				++Stats_Rejected;
 		}
 	}
-	inline NetPeer*const PeerNet::GetPeer(string IP, string Port)
+	inline void PeerNet::DisconnectPeer(NetPeerBase*const Peer)
+	{
+		if (Peers.Erase(PeerKey(Peer->GetAddress()->SockAddr()), Peer)) { Disconnected(Peer); }
+	}
+	inline void PeerNet::Disconnected(NetPeerBase*const Peer)
+	{
+		PeerSlots.Release(Peer->GetHandle());
+		Peer->StopTimer();
+		//	Receive threads may still be inside it, and sockets may still hold packets it owns
+		//	It's destroyed once no thread can reach it and its address has no sends outstanding
+		Retire(Peer, &Peer->GetAddress()->Sending);
+	}
+	inline NetPeerBase*const PeerNet::GetPeer(const SOCKADDR_INET*const AddrBuff)
 	{
 		//	Check if we already have a connected object with this address
-		const string Formatted(IP + string(":") + Port);
-		auto it = Peers.find(Formatted);
-		if (it != Peers.end())
-		{
-			return it->second;	//	Already have a connected object for this ip/port
-		}
-		else {
-			NetAddress*const NewAddr = Addresses->FreeAddress();
-			NewAddr->Resolve(IP, Port);
-			Addresses->WriteAddress(NewAddr);
-			NetPeer*const ThisPeer = _PeerFactory->Create(this, DefaultSocket, NewAddr);
-#ifdef _PERF_SPINLOCK
-			while (!PeerMutex.try_lock()) {}
-#else
-			PeerMutex.lock();
-#endif
-			Peers.emplace(Formatted, ThisPeer);
-			PeerMutex.unlock();
-			return ThisPeer;
-		}
+		return Peers.FindOrCreate(PeerKey(AddrBuff), [&]() { return CreatePeer(AddrBuff); });
+	}
+	inline NetPeerBase*const PeerNet::GetPeer(string IP, string Port)
+	{
+		//	Resolve the host so it matches the binary address its datagrams arrive from
+		addrinfo Hint;
+		ZeroMemory(&Hint, sizeof(Hint));
+		Hint.ai_family = AF_INET;
+		Hint.ai_socktype = SOCK_DGRAM;
+		Hint.ai_protocol = IPPROTO_UDP;
+		addrinfo* Result = nullptr;
+		if (getaddrinfo(IP.c_str(), Port.c_str(), &Hint, &Result) != 0) { printf("GetPeer GetAddrInfo Failed %i\n", WSAGetLastError()); return nullptr; }
+		SOCKADDR_INET Resolved;
+		ZeroMemory(&Resolved, sizeof(Resolved));
+		std::memcpy(&Resolved, Result->ai_addr, (std::min)((size_t)Result->ai_addrlen, sizeof(Resolved)));
+		freeaddrinfo(Result);
+		//	Check if we already have a connected object with this address
+		return Peers.FindOrCreate(PeerKey(&Resolved), [&]() { return CreatePeer(&Resolved); });
+	}
+	inline NetPeerBase*const PeerNet::CreatePeer(const SOCKADDR_INET*const AddrBuff)
+	{
+		if (Closing.load()) { return nullptr; }
+		//	Reserve the handle first; a peer starts ticking as soon as it's constructed, so it can't simply be deleted again
+		const SlotHandle Handle = PeerSlots.Acquire(nullptr);
+		if (Handle == 0) { printf("Peer Slab Exhausted\n"); return nullptr; }
+		NetAddress*const NewAddr = Addresses->FreeAddress();
+		if (NewAddr == nullptr) { PeerSlots.Release(Handle); return nullptr; }
+		NewAddr->Assign(AddrBuff);
+		NetPeerBase*const Peer = _PeerFactory->Create(this, DefaultSocket, NewAddr);
+		if (Peer == nullptr) { Addresses->ReleaseAddress(NewAddr); PeerSlots.Release(Handle); return nullptr; }
+		Peer->Handle = Handle;
+		PeerSlots.Assign(Handle, Peer);
+		return Peer;
 	}
 	//	Creates a socket and starts listening at the specified IP and Port
 	//	Returns socket if it already exists
@@ -247,6 +385,7 @@ namespace PeerNet
 		}
 		else {
 			NetAddress*const NewAddr = Addresses->FreeAddress();
+			if (NewAddr == nullptr) { return nullptr; }
 			NewAddr->Resolve(IP, Port);
 			NetSocket*const ThisSocket = new NetSocket(this, NewAddr);
 #ifdef _PERF_SPINLOCK
@@ -0,0 +1,242 @@
+#pragma once
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define PN_TaskDequeSize 256	//	Starting capacity of each worker's deque; must be a power of two
+
+//	A unit of work for the TaskExecutor
+//	Owned by whoever submitted it; the executor only calls Run
+struct ExecutorTask
+{
+	inline virtual void Run() = 0;
+	inline virtual ~ExecutorTask() {}
+};
+
+//
+//	Chase-Lev Work-Stealing Deque
+//	The owning worker pushes and takes at the bottom without locking
+//	Any other worker may steal from the top, racing only on a single compare-exchange
+//	Outgrown buffers are kept until the deque is destroyed since a thief may still be reading one
+class TaskDeque
+{
+	struct Buffer
+	{
+		const long long Mask;
+		std::unique_ptr<std::atomic<ExecutorTask*>[]> Tasks;
+
+		inline Buffer(const long long Size) : Mask(Size - 1), Tasks(new std::atomic<ExecutorTask*>[Size]) {}
+		inline ExecutorTask*const Get(const long long i) const { return Tasks[i & Mask].load(std::memory_order_relaxed); }
+		inline void Put(const long long i, ExecutorTask*const Task) { Tasks[i & Mask].store(Task, std::memory_order_relaxed); }
+	};
+
+	std::atomic<long long> Top;
+	std::atomic<long long> Bottom;
+	std::atomic<Buffer*> Current;
+	std::vector<std::unique_ptr<Buffer>> Buffers;	//	Every buffer ever used
+
+public:
+	inline TaskDeque() : Top(0), Bottom(0), Current(nullptr), Buffers()
+	{
+		Buffers.emplace_back(new Buffer(PN_TaskDequeSize));
+		Current.store(Buffers.back().get());
+	}
+
+	//	Owner only
+	inline void Push(ExecutorTask*const Task)
+	{
+		const long long B = Bottom.load(std::memory_order_relaxed);
+		const long long T = Top.load(std::memory_order_acquire);
+		Buffer* Buf = Current.load(std::memory_order_relaxed);
+		if (B - T > Buf->Mask)
+		{
+			//	Full; double the capacity
+			Buffer*const Grown = new Buffer((Buf->Mask + 1) * 2);
+			for (long long i = T; i < B; i++) { Grown->Put(i, Buf->Get(i)); }
+			Buffers.emplace_back(Grown);
+			Current.store(Grown, std::memory_order_release);
+			Buf = Grown;
+		}
+		Buf->Put(B, Task);
+		std::atomic_thread_fence(std::memory_order_release);
+		Bottom.store(B + 1, std::memory_order_relaxed);
+	}
+
+	//	Owner only; newest first
+	//	Returns nullptr when empty
+	inline ExecutorTask*const Take()
+	{
+		const long long B = Bottom.load(std::memory_order_relaxed) - 1;
+		Buffer*const Buf = Current.load(std::memory_order_relaxed);
+		Bottom.store(B, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long T = Top.load(std::memory_order_relaxed);
+		if (T > B) {
+			Bottom.store(B + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		ExecutorTask* Task = Buf->Get(B);
+		if (T == B)
+		{
+			//	Last one; race the thieves for it
+			if (!Top.compare_exchange_strong(T, T + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { Task = nullptr; }
+			Bottom.store(B + 1, std::memory_order_relaxed);
+		}
+		return Task;
+	}
+
+	//	Any thread; oldest first
+	//	Returns nullptr when empty or when another thread won the race
+	inline ExecutorTask*const Steal()
+	{
+		long long T = Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const long long B = Bottom.load(std::memory_order_acquire);
+		if (T >= B) { return nullptr; }
+		ExecutorTask*const Task = Current.load(std::memory_order_acquire)->Get(T);
+		if (!Top.compare_exchange_strong(T, T + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { return nullptr; }
+		return Task;
+	}
+};
+
+//
+//	Task Executor
+//	A pool of workers that balance load by stealing from each other
+//	Tasks submitted from outside the pool are dealt round robin into each worker's inbox
+//	Tasks submitted by a worker go on its own deque and run there unless someone idle steals them
+//	A task is only ever run by one worker; anything that must not run concurrently with itself
+//	just has to avoid being submitted again before it finishes
+class TaskExecutor
+{
+	struct Worker
+	{
+		TaskDeque Deque;
+		std::mutex InboxMutex;
+		std::deque<ExecutorTask*> Inbox;	//	Tasks handed over from outside the pool
+		std::thread Thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> Workers;
+	std::atomic<unsigned long> NextInbox;
+	std::atomic<long long> Queued;		//	Tasks submitted and not yet picked up
+	std::atomic<unsigned long> Sleepers;
+	std::mutex SleepMutex;
+	std::condition_variable SleepCondition;
+	std::atomic<bool> Abort;
+
+	//	The worker the calling thread is, if any
+	inline static Worker*& Self()
+	{
+		static thread_local Worker* Current = nullptr;
+		return Current;
+	}
+
+	inline ExecutorTask*const Find(Worker*const Me, const size_t Index)
+	{
+		ExecutorTask* Task = Me->Deque.Take();
+		if (Task != nullptr) { return Task; }
+		//	Move our inbox onto our deque so others can steal from it
+		Me->InboxMutex.lock();
+		std::deque<ExecutorTask*> Inbox;
+		Inbox.swap(Me->Inbox);
+		Me->InboxMutex.unlock();
+		if (!Inbox.empty())
+		{
+			for (auto Pending : Inbox) { Me->Deque.Push(Pending); }
+			return Me->Deque.Take();
+		}
+		//	Steal, starting with our neighbour so thieves spread out
+		for (size_t i = 1; i < Workers.size(); i++)
+		{
+			Worker*const Victim = Workers[(Index + i) % Workers.size()].get();
+			Task = Victim->Deque.Steal();
+			if (Task != nullptr) { return Task; }
+			//	A busy worker may not have gotten to its inbox yet
+			Victim->InboxMutex.lock();
+			if (!Victim->Inbox.empty()) {
+				Task = Victim->Inbox.front();
+				Victim->Inbox.pop_front();
+			}
+			Victim->InboxMutex.unlock();
+			if (Task != nullptr) { return Task; }
+		}
+		return nullptr;
+	}
+
+	inline void Work(const size_t Index)
+	{
+		Worker*const Me = Workers[Index].get();
+		Self() = Me;
+		while (true)
+		{
+			ExecutorTask*const Task = Find(Me, Index);
+			if (Task != nullptr)
+			{
+				--Queued;
+				Task->Run();
+				continue;
+			}
+			std::unique_lock<std::mutex> Lock(SleepMutex);
+			++Sleepers;
+			SleepCondition.wait(Lock, [&]() { return Abort.load() || Queued.load() > 0; });
+			--Sleepers;
+			if (Abort.load()) { return; }
+		}
+	}
+
+	//	Wake a sleeping worker if there is one
+	inline void Wake()
+	{
+		if (Sleepers.load() == 0) { return; }
+		SleepMutex.lock();
+		SleepMutex.unlock();
+		SleepCondition.notify_one();
+	}
+
+	inline TaskExecutor() : Workers(), NextInbox(0), Queued(0), Sleepers(0), SleepMutex(), SleepCondition(), Abort(false)
+	{
+		const unsigned int WorkerCount = (std::max)(2u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < WorkerCount; i++) { Workers.emplace_back(new Worker()); }
+		for (unsigned int i = 0; i < WorkerCount; i++) { Workers[i]->Thread = std::thread([this, i]() { Work(i); }); }
+	}
+
+public:
+	inline ~TaskExecutor()
+	{
+		SleepMutex.lock();
+		Abort.store(true);
+		SleepMutex.unlock();
+		SleepCondition.notify_all();
+		for (auto& W : Workers) { W->Thread.join(); }
+	}
+
+	//	Every TimedEvent shares this one
+	inline static TaskExecutor& Instance()
+	{
+		static TaskExecutor Executor;
+		return Executor;
+	}
+
+	inline const size_t WorkerCount() const { return Workers.size(); }
+
+	//	Queue a task to run on some worker
+	inline void Submit(ExecutorTask*const Task)
+	{
+		Worker*const Me = Self();
+		if (Me != nullptr) { Me->Deque.Push(Task); }
+		else
+		{
+			Worker*const To = Workers[NextInbox++ % Workers.size()].get();
+			To->InboxMutex.lock();
+			To->Inbox.push_back(Task);
+			To->InboxMutex.unlock();
+		}
+		++Queued;
+		Wake();
+	}
+};
\ No newline at end of file
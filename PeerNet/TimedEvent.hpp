@@ -1,63 +1,344 @@
 #pragma once
 #define WIN32_LEAN_AND_MEAN
-#include <windows.h>	// SetThreadPriority 
+#include <windows.h>	// CreateWaitableTimer, SetThreadPriority
 #include <thread>				// std::thread
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "TaskExecutor.hpp"
+
+#define PN_TimerBits 8			//	The inner wheel has 2^PN_TimerBits one millisecond slots
+#define PN_TimerOuterBits 6		//	Each of the two outer wheels has 2^PN_TimerOuterBits slots
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
 
 using std::chrono::milliseconds;
 using std::chrono::duration;
 using std::thread;
 
+class TimedEvent;
+
+//	A single scheduled TimedEvent
+//	Shared between its event and the wheel; whichever lets go last deletes it
+//	Handed to the TaskExecutor each time it comes due, and only put back in the wheel once it has run
+//	so its owner never ticks on two workers at once
+struct TimerEntry : public ExecutorTask
+{
+	TimedEvent*const Owner;
+	std::atomic<long long> Interval;	//	Milliseconds between ticks
+	unsigned long long Due;				//	Wheel millisecond it fires at
+	TimerEntry* Next;					//	Next entry in the same slot
+	std::atomic<bool> Cancelled;
+	std::atomic<unsigned char> Refs;
+	std::mutex RunMutex;				//	Held while the owner is ticking
+	std::atomic<std::thread::id> Worker;	//	Thread currently ticking the owner
+
+	inline TimerEntry(TimedEvent*const Event, const long long Milliseconds)
+		: Owner(Event), Interval(Milliseconds), Due(0), Next(nullptr), Cancelled(false), Refs(2), RunMutex(), Worker() {}
+
+	inline void Run();
+};
+
+//
+//	Timer Wheel
+//	Drives every TimedEvent in the process from one waitable timer thread and the TaskExecutor's workers
+//	Instead of a thread per event sleeping in a loop
+//	Three hashed wheels cover 1ms, 256ms and 16s slots; inserting and cancelling are O(1)
+//	Entries move inward as their outer slot comes up and are handed to the workers once due
+class TimerWheel
+{
+	std::mutex Mutex;
+	TimerEntry* Inner[1 << PN_TimerBits];
+	TimerEntry* Outer[2][1 << PN_TimerOuterBits];
+	unsigned long long Current;		//	Last millisecond processed
+	unsigned long long NextWake;	//	Millisecond the timer is armed for
+	const std::chrono::steady_clock::time_point Start;
+
+	TaskExecutor& Executor;
+	HANDLE Timer;
+	std::atomic<bool> Abort;
+
+	thread Driver;
+
+	inline const unsigned long long Now() const
+	{
+		return std::chrono::duration_cast<milliseconds>(std::chrono::steady_clock::now() - Start).count();
+	}
+
+	inline void Release(TimerEntry*const Entry)
+	{
+		if (--Entry->Refs == 0) { delete Entry; }
+	}
+
+	//	Wake the driver at the given millisecond
+	inline void Arm(const unsigned long long When)
+	{
+		NextWake = When;
+		const unsigned long long Time = Now();
+		LARGE_INTEGER Due;
+		//	Relative times are negative and in 100 nanosecond units
+		Due.QuadPart = When > Time ? -(LONGLONG)((When - Time) * 10000) : -1;
+		SetWaitableTimer(Timer, &Due, 0, NULL, NULL, FALSE);
+	}
+
+	//	Place an entry in the slot its Due time falls in
+	//	Must be called with Mutex held
+	inline void Insert(TimerEntry*const Entry)
+	{
+		if (Entry->Due <= Current) { Entry->Due = Current + 1; }
+		const unsigned long long Delta = Entry->Due - Current;
+		TimerEntry** Slot;
+		if (Delta < (1ull << PN_TimerBits)) {
+			Slot = &Inner[Entry->Due & ((1 << PN_TimerBits) - 1)];
+		}
+		else if (Delta < (1ull << (PN_TimerBits + PN_TimerOuterBits))) {
+			Slot = &Outer[0][(Entry->Due >> PN_TimerBits) & ((1 << PN_TimerOuterBits) - 1)];
+		}
+		else {
+			//	Anything further out waits in the last slot and gets reinserted when it comes up
+			const unsigned long long Furthest = Current + (1ull << (PN_TimerBits + 2 * PN_TimerOuterBits)) - 1;
+			Slot = &Outer[1][((std::min)(Entry->Due, Furthest) >> (PN_TimerBits + PN_TimerOuterBits)) & ((1 << PN_TimerOuterBits) - 1)];
+		}
+		Entry->Next = *Slot;
+		*Slot = Entry;
+	}
+
+	//	Reinsert every entry of an outer slot against the current time
+	inline void Cascade(TimerEntry*& Slot)
+	{
+		TimerEntry* Entry = Slot;
+		Slot = nullptr;
+		while (Entry != nullptr)
+		{
+			TimerEntry*const Next = Entry->Next;
+			if (Entry->Cancelled.load()) { Release(Entry); }
+			else { Insert(Entry); }
+			Entry = Next;
+		}
+	}
+
+	//	Process every millisecond up to Time, collecting due entries
+	inline void Advance(const unsigned long long Time, std::vector<TimerEntry*>& Due)
+	{
+		while (Current < Time)
+		{
+			++Current;
+			if ((Current & ((1 << PN_TimerBits) - 1)) == 0)
+			{
+				if (((Current >> PN_TimerBits) & ((1 << PN_TimerOuterBits) - 1)) == 0) {
+					Cascade(Outer[1][(Current >> (PN_TimerBits + PN_TimerOuterBits)) & ((1 << PN_TimerOuterBits) - 1)]);
+				}
+				Cascade(Outer[0][(Current >> PN_TimerBits) & ((1 << PN_TimerOuterBits) - 1)]);
+			}
+			TimerEntry*& Slot = Inner[Current & ((1 << PN_TimerBits) - 1)];
+			TimerEntry* Entry = Slot;
+			Slot = nullptr;
+			while (Entry != nullptr)
+			{
+				TimerEntry*const Next = Entry->Next;
+				if (Entry->Cancelled.load()) { Release(Entry); }
+				else if (Entry->Due > Current) { Insert(Entry); }
+				else { Due.push_back(Entry); }
+				Entry = Next;
+			}
+		}
+	}
+
+	//	The next millisecond anything could be due
+	inline const unsigned long long NextDue() const
+	{
+		for (unsigned long long i = 1; i < (1ull << PN_TimerBits); i++) {
+			if (Inner[(Current + i) & ((1 << PN_TimerBits) - 1)] != nullptr) { return Current + i; }
+		}
+		//	Nothing in the inner wheel; wake to cascade the next outer slot
+		return Current + (1ull << PN_TimerBits) - (Current & ((1 << PN_TimerBits) - 1));
+	}
+
+	inline void Drive()
+	{
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
+		std::vector<TimerEntry*> Due;
+		while (!Abort.load())
+		{
+			Mutex.lock();
+			Advance(Now(), Due);
+			Arm(NextDue());
+			Mutex.unlock();
+			for (auto Entry : Due) { Executor.Submit(Entry); }
+			Due.clear();
+			WaitForSingleObject(Timer, INFINITE);
+		}
+	}
+
+	//	The executor is created first so it outlives us
+	inline TimerWheel()
+		: Mutex(), Inner(), Outer(), Current(0), NextWake(0), Start(std::chrono::steady_clock::now()),
+		Executor(TaskExecutor::Instance()),
+		Timer(CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS)), Abort(false), Driver()
+	{
+		//	High resolution timers need Windows 10 1803; fall back to a regular one
+		if (Timer == NULL) { Timer = CreateWaitableTimer(NULL, FALSE, NULL); }
+		Driver = thread([&]() { Drive(); });
+	}
+
+public:
+	inline ~TimerWheel()
+	{
+		Abort.store(true);
+		LARGE_INTEGER Due;
+		Due.QuadPart = -1;
+		SetWaitableTimer(Timer, &Due, 0, NULL, NULL, FALSE);
+		Driver.join();
+		CloseHandle(Timer);
+	}
+
+	//	Every TimedEvent shares this one
+	inline static TimerWheel& Instance()
+	{
+		static TimerWheel Wheel;
+		return Wheel;
+	}
+
+	//	Start ticking Event every Interval milliseconds
+	inline TimerEntry*const Schedule(TimedEvent*const Event, const long long Interval)
+	{
+		TimerEntry*const Entry = new TimerEntry(Event, Interval);
+		Mutex.lock();
+		Entry->Due = Current + Interval;
+		Insert(Entry);
+		if (Entry->Due < NextWake) { Arm(Entry->Due); }
+		Mutex.unlock();
+		return Entry;
+	}
+
+	//	Tick an entry's owner then put it back in the wheel
+	//	Called by a TaskExecutor worker
+	inline void Run(TimerEntry*const Entry);
+
+	//	Stop ticking an entry and let go of it
+	//	Waits for a tick in progress to finish, unless it is the calling thread
+	//	Once this returns the owner will never be ticked again
+	inline void Cancel(TimerEntry*const Entry)
+	{
+		Entry->Cancelled.store(true);
+		if (Entry->Worker.load() != std::this_thread::get_id())
+		{
+			Entry->RunMutex.lock();
+			Entry->RunMutex.unlock();
+		}
+		Release(Entry);
+	}
+};
+
 class TimedEvent
 {
+	friend class TimerWheel;
+
 protected:
 	duration<long long, std::milli> IntervalTime;
 	const unsigned char MaxTicks;
 	unsigned char CurTicks;
-	bool Abort;
-	bool Running;
-	thread TimedThread;
+	std::atomic<bool> Running;
 
 private:
+	std::mutex TimerMutex;
+	TimerEntry* Entry;	//	Our place in the timer wheel while running
+	std::chrono::steady_clock::time_point NextPoll;	//	When PollTimer next ticks us
+
 	inline virtual void OnTick() = 0;
 	inline virtual void OnExpire() = 0;
 
+	//	Called by the timer wheel every interval
+	//	Returns false once expired; nothing here may be touched after OnTick returns, it may have deleted us
+	inline const bool Fire()
+	{
+		if (MaxTicks == 0 || CurTicks < MaxTicks)
+		{
+			OnTick();
+			return true;
+		}
+		OnExpire();
+		return false;
+	}
+
 public:
 
-	inline void StartTimer() { Running = true; }
-	inline void StopTimer() { Running = false; }
+	inline void StartTimer()
+	{
+		TimerMutex.lock();
+		if (Entry == nullptr) { Entry = TimerWheel::Instance().Schedule(this, IntervalTime.count()); }
+		Running = true;
+		TimerMutex.unlock();
+	}
+	//	Once this returns OnTick won't be called again, unless called from within OnTick itself
+	inline void StopTimer()
+	{
+		TimerMutex.lock();
+		Running = false;
+		TimerEntry*const Stopping = Entry;
+		Entry = nullptr;
+		TimerMutex.unlock();
+		if (Stopping != nullptr) { TimerWheel::Instance().Cancel(Stopping); }
+	}
 	inline const bool TimerRunning() const { return Running; }
 
+	//	Mark us running without scheduling anything; PollTimer does the ticking
+	inline void StartPolling()
+	{
+		TimerMutex.lock();
+		Running = true;
+		TimerMutex.unlock();
+	}
+
+	//	Tick from the callers own loop instead of the timer wheel
+	//	Calls OnTick if an interval has passed since it last did; never mix with StartTimer
+	//	Nothing may be touched after this returns, OnTick may have deleted us
+	inline void PollTimer(const std::chrono::steady_clock::time_point& Now)
+	{
+		if (!Running || Now < NextPoll) { return; }
+		NextPoll = Now + IntervalTime;
+		Fire();
+	}
+
 	//	TODO: Multiply LastRTT here by some small percentage
 	//	Based on the variation between the last few values of LastRTT
 	//	This will smooth out random hiccups in the network
-	inline void NewInterval(const long long &LastRTT) { IntervalTime = milliseconds((const unsigned int)ceil(LastRTT)); }
+	inline void NewInterval(const long long &LastRTT)
+	{
+		TimerMutex.lock();
+		IntervalTime = milliseconds((const unsigned int)ceil(LastRTT));
+		if (Entry != nullptr) { Entry->Interval.store(IntervalTime.count()); }
+		TimerMutex.unlock();
+	}
 
 	//	Constructor
 	inline TimedEvent(milliseconds Interval, const unsigned char iMaxTicks) :
-		IntervalTime(Interval), MaxTicks(iMaxTicks), CurTicks(0), Abort(false), Running(false),
-		TimedThread([&]() {
-		//
-		//	Make sure this thread uses the least amount of resources possible
-		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
-
-		while (!Abort)
-		{
-			if (Running)
-			{
-				if ((MaxTicks == 0 || CurTicks < MaxTicks))
-				{
-					OnTick();
-				} else { OnExpire(); return; }
-			}
-			std::this_thread::sleep_for(IntervalTime);
-		}	}) {}
+		IntervalTime(Interval), MaxTicks(iMaxTicks), CurTicks(0), Running(false), TimerMutex(), Entry(nullptr), NextPoll() {}
 
 	//	Destructor
-	inline virtual ~TimedEvent() {
-		Running = false;
-		Abort = true;
-		//	Would like to use .join() here instead
-		//	However that throws an odd exception..
-		TimedThread.detach();
-	}
-};
\ No newline at end of file
+	//	Derived classes must call StopTimer in their own destructor; by the time we get here OnTick is gone
+	inline virtual ~TimedEvent() { StopTimer(); }
+};
+
+inline void TimerEntry::Run() { TimerWheel::Instance().Run(this); }
+
+inline void TimerWheel::Run(TimerEntry*const Entry)
+{
+	bool Again = false;
+	Entry->RunMutex.lock();
+	Entry->Worker.store(std::this_thread::get_id());
+	if (!Entry->Cancelled.load()) { Again = Entry->Owner->Fire(); }
+	Entry->Worker.store(std::thread::id());
+	Entry->RunMutex.unlock();
+	//	Owner may have been deleted by its own tick; only Entry is safe to touch
+	if (!Again) { Entry->Cancelled.store(true); }
+	if (Entry->Cancelled.load()) { Release(Entry); return; }
+	Mutex.lock();
+	Entry->Due = Now() + Entry->Interval.load();
+	Insert(Entry);
+	if (Entry->Due < NextWake) { Arm(Entry->Due); }
+	Mutex.unlock();
+}
\ No newline at end of file